@@ -0,0 +1,89 @@
+// Context creation/teardown rate.
+//
+//   node --expose-gc bench/create-context.js [count] [--mock] [--per-instance]
+//
+// --mock swaps the binding for a no-op stand-in so the cost of the JS
+// wrapper can be measured on its own.
+//
+// --per-instance builds every context the way createContext did before the
+// wrapper moved onto the prototype: each accessor gets its own closures
+// and each method a bound copy, defined on the instance. Run with and
+// without it to compare the two.
+
+var context2d = require('../context2d');
+
+var argv = process.argv.slice(2);
+var mock = argv.indexOf('--mock') > -1;
+var perInstance = argv.indexOf('--per-instance') > -1;
+var count = parseInt(argv.filter(function(a) { return a[0] !== '-'; })[0], 10) || 20000;
+
+function MockContext2D(w, h) {
+  this.w = w;
+  this.h = h;
+}
+
+if (mock) {
+  // read before any context wraps the native prototype
+  var Context2D = require('bindings')('context2d').Context2D;
+  Object.keys(Context2D.prototype).forEach(function(name) {
+    MockContext2D.prototype[name] = function() {};
+  });
+
+  MockContext2D.prototype.setFillStyle =
+  MockContext2D.prototype.setStrokeStyle = function(c) { return c; };
+}
+
+var Ctor = mock ? MockContext2D : undefined;
+
+function redefine(ctx) {
+  var proto = Object.getPrototypeOf(ctx);
+  Object.getOwnPropertyNames(proto).forEach(function(name) {
+    var desc = Object.getOwnPropertyDescriptor(proto, name);
+    if (name === 'constructor' || ctx.hasOwnProperty(name)) {
+      return;
+    }
+
+    if (desc.get || desc.set) {
+      Object.defineProperty(ctx, name, {
+        get : desc.get && function() { return desc.get.call(ctx); },
+        set : desc.set && function(v) { desc.set.call(ctx, v); },
+        configurable: true
+      });
+    } else if (typeof desc.value === 'function') {
+      ctx[name] = desc.value.bind(ctx);
+    }
+  });
+}
+
+function run(n, draw) {
+  var start = process.hrtime();
+  for (var i = 0; i<n; i++) {
+    var ctx = context2d.createContext(null, 64, 64, Ctor);
+    if (perInstance) {
+      redefine(ctx);
+    }
+    if (draw) {
+      ctx.fillStyle = '#f00';
+      ctx.fillRect(0, 0, 32, 32);
+    }
+    ctx = null;
+  }
+
+  if (global.gc) {
+    global.gc();
+  }
+
+  var t = process.hrtime(start);
+  return n / (t[0] + t[1] / 1e9);
+}
+
+// warm up
+run(Math.min(count, 1000), true);
+
+var heap = process.memoryUsage().heapUsed;
+
+console.log('mode:', mock ? 'mock binding' : 'native binding',
+            perInstance ? 'per instance' : 'prototype', 'count:', count);
+console.log('create/teardown:        %d contexts/s', Math.round(run(count, false)));
+console.log('create/draw/teardown:   %d contexts/s', Math.round(run(count, true)));
+console.log('heap delta:             %d KB', Math.round((process.memoryUsage().heapUsed - heap) / 1024));
@@ -0,0 +1,71 @@
+// Pixel readback and writeback throughput.
+//
+//   node bench/image-data.js [iterations]
+//
+// Each size is filled with a mix of opaque, translucent and transparent
+// pixels so both the fast and the (un)premultiply paths are exercised.
+
+var context2d = require('../context2d');
+
+var argv = process.argv.slice(2);
+var iterations = parseInt(argv[0], 10) || 20;
+var sizes = [256, 1024, 4096];
+
+function fill(ctx, size) {
+  ctx.fillStyle = '#369';
+  ctx.fillRect(0, 0, size, size / 2);
+  ctx.fillStyle = 'rgba(200, 100, 50, 0.5)';
+  ctx.fillRect(0, size / 4, size, size / 2);
+}
+
+function time(n, fn) {
+  var start = process.hrtime();
+  for (var i = 0; i<n; i++) {
+    fn();
+  }
+  var t = process.hrtime(start);
+  return (t[0] * 1e3 + t[1] / 1e6) / n;
+}
+
+function report(name, size, ms) {
+  console.log('%s %d²: %s ms (%d MB/s)',
+    name, size, ms.toFixed(2), Math.round(size * size * 4 / 1048576 / (ms / 1000)));
+}
+
+sizes.forEach(function(size) {
+  var ctx = context2d.createContext(null, size, size);
+  fill(ctx, size);
+
+  // scale the iteration count down for the large surfaces
+  var n = Math.max(1, Math.round(iterations * 256 / size));
+
+  var ms = time(n, function() {
+    ctx.getImageData(0, 0, size, size);
+  });
+
+  report('getImageData', size, ms);
+
+  var id = ctx.getImageData(0, 0, size, size);
+  ms = time(n, function() {
+    ctx.putImageData(id, 0, 0);
+  });
+
+  report('putImageData', size, ms);
+
+  // a dirty rect hanging off the bottom right corner
+  ms = time(n, function() {
+    ctx.putImageData(id, size / 2, size / 2, 0, 0, size, size);
+  });
+
+  report('putImageData dirty', size, ms);
+
+  ['rgba8888', 'rgb888', 'rgb565', 'a8'].forEach(function(format) {
+    ms = time(n, function() {
+      ctx.toBuffer({ format: format });
+    });
+
+    report('toBuffer ' + format, size, ms);
+  });
+
+  ctx.release();
+});
@@ -3,6 +3,14 @@
     'context2d.gypi'
   ],
 
+  # optional codecs backed by the system libjpeg / libwebp / giflib, enable
+  # with node-gyp rebuild -- -Dwith_jpeg=1 -Dwith_webp=1 -Dwith_gif=1
+  'variables' : {
+    'with_jpeg%' : 0,
+    'with_webp%' : 0,
+    'with_gif%' : 0,
+  },
+
   'targets': [{
     'target_name' : 'context2d',
     'dependencies' : [
@@ -27,10 +35,33 @@
     ],
     'sources' : [
       'src/context2d.cc',
+      'src/color.cc',
+      'src/fontcache.cc',
+      'src/surfacepool.cc',
+      'src/pixelops.cc',
+      'src/imagebitmap.cc',
+      'src/encoder.cc',
+      'src/pngparallel.cc',
+      'src/decoder.cc',
+      'src/regionimage.cc',
+      'src/imagecache.cc',
+      'src/animatedimage.cc',
+      'src/picture.cc',
     ],
     'include_dirs' : [
       '<@(shared_include_dirs)'
     ],
+    'conditions' : [
+      ['with_jpeg == 1', {
+        'defines' : ['CONTEXT2D_JPEG'],
+      }],
+      ['with_webp == 1', {
+        'defines' : ['CONTEXT2D_WEBP'],
+      }],
+      ['with_gif == 1', {
+        'defines' : ['CONTEXT2D_GIF'],
+      }],
+    ],
   },
   {
     'target_name' : 'zlib',
@@ -549,6 +580,31 @@
 
     ],
     'conditions' : [
+      ['with_jpeg == 1', {
+        'sources' : [
+          'deps/skia/src/images/SkImageDecoder_libjpeg.cpp',
+          'deps/skia/src/images/SkJpegUtility.cpp',
+        ],
+        'link_settings' : {
+          'libraries' : ['-ljpeg']
+        }
+      }],
+      ['with_webp == 1', {
+        'sources' : [
+          'deps/skia/src/images/SkImageDecoder_libwebp.cpp',
+        ],
+        'link_settings' : {
+          'libraries' : ['-lwebp']
+        }
+      }],
+      ['with_gif == 1', {
+        'sources' : [
+          'deps/skia/src/images/SkImageDecoder_libgif.cpp',
+        ],
+        'link_settings' : {
+          'libraries' : ['-lgif']
+        }
+      }],
       ['OS == "mac"', {
         'cflags': [
           '-mssse3',
@@ -1,12 +1,14 @@
-var Context2D;
+var Context2D, binding;
 try {
-  Context2D = require('bindings')('context2d').Context2D;
+  binding = require('bindings')('context2d');
+  Context2D = binding.Context2D;
 } catch (e) {
   console.error(e.stack)
 }
-var csscolor = require('./lib/color');
+var commands = require('./lib/commands');
 var cssfont = require('cssfontparser');
 var util = require('util');
+var Readable = require('stream').Readable;
 var TAU = Math.PI*2;
 //
 var valid = function(a) {
@@ -77,8 +79,9 @@ function CanvasGradient(type, opts) {
       );
     }
 
-    var color = csscolor(color);
-    if (!color) {
+    // 0xAARRGGBB, handed straight to the gradient shader
+    var color = binding.parseColor(color);
+    if (typeof color === 'undefined') {
       throw new DOMException('color stop color', DOMException.SYNTAX_ERR);
     }
 
@@ -89,13 +92,11 @@ function CanvasGradient(type, opts) {
       stopCache[key]+=.0000001;
     }
 
-    color.array[3] *= 255;
-
     offset+=stopCache[key];
 
     stops.push({
       offset : offset,
-      color : color.array,
+      color : color,
       idx: idx++
     });
 
@@ -203,6 +204,285 @@ CanvasPattern.prototype.type = 'pattern';
 
 module.exports.CanvasPattern = CanvasPattern;
 
+// The premultiplied copy of an image's pixels that drawImage hands to the
+// binding. It is converted natively once and kept on the image, keyed by
+// the identity of its data plus image.generation; bump the latter after
+// changing the pixels in place.
+function premultiplied(image, id) {
+  var generation = image.generation || 0;
+  var cache = image._premultiplied;
+
+  if (!cache ||
+      cache.source !== id.data ||
+      cache.generation !== generation ||
+      cache.width !== id.width ||
+      cache.height !== id.height)
+  {
+    cache = {
+      source: id.data,
+      generation: generation,
+      width: id.width,
+      height: id.height,
+      data: binding.premultiply(id.data, id.width, id.height)
+    };
+
+    Object.defineProperty(image, '_premultiplied', {
+      value: cache,
+      writable: true,
+      configurable: true
+    });
+  }
+
+  return cache.data;
+}
+
+function isImageBitmap(obj) {
+  return !!binding && obj instanceof binding.ImageBitmap;
+}
+
+function isRegionImage(obj) {
+  return !!binding && obj instanceof binding.RegionImage;
+}
+
+function isAnimatedImage(obj) {
+  return !!binding && obj instanceof binding.AnimatedImage;
+}
+
+function isContext(obj) {
+  return !!binding && obj instanceof binding.Context2D;
+}
+
+// createImageBitmap(source): an ImageBitmap holding a premultiplied copy
+// of an image, canvas, context or ImageData. drawImage uses it without any
+// per draw conversion. Unlike the DOM version this returns synchronously.
+module.exports.createImageBitmap = function(source) {
+  if (!binding) {
+    throw new Error('could not create image bitmap, binding not loaded');
+  }
+
+  if (!source) {
+    throw new DOMException('invalid image', DOMException.TYPE_MISMATCH_ERR);
+  }
+
+  if (source.ctx) {
+    source = source.ctx;
+  }
+
+  var id, premultiplied = false;
+  if (isImageBitmap(source)) {
+    throw new DOMException('image is already an ImageBitmap', DOMException.TYPE_MISMATCH_ERR);
+  } else if (typeof source.toBuffer === 'function') {
+    // a context, its pixels already are in the native format. A copy:
+    // an alias would live until collected, making every draw on the
+    // source copy its surface and keeping that surface out of the pool
+    id = {
+      width: source.width,
+      height: source.height,
+      data: source.toBuffer()
+    };
+    premultiplied = true;
+  } else if (source.imageData) {
+    id = source.imageData;
+  } else {
+    id = source;
+  }
+
+  if (!id || !id.data || !id.width || !id.height) {
+    throw new DOMException('invalid image dimensions', DOMException.INVALID_STATE_ERR);
+  }
+
+  return new binding.ImageBitmap(id.data, id.width, id.height, premultiplied);
+};
+
+if (binding) {
+  module.exports.ImageBitmap = binding.ImageBitmap;
+  // new RegionImage(pngBuffer, [{ tileSize, maxTiles }]): a large PNG that
+  // drawImage decodes one source rect at a time, see src/regionimage.h
+  module.exports.RegionImage = binding.RegionImage;
+  // new AnimatedImage(gifBuffer, [{ frameCache }]): drawImage draws its
+  // currentFrame, anim.currentFrame = anim.frameAtTime(ms) seeks by time.
+  // See src/animatedimage.h
+  module.exports.AnimatedImage = binding.AnimatedImage;
+  // returned by ctx.endRecording(), see src/picture.h
+  module.exports.Picture = binding.Picture;
+}
+
+// Calls method on self with args plus a node style callback. Without fn
+// the result comes back as a Promise, where the runtime has them.
+var callbackOrPromise = function(self, method, args, fn) {
+  if (typeof fn === 'function' || typeof Promise === 'undefined') {
+    method.apply(self, args.concat(fn));
+    return;
+  }
+
+  return new Promise(function(resolve, reject) {
+    method.apply(self, args.concat(function(err, result) {
+      err ? reject(err) : resolve(result);
+    }));
+  });
+};
+
+// decodeImage(buffer, [options], [fn]): an ImageBitmap of the PNG, JPEG,
+// WebP or GIF in buffer, decoded off the main thread straight into surface
+// pixels. module.exports.decoders lists the formats this build can read.
+//
+// options.width / options.height: the size the image will be drawn at.
+// The decoder skips pixels by the largest power of two that still covers
+// it, drawImage does the final resample.
+// options.sampleSize: keep every nth pixel and row instead.
+module.exports.decodeImage = function(buffer, options, fn) {
+  if (!binding) {
+    throw new Error('could not decode image, binding not loaded');
+  }
+
+  if (typeof options === 'function') {
+    fn = options;
+    options = undefined;
+  }
+
+  return callbackOrPromise(binding, binding.decodeImage, [buffer, options], fn);
+};
+
+// Readable of PNG bytes, fed by a native PngEncoder one read() at a time.
+// Each step runs from setImmediate so a large export does not hold up I/O
+// and stops as soon as the consumer stops reading.
+function PngStream(encoder) {
+  Readable.call(this);
+  this._encoder = encoder;
+
+  // _destroy() only runs on node 8 and later
+  this.on('end', this._release);
+  this.on('close', this._release);
+}
+util.inherits(PngStream, Readable);
+
+// stops encoding and lets go of the frame
+PngStream.prototype._release = function() {
+  if (this._encoder) {
+    this._encoder.close();
+    this._encoder = null;
+  }
+};
+
+PngStream.prototype._read = function() {
+  var self = this;
+  setImmediate(function step() {
+    if (!self._encoder) {
+      return;
+    }
+
+    var chunk;
+    try {
+      chunk = self._encoder.read();
+    } catch (e) {
+      self._release();
+      self.emit('error', e);
+      return;
+    }
+
+    if (chunk === null) {
+      self._release();
+      self.push(null);
+    } else if (chunk.length) {
+      self.push(chunk);
+    } else {
+      setImmediate(step);
+    }
+  });
+};
+
+PngStream.prototype._destroy = function(err, cb) {
+  this._release();
+  cb(err);
+};
+
+// node before 8 has no destroy() on Readables
+if (typeof Readable.prototype.destroy !== 'function') {
+  PngStream.prototype.destroy = function(err) {
+    this._release();
+    if (err) {
+      this.emit('error', err);
+    }
+    this.emit('close');
+  };
+}
+
+module.exports.CommandBuffer = commands.CommandBuffer;
+module.exports.commands = commands.commands;
+
+if (binding) {
+  module.exports.parseColor = binding.parseColor;
+  // formats the to*Buffer methods can produce in this build
+  module.exports.encoders = binding.encoders;
+  module.exports.decoders = binding.decoders;
+
+  // createLazyImage(buffer): an ImageBitmap that keeps the encoded image and
+  // decodes on draw into a process wide, budgeted cache. Evicted pixels are
+  // decoded again on the next draw. setImageCacheLimit(bytes) sets the
+  // budget (64MB by default, 0 for none), imageCacheStats() reports usage.
+  module.exports.createLazyImage = binding.createLazyImage;
+  module.exports.imageCacheStats = binding.imageCacheStats;
+  module.exports.setImageCacheLimit = binding.setImageCacheLimit;
+  module.exports.colorCacheStats = binding.colorCacheStats;
+}
+
+// Parsed font strings. cssfontparser resolves relative sizes against the
+// current font, so that is part of the key. Typefaces and metrics are
+// cached natively, see src/fontcache.cc
+var parsedFonts = Object.create(null);
+var parsedFontStats = { hits: 0, misses: 0, entries: 0, limit: 64 };
+
+var parseFont = function(val, parent) {
+  var key = val + '\n' + parent;
+  var f = parsedFonts[key];
+
+  if (typeof f !== 'undefined') {
+    parsedFontStats.hits++;
+    return f;
+  }
+
+  parsedFontStats.misses++;
+  if (parsedFontStats.entries >= parsedFontStats.limit) {
+    parsedFonts = Object.create(null);
+    parsedFontStats.entries = 0;
+  }
+
+  f = null;
+  var parsed = cssfont(val, parent);
+  if (parsed && parsed.family !== 'default' && parsed.family !== 'initial') {
+    f = {
+      string : parsed.toString(),
+      family : parsed.family.split(', ')[0],
+      size : parsed.size
+    };
+  }
+
+  parsedFonts[key] = f;
+  parsedFontStats.entries++;
+  return f;
+};
+
+module.exports.fontCacheStats = function() {
+  var stats = binding.fontCacheStats();
+  stats.parsed = {
+    hits : parsedFontStats.hits,
+    misses : parsedFontStats.misses,
+    entries : parsedFontStats.entries,
+    limit : parsedFontStats.limit
+  };
+  return stats;
+};
+
+// limits both the parsed font strings and the resolved typefaces
+module.exports.setFontCacheLimit = function(limit) {
+  binding.setFontCacheLimit(limit);
+  parsedFontStats.limit = limit;
+  if (parsedFontStats.entries > limit) {
+    parsedFonts = Object.create(null);
+    parsedFontStats.entries = 0;
+  }
+};
+
 
 function ContextState() {
 
@@ -220,18 +500,11 @@ ContextState.prototype = {
   globalCompositeOperation: 'source-over',
   globalAlpha: 1,
   font: '10px sans-serif',
+  fontSize: 10,
   lineWidth : 1,
   lineCap : 'butt',
   lineJoin : 'miter',
   miterLimit : 10,
-  apply: function(ctx) {
-    var that = this;
-    Object.keys(this).forEach(function(key) {
-      if (typeof that[key] !== 'function') {
-        ctx[key] = that[key];
-      }
-    });
-  },
   clone : function() {
     var ret = new ContextState();
     var that = this;
@@ -245,114 +518,180 @@ ContextState.prototype = {
   }
 };
 
-module.exports.createContext = function(canvas, w, h, ContextCtor) {
+var lineJoinMap = {
+  miter : 0,
+  round : 1,
+  bevel : 2
+};
 
-  ContextCtor = ContextCtor || Context2D;
+var lineCapMap = {
+  butt : 0,
+  round : 1,
+  square : 2
+};
 
-  if (!ContextCtor) {
-    throw new Error('could not create context, binding not loaded');
-  }
+var textAlignMap = {
+  start : 0,
+  end : 2,
+  left : 0,
+  center : 1,
+  right : 2
+};
 
-  var state = new ContextState();
-  var stateStack = [];
+var textBaselineMap = {
+  top : 0,
+  hanging : 1,
+  middle : 2,
+  alphabetic: 3,
+  ideographic : 4,
+  bottom : 5
+};
 
-  canvas = canvas || {
-    width : w || 300,
-    height: h || 150
-  };
+var compositeMap = {
+  'source-atop' : 9,
+  'source-in' : 5,
+  'source-out' : 7,
+  'source-over' : 3,
+  'destination-atop' : 10,
+  'destination-in' : 6,
+  'destination-out' : 8,
+  'destination-over' : 4,
+  'lighter' : 12,
+  'copy' : 1,
+  'xor' : 11
+};
 
-  canvas.dir = canvas.dir || 'ltr';
+var patternModeMap = {
+  'repeat' : 1,
+  'repeat-x' : 1,
+  'repeat-y' : 1,
+  'no-repeat' : 1
+};
 
-  var ret = new ContextCtor(canvas.width, canvas.height);
+var nonspaceRemoval = /[\x00-\x1f]+[\x00-\x1f ]+[\x00-\x1f]+/g;
+var collapseText = function(str) {
+  str = (str + '').replace(/  /g, ' ');
+  return str.replace(nonspaceRemoval, '').trim();
+};
 
-  var override = function(orig, fn) {
-    ret[orig] = fn.bind(ret, ret[orig].bind(ret))
-  };
+var validateWH = function(w, h) {
+  if (!valid(w) || !valid(h)) {
+    throw new DOMException('invalid dimensions', DOMException.NOT_SUPPORTED_ERR);
+  }
 
-  if (typeof canvas.width !== 'undefined' &&
-      typeof canvas.width !== 'undefined' &&
-      typeof canvas.addEventListener === 'function'
-    )
-  {
-    canvas.addEventListener('resize', function(ev) {
-      ret.width = canvas.width;
-      ret.height = canvas.height;
-    });
+  if (!w || !h) {
+    throw new DOMException('invalid dimensions', DOMException.INDEX_SIZE_ERR);
   }
+};
 
-  ret.dirty = false;
+var currentColor = function(canvas) {
+  if (canvas.getAttribute) {
+    var style = canvas.getAttribute('style') || '';
+    var currentMatch = style.match(/color: ?([^\);]+)/);
+    if (currentMatch && currentMatch.length > 1) {
+      return currentMatch[1];
+    }
+  }
+  return '#000000';
+};
+
+// The accessors and argument validation below are installed once on the
+// prototype of each native constructor handed to createContext, so a new
+// context only has to allocate its own state. Per instance data lives in
+// _state, _stateStack, _recordingDepth and _fonts.
+var wrappedConstructors = [];
 
-  Object.defineProperty(ret, 'width', {
-    get : function() { return canvas.width },
+var wrap = function(ContextCtor) {
+  if (wrappedConstructors.indexOf(ContextCtor) > -1) {
+    return;
+  }
+  wrappedConstructors.push(ContextCtor);
+
+  var proto = ContextCtor.prototype;
+
+  // replace a native method, factory receives the original
+  var override = function(name, factory) {
+    proto[name] = factory(proto[name]);
+  };
+
+  // drops the saves a recording left open, like the native side does when
+  // the recording ends or the surface goes away under it
+  var closeRecording = function(ctx) {
+    while (ctx._stateStack.length > ctx._recordingDepth) {
+      ctx._state = ctx._stateStack.pop();
+    }
+    ctx._recordingDepth = 0;
+  };
+
+  Object.defineProperty(proto, 'width', {
+    get : function() { return this.canvas.width },
     set : function(w) {
+      var canvas = this.canvas;
       if (canvas.width !== w) {
         canvas.width = w;
-        ret.resize(canvas.width, canvas.height);
-        ret.dirty = true;
+        this.resize(canvas.width, canvas.height);
+        this.dirty = true;
       }
     }
   });
 
-  Object.defineProperty(ret, 'height', {
-    get : function() { return canvas.height },
+  Object.defineProperty(proto, 'height', {
+    get : function() { return this.canvas.height },
     set : function(h) {
+      var canvas = this.canvas;
       if (canvas.h !== h) {
         canvas.height = h;
-        ret.resize(canvas.width, canvas.height);
-        ret.dirty = true;
+        this.resize(canvas.width, canvas.height);
+        this.dirty = true;
       }
     }
   });
 
+  // a new surface ends any recording, on this side too
+  override('resize', function(resize) {
+    return function(w, h) {
+      resize.call(this, w, h);
+      closeRecording(this);
+    };
+  });
 
-  Object.defineProperty(ret, 'canvas', {
-    value : canvas
+  // the surface is gone, the size reported has to follow
+  override('release', function(release) {
+    return function() {
+      release.call(this);
+      closeRecording(this);
+      this.canvas.width = 0;
+      this.canvas.height = 0;
+    };
   });
 
-  Object.defineProperty(ret, 'globalAlpha', {
-    get : function() { return state.globalAlpha; },
+  Object.defineProperty(proto, 'globalAlpha', {
+    get : function() { return this._state.globalAlpha; },
     set : function(v) {
       if (!isNaN(v) && isFinite(v) && v >= 0 && v <= 1) {
-        state.globalAlpha = v;
-        ret.setGlobalAlpha(v);
-        ret.dirty = true;
+        this._state.globalAlpha = v;
+        this.setGlobalAlpha(v);
+        this.dirty = true;
       }
     }
   });
 
-  Object.defineProperty(ret, 'globalCompositeOperation', {
+  Object.defineProperty(proto, 'globalCompositeOperation', {
     get : function() {
-      return state.globalCompositeOperation;
+      return this._state.globalCompositeOperation;
     },
     set : function(str) {
-      var mapping = {
-        'source-atop' : 9,
-        'source-in' : 5,
-        'source-out' : 7,
-        'source-over' : 3,
-        'destination-atop' : 10,
-        'destination-in' : 6,
-        'destination-out' : 8,
-        'destination-over' : 4,
-        'lighter' : 12,
-        'copy' : 1,
-        'xor' : 11
-      };
-
-      if (mapping[str]) {
-        state.globalCompositeOperation = str;
-        ret.setGlobalCompositeOperation(mapping[str]);
-        ret.dirty = true;
+      if (compositeMap[str]) {
+        this._state.globalCompositeOperation = str;
+        this.setGlobalCompositeOperation(compositeMap[str]);
+        this.dirty = true;
       }
     }
   });
 
-
-
-
-  Object.defineProperty(ret, 'fillStyle', {
+  Object.defineProperty(proto, 'fillStyle', {
     get : function() {
-      return state.fillStyle;
+      return this._state.fillStyle;
     },
     set : function(c) {
       if (!c) {
@@ -360,48 +699,35 @@ module.exports.createContext = function(canvas, w, h, ContextCtor) {
       }
 
       if (c === 'currentColor') {
-        if (canvas.getAttribute) {
-          var style = canvas.getAttribute('style') || '';
-          var currentMatch = style.match(/color: ?([^\);]+)/);
-          if (currentMatch && currentMatch.length > 1) {
-            c = currentMatch[1];
-          } else {
-            c = '#000000';
-          }
-        } else {
-          c = '#000000';
-        }
+        c = currentColor(this.canvas);
       }
 
       if (c.type) {
         if (c.type === 'pattern') {
           var id = c.imageData;
           if (id) {
-            ret.setFillStylePattern(new Buffer(id.data), id.width, id.height, !!c.x, !!c.y);
-            state.fillStyle = c;
+            this.setFillStylePattern(new Buffer(id.data), id.width, id.height, !!c.x, !!c.y);
+            this._state.fillStyle = c;
           } else {
-            ret.fillStyle = 'rgba(0, 0, 0, 0.0)';
+            this.fillStyle = 'rgba(0, 0, 0, 0.0)';
           }
         } else if (c.type === 'gradient') {
-          state.fillStyle = c;
+          this._state.fillStyle = c;
         }
         return;
       } else {
-        var color = csscolor(c);
+        // parsed and interned natively, returns the serialized color
+        var color = this.setFillStyle(c);
         if (color) {
-          state.fillStyle = color.string;
-          color = color.array;
-
-          color[3] = color[3] * 255;
-          ret.setFillStyle.apply(ret, color);
+          this._state.fillStyle = color;
         }
       }
     }
   });
 
-  Object.defineProperty(ret, 'strokeStyle', {
+  Object.defineProperty(proto, 'strokeStyle', {
     get : function() {
-      return state.strokeStyle;
+      return this._state.strokeStyle;
     },
     set : function(c) {
       if (!c) {
@@ -409,31 +735,17 @@ module.exports.createContext = function(canvas, w, h, ContextCtor) {
       }
 
       if (c === 'currentColor') {
-        if (canvas.getAttribute) {
-          var style = canvas.getAttribute('style') || '';
-          var currentMatch = style.match(/color: ?([^\);]+)/);
-          if (currentMatch && currentMatch.length > 1) {
-            c = currentMatch[1];
-          } else {
-            c = '#000000';
-          }
-        } else {
-          c = '#000000';
-        }
+        c = currentColor(this.canvas);
       }
 
-      var color = csscolor(c);
+      var color = this.setStrokeStyle(c);
       if (color) {
-        state.strokeStyle = color.string;
-        color = color.array;
-
-        color[3] = color[3] * 255;
-        ret.setStrokeStyle.apply(ret, color);
+        this._state.strokeStyle = color;
       }
     }
   });
 
-  ret.drawImage = function(i) {
+  proto.drawImage = function(i) {
     requireArgs(arguments, 3);
 
     var args = [];
@@ -458,62 +770,55 @@ module.exports.createContext = function(canvas, w, h, ContextCtor) {
       return;
     }
 
-    var needsSwizzle = true;
-
-    if (i.getContext && (!i.width || !i.height)) {
-      throw new DOMException('invalid canvas dimensions', DOMException.INVALID_STATE_ERR);
+    if (isAnimatedImage(i)) {
+      i = i.getFrame(i.currentFrame);
     }
 
-    // Handle Canvas elements
-    if (i.ctx) {
-      i = i.ctx;
-      needsSwizzle = false;
-    }
+    var id, data;
+
+    if (isImageBitmap(i) || isRegionImage(i)) {
+      // premultiplied natively, up front or per source rect
+      id = i;
+    } else {
+      var needsSwizzle = true;
 
-    if (!i.imageData) {
-      needsSwizzle = false;
-      var buffer = new Buffer(i.width * i.height * 4);
-      buffer.fill(0);
-      i.imageData = {
-        width : i.width,
-        height: i.height,
-        data:  buffer
+      if (i.getContext && (!i.width || !i.height)) {
+        throw new DOMException('invalid canvas dimensions', DOMException.INVALID_STATE_ERR);
       }
-    }
 
-    var id = i.imageData;
+      // Handle Canvas elements
+      if (i.ctx) {
+        i = i.ctx;
+        needsSwizzle = false;
+      }
+
+      if (isContext(i)) {
+        // drawn natively from a snapshot of its surface, nothing to copy
+        id = i;
+      } else {
+        if (!i.imageData) {
+          needsSwizzle = false;
+          var buffer = new Buffer(i.width * i.height * 4);
+          buffer.fill(0);
+          i.imageData = {
+            width : i.width,
+            height: i.height,
+            data:  buffer
+          }
+        }
+
+        id = i.imageData;
+      }
+    }
 
     if (!id.width || !id.height) {
       throw new DOMException('invalid image dimensions', DOMException.INVALID_STATE_ERR);
     }
 
-    if (needsSwizzle && !i.swizzled) {
-      var pre = function(component, alpha) {
-        var prod = (component * alpha) + 128;
-        return (prod + (prod >> 8)) >> 8;
-      }
-      var win32 = process.platform === 'win32';
-      var length = id.data.length;
-      for (var i = 0; i<length; i+=4) {
-
-        var a = id.data[i+3];
-            r = pre(id.data[i], a),
-            g = pre(id.data[i+1], a),
-            b = pre(id.data[i+2], a);
-
-        if (win32) {
-          id.data[i+2] = r;
-          id.data[i+1] = g;
-          id.data[i] = b;
-          id.data[i+3] = a;
-        } else {
-          id.data[i] = r;
-          id.data[i+1] = g;
-          id.data[i+2] = b;
-          id.data[i+3] = a;
-        }
-      }
-      i.swizzled = true;
+    if (id !== i) {
+      // image pixels are unpremultiplied RGBA, the surface wants them
+      // premultiplied in native order
+      data = needsSwizzle ? premultiplied(i, id) : id.data;
     }
 
     var sx = 0,
@@ -611,124 +916,115 @@ module.exports.createContext = function(canvas, w, h, ContextCtor) {
       throw new DOMException('invalid image dimensions (' + i.src + ')', DOMException.INDEX_SIZE_ERR);
     }
 
-    ret.drawImageBuffer(id.data, sx, sy, sw, sh, dx, dy, dw, dh, id.width, id.height);
-    ret.dirty = true;
+    if (data) {
+      this.drawImageBuffer(data, sx, sy, sw, sh, dx, dy, dw, dh, id.width, id.height);
+    } else if (isRegionImage(i)) {
+      this.drawRegionImage(i, sx, sy, sw, sh, dx, dy, dw, dh);
+    } else if (isContext(i)) {
+      this.drawContext(i, sx, sy, sw, sh, dx, dy, dw, dh);
+    } else {
+      this.drawImageBitmap(i, sx, sy, sw, sh, dx, dy, dw, dh);
+    }
+    this.dirty = true;
   };
 
 
-  Object.defineProperty(ret, 'imageData', {
+  Object.defineProperty(proto, 'imageData', {
     get : function() {
+      var self = this;
       return {
-        width : ret.width,
-        height: ret.height,
+        width : self.width,
+        height: self.height,
+        // a copy: an alias would live until collected, making every draw
+        // on this context copy its surface and keeping that surface out of
+        // the pool. drawImage() draws contexts without going through here
         get data() {
-          return ret.toBuffer();
+          return self.toBuffer();
         }
       }
     }
   });
 
-  Object.defineProperty(ret, 'shadowOffsetX', {
-    get : function() { return state.shadowOffsetX; },
+  Object.defineProperty(proto, 'shadowOffsetX', {
+    get : function() { return this._state.shadowOffsetX; },
     set : function(val) {
       if (!valid(val)) {
         return;
       }
 
-      state.shadowOffsetX = val;
+      this._state.shadowOffsetX = val;
 
-      ret.setShadowOffsetX(val);
+      this.setShadowOffsetX(val);
     }
   });
 
-  Object.defineProperty(ret, 'shadowOffsetY', {
-    get : function() { return state.shadowOffsetY; },
+  Object.defineProperty(proto, 'shadowOffsetY', {
+    get : function() { return this._state.shadowOffsetY; },
     set : function(val) {
       if (!valid(val)) {
         return;
       }
 
-      state.shadowOffsetY = val;
+      this._state.shadowOffsetY = val;
 
-      ret.setShadowOffsetY(val);
+      this.setShadowOffsetY(val);
     }
   });
 
-  Object.defineProperty(ret, 'shadowBlur', {
-    get : function() { return state.shadowBlur; },
+  Object.defineProperty(proto, 'shadowBlur', {
+    get : function() { return this._state.shadowBlur; },
     set : function(val) {
       if (val < 0 || !valid(val)) {
         return;
       }
 
-      state.shadowBlur = val;
+      this._state.shadowBlur = val;
 
-      ret.setShadowBlur(val);
+      this.setShadowBlur(val);
     }
   });
 
-  Object.defineProperty(ret, 'shadowColor', {
-    get : function() { return state.shadowColor; },
+  Object.defineProperty(proto, 'shadowColor', {
+    get : function() { return this._state.shadowColor; },
     set : function(c) {
-      var color = csscolor(c);
+      var color = this.setShadowColor(c);
       if (color) {
-        state.shadowColor = color.string;
-        color = color.array;
-
-        color[3] = color[3] * 255;
-        ret.setShadowColor(
-          color[0],
-          color[1],
-          color[2],
-          color[3]
-        );
+        this._state.shadowColor = color;
       }
     }
   });
 
-  var lineJoinMap = {
-    miter : 0,
-    round : 1,
-    bevel : 2
-  };
-
-  Object.defineProperty(ret, 'lineJoin', {
+  Object.defineProperty(proto, 'lineJoin', {
     get : function() {
-      return state.lineJoin;
+      return this._state.lineJoin;
     },
     set : function(val) {
       if (typeof lineJoinMap[val] !== 'undefined') {
-        state.lineJoin = val;
-        ret.setLineJoin(lineJoinMap[val]);
+        this._state.lineJoin = val;
+        this.setLineJoin(lineJoinMap[val]);
       }
     }
   });
 
-  var lineCapMap = {
-    butt : 0,
-    round : 1,
-    square : 2
-  };
-
-  Object.defineProperty(ret, 'lineCap', {
+  Object.defineProperty(proto, 'lineCap', {
     get : function() {
-      return state.lineCap;
+      return this._state.lineCap;
     },
     set : function(val) {
       if (typeof lineCapMap[val] !== 'undefined') {
-        state.lineCap = val;
-        ret.setLineCap(lineCapMap[val]);
+        this._state.lineCap = val;
+        this.setLineCap(lineCapMap[val]);
       }
     }
   });
 
 
-  Object.defineProperty(ret, 'miterLimit', {
-    get: function() { return state.miterLimit; },
+  Object.defineProperty(proto, 'miterLimit', {
+    get: function() { return this._state.miterLimit; },
     set: function(val) {
       if (valid(val) && val > 0) {
-        state.miterLimit = val;
-        ret.setMiterLimit(val);
+        this._state.miterLimit = val;
+        this.setMiterLimit(val);
       }
     }
   });
@@ -738,36 +1034,39 @@ module.exports.createContext = function(canvas, w, h, ContextCtor) {
 //            attribute double lineDashOffset;
 
 
-  var fontCache = {};
-  override('addFont', function(addFont, name, buffer) {
-
-    var fontId = addFont(buffer);
-    fontCache[name] = fontId;
-    return fontId;
+  override('addFont', function(addFont) {
+    return function(name, buffer) {
+      var fontId = addFont.call(this, buffer);
+      this._fonts = this._fonts || {};
+      this._fonts[name] = fontId;
+      return fontId;
+    };
   });
 
 
 
-  Object.defineProperty(ret, 'font', {
+  Object.defineProperty(proto, 'font', {
     get : function() {
-      return state.font;
+      return this._state.font;
     },
     set: function (val) {
       if (!val || val.indexOf('inherit') > -1) {
         return
       }
 
-      var f = cssfont(val, state.font);
-      if (f && f.family !== 'default' && f.family !== 'initial') {
-        state.font = f.toString();
+      var state = this._state;
+      var f = parseFont(val, state.font);
+      if (f) {
+        state.font = f.string;
+        state.fontSize = f.size;
 
-        var family = f.family.split(', ')[0];
+        var family = f.family;
 
-        if (fontCache[family]) {
-          family = fontCache[family];
+        if (this._fonts && this._fonts[family]) {
+          family = this._fonts[family];
         }
 
-        ret.setFont(
+        this.setFont(
           family,
           false, false, f.size);
       }
@@ -775,65 +1074,41 @@ module.exports.createContext = function(canvas, w, h, ContextCtor) {
   });
 
 
-  var textAlignMap = {
-    start : 0,
-    end : 2,
-    left : 0,
-    center : 1,
-    right : 2
-  };
-
-  Object.defineProperty(ret, 'textAlign', {
-    get : function() { return state.textAlign; },
+  Object.defineProperty(proto, 'textAlign', {
+    get : function() { return this._state.textAlign; },
     set : function(val) {
       if (!val || typeof textAlignMap[val] === 'undefined') {
         return;
       }
 
-      state.textAlign = val;
+      this._state.textAlign = val;
       var intVal = textAlignMap[val] || 0;
 
-      if (canvas.dir === 'rtl') {
+      if (this.canvas.dir === 'rtl') {
         intVal += 2;
         if (intVal > 2) { intVal = 0;}
       }
 
-      ret.setTextAlign(intVal);
+      this.setTextAlign(intVal);
     }
   });
 
 
-  var textBaselineMap = {
-    top : 0,
-    hanging : 1,
-    middle : 2,
-    alphabetic: 3,
-    ideographic : 4,
-    bottom : 5
-  };
-
-  Object.defineProperty(ret, 'textBaseline', {
-    get : function() { return state.textBaseline; },
+  Object.defineProperty(proto, 'textBaseline', {
+    get : function() { return this._state.textBaseline; },
     set : function(val) {
       if (!val || typeof textBaselineMap[val] === 'undefined') {
         return;
       }
 
-      state.textBaseline = val;
-      ret.setTextBaseline(val);
+      this._state.textBaseline = val;
+      this.setTextBaseline(textBaselineMap[val]);
     }
   });
 
 
-  var patternModeMap = {
-    'repeat' : 1,
-    'repeat-x' : 1,
-    'repeat-y' : 1,
-    'no-repeat' : 1
-  };
-
   // The real work here is done in .setFillStyle and friends
-  ret.createPattern = function(obj, mode) {
+  proto.createPattern = function(obj, mode) {
     requireArgs(arguments, 2);
 
     if (!obj || typeof obj === 'string' || obj.split) {
@@ -873,7 +1148,7 @@ module.exports.createContext = function(canvas, w, h, ContextCtor) {
     );
   };
 
-  ret.createLinearGradient = function(x0, y0, x1, y1) {
+  proto.createLinearGradient = function(x0, y0, x1, y1) {
     requireArgs(arguments, 4);
 
     return new CanvasGradient('linear', {
@@ -884,7 +1159,7 @@ module.exports.createContext = function(canvas, w, h, ContextCtor) {
     });
   };
 
-  ret.createRadialGradient = function(x0, y0, r0, x1, y1, r1) {
+  proto.createRadialGradient = function(x0, y0, r0, x1, y1, r1) {
     return new CanvasGradient('radial', {
       x0 : x0,
       y0 : y0,
@@ -895,7 +1170,7 @@ module.exports.createContext = function(canvas, w, h, ContextCtor) {
     });
   };
 
-  ret.setTransform = function(a,b,c,d,e,f) {
+  proto.setTransform = function(a,b,c,d,e,f) {
     requireArgs(arguments, 6);
 
     if (!valid(a) ||
@@ -913,14 +1188,14 @@ module.exports.createContext = function(canvas, w, h, ContextCtor) {
 
   };
 
-  override('fillRect', function(fillRect, x, y, w, h) {
-    requireArgs(arguments, 5);
+  override('fillRect', function(fillRect) {
+    return function(x, y, w, h) {
+      requireArgs(arguments, 4);
 
-    if (state.fillStyle) {
-      var fs = state.fillStyle;
-      if (fs.type) {
+      var fs = this._state.fillStyle;
+      if (fs && fs.type) {
         if (fs.type === 'gradient') {
-          if (!state.fillStyle.apply(ret)) {
+          if (!fs.apply(this)) {
             return;
           }
 
@@ -948,206 +1223,273 @@ module.exports.createContext = function(canvas, w, h, ContextCtor) {
           }
         }
       }
-    }
 
-    fillRect(x, y, w, h);
-    ret.dirty = true;
+      fillRect.call(this, x, y, w, h);
+      this.dirty = true;
+    };
   });
 
-  override('clearRect', function(clearRect, x, y, w, h) {
-    requireArgs(arguments, 5);
+  override('clearRect', function(clearRect) {
+    return function(x, y, w, h) {
+      requireArgs(arguments, 4);
 
-    if (!valid(x) || !valid(y) || !valid(w) || !valid(h)) {
-      return;
-    }
+      if (!valid(x) || !valid(y) || !valid(w) || !valid(h)) {
+        return;
+      }
 
-    if (!w && !h) {
-      return;
-    }
+      if (!w && !h) {
+        return;
+      }
 
-    clearRect(x, y, w, h);
-    ret.dirty = true;
+      clearRect.call(this, x, y, w, h);
+      this.dirty = true;
+    };
   });
 
-  override('strokeRect', function(strokeRect, x, y, w, h) {
-    requireArgs(arguments, 5);
+  override('strokeRect', function(strokeRect) {
+    return function(x, y, w, h) {
+      requireArgs(arguments, 4);
 
-    if (!valid(x) || !valid(y) || !valid(w) || !valid(h)) {
-      return;
-    }
+      if (!valid(x) || !valid(y) || !valid(w) || !valid(h)) {
+        return;
+      }
 
 
-    if (!w && !h) {
-      return;
-    }
+      if (!w && !h) {
+        return;
+      }
 
-    strokeRect(x, y, w, h);
-    ret.dirty = true;
+      strokeRect.call(this, x, y, w, h);
+      this.dirty = true;
+    };
   });
 
   override('stroke', function(stroke) {
-    stroke();
-    ret.dirty = true;
+    return function() {
+      stroke.call(this);
+      this.dirty = true;
+    };
   });
 
   override('fill', function(fill) {
-    fill();
-    ret.dirty = true;
+    return function() {
+      fill.call(this);
+      this.dirty = true;
+    };
   });
 
-  override('scale', function(scale, x, y) {
-    requireArgs(arguments, 3);
+  override('scale', function(scale) {
+    return function(x, y) {
+      requireArgs(arguments, 2);
 
-    if (!valid(x) || !valid(y)) {
-      return;
-    }
-    scale(x, y);
+      if (!valid(x) || !valid(y)) {
+        return;
+      }
+      scale.call(this, x, y);
+    };
   });
 
-  override('translate', function(translate, x, y) {
-    requireArgs(arguments, 3);
+  override('translate', function(translate) {
+    return function(x, y) {
+      requireArgs(arguments, 2);
 
-    if (!valid(x) || !valid(y)) {
-      return;
-    }
-    translate(x, y);
+      if (!valid(x) || !valid(y)) {
+        return;
+      }
+      translate.call(this, x, y);
+    };
   });
 
-  override('transform', function(transform, a, b, c, d, e, f) {
-    requireArgs(arguments, 7);
-
-    if (!valid(a) ||
-        !valid(b) ||
-        !valid(c) ||
-        !valid(d) ||
-        !valid(e) ||
-        !valid(f)
-    ) {
-      return;
-    }
+  override('transform', function(transform) {
+    return function(a, b, c, d, e, f) {
+      requireArgs(arguments, 6);
+
+      if (!valid(a) ||
+          !valid(b) ||
+          !valid(c) ||
+          !valid(d) ||
+          !valid(e) ||
+          !valid(f)
+      ) {
+        return;
+      }
 
-    transform(a, b, c, d, e, f);
+      transform.call(this, a, b, c, d, e, f);
+    };
   });
 
-  override('rotate', function(rotate, rads) {
-    requireArgs(arguments, 2);
+  // drawPicture(picture, [matrix]): plays back a Picture from
+  // endRecording() through the current transform and then matrix, given as
+  // [a, b, c, d, e, f] or an object with a to f like a DOMMatrix
+  override('drawPicture', function(drawPicture) {
+    return function(picture, matrix) {
+      requireArgs(arguments, 1);
 
-    if (!valid(rads)) {
-      return;
-    }
-    rotate(rads);
+      var m = matrix || [1, 0, 0, 1, 0, 0];
+      if (!Array.isArray(m)) {
+        m = [m.a, m.b, m.c, m.d, m.e, m.f];
+      }
+
+      if (m.length !== 6 || !m.every(valid)) {
+        throw new DOMException('invalid matrix', DOMException.TYPE_MISMATCH_ERR);
+      }
+
+      drawPicture.call(this, picture, m[0], m[1], m[2], m[3], m[4], m[5]);
+      this.dirty = true;
+    };
   });
 
-  var validateWH = function(w, h) {
-    if (!valid(w) || !valid(h)) {
-      throw new DOMException('invalid dimensions', DOMException.NOT_SUPPORTED_ERR);
-    }
+  override('rotate', function(rotate) {
+    return function(rads) {
+      requireArgs(arguments, 1);
 
-    if (!w || !h) {
-      throw new DOMException('invalid dimensions', DOMException.INDEX_SIZE_ERR);
-    }
-  }
+      if (!valid(rads)) {
+        return;
+      }
+      rotate.call(this, rads);
+    };
+  });
 
-  override('getImageData', function(getImageData, sx, sy, sw, sh) {
-    if (!valid(sx) || !valid(sy)) {
-      throw new DOMException('invalid coords', DOMException.NOT_SUPPORTED_ERR);
-    }
+  override('getImageData', function(getImageData) {
+    return function(sx, sy, sw, sh) {
+      if (!valid(sx) || !valid(sy)) {
+        throw new DOMException('invalid coords', DOMException.NOT_SUPPORTED_ERR);
+      }
 
-    validateWH(sw, sh);
+      validateWH(sw, sh);
 
-    if (sw + sx < 0 ||
-        sh + sy < 0 ||
-        sx + sw > ret.width ||
-        sh + sy > ret.height)
-    {
-      sw = Math.abs(sw);
-      sh = Math.abs(sh);
+      if (sw + sx < 0 ||
+          sh + sy < 0 ||
+          sx + sw > this.width ||
+          sh + sy > this.height)
+      {
+        sw = Math.abs(sw);
+        sh = Math.abs(sh);
 
-      var buf = new Buffer(sw * sh * 4);
-      buf.fill(0);
-      return new ImageData(buf, sw, sh);
-    }
+        var buf = new Buffer(sw * sh * 4);
+        buf.fill(0);
+        return new ImageData(buf, sw, sh);
+      }
 
 
-    if (sw < 0) {
-      sx += sw;
-      sw = Math.abs(sw);
-    }
+      if (sw < 0) {
+        sx += sw;
+        sw = Math.abs(sw);
+      }
 
-    if (sh < 0) {
-      sy += sh;
-      sh = Math.abs(sh);
-    }
+      if (sh < 0) {
+        sy += sh;
+        sh = Math.abs(sh);
+      }
 
 
-    sx = Math.round(Math.abs(sx));
-    sy = Math.round(Math.abs(sy));
-    sw = Math.round(sw) || 1;
-    sh = Math.round(sh) || 1;
+      sx = Math.round(Math.abs(sx));
+      sy = Math.round(Math.abs(sy));
+      sw = Math.round(sw) || 1;
+      sh = Math.round(sh) || 1;
 
-    var obj = getImageData(sx, sy, sw, sh);
-    return new ImageData(obj.data, obj.width, obj.height);
+      var obj = getImageData.call(this, sx, sy, sw, sh);
+      return new ImageData(obj.data, obj.width, obj.height);
+    };
   });
 
-  override('putImageData', function(putImageData, id, dx, dy, dirtyX, dirtyY, dirtyWidth, dirtyHeight) {
-    if (!valid(dx) ||
-        !valid(dy) ||
-        (typeof dirtyX !== 'undefined' && !valid(dirtyX)) ||
-        (typeof dirtyY !== 'undefined' && !valid(dirtyY)) ||
-        (typeof dirtyWidth !== 'undefined' && !valid(dirtyWidth)) ||
-        (typeof dirtyHeight !== 'undefined' && !valid(dirtyHeight)))
-    {
-      throw new DOMException('invalid coords', DOMException.NOT_SUPPORTED_ERR);
-    }
-
-    if (!id) {
-      throw new DOMException('invalid datatype', DOMException.TYPE_MISMATCH_ERR);
-    }
+  override('putImageData', function(putImageData) {
+    return function(id, dx, dy, dirtyX, dirtyY, dirtyWidth, dirtyHeight) {
+      if (!valid(dx) ||
+          !valid(dy) ||
+          (typeof dirtyX !== 'undefined' && !valid(dirtyX)) ||
+          (typeof dirtyY !== 'undefined' && !valid(dirtyY)) ||
+          (typeof dirtyWidth !== 'undefined' && !valid(dirtyWidth)) ||
+          (typeof dirtyHeight !== 'undefined' && !valid(dirtyHeight)))
+      {
+        throw new DOMException('invalid coords', DOMException.NOT_SUPPORTED_ERR);
+      }
 
-    if (!(id instanceof ImageData)) {
-      throw new DOMException('invalid datatype', DOMException.TYPE_MISMATCH_ERR);
-    }
+      if (!id) {
+        throw new DOMException('invalid datatype', DOMException.TYPE_MISMATCH_ERR);
+      }
 
-    var width = dirtyWidth;
-    var height = dirtyHeight;
-    dirtyX = dirtyX || 0;
-    dirtyY = dirtyY || 0;
+      if (!(id instanceof ImageData)) {
+        throw new DOMException('invalid datatype', DOMException.TYPE_MISMATCH_ERR);
+      }
 
-    if (typeof dirtyWidth === 'undefined') {
-      width = id.width;
-    }
+      if (typeof dirtyWidth === 'undefined') {
+        dirtyWidth = id.width;
+      }
 
-    if (typeof dirtyHeight === 'undefined') {
-      height = id.height;
-    }
+      if (typeof dirtyHeight === 'undefined') {
+        dirtyHeight = id.height;
+      }
 
-    if (width < 0) {
-      dirtyX += width;
-      width = Math.abs(width);
-    }
+      // the dirty rect is clipped natively, straight from id.data
+      putImageData.call(
+        this,
+        id.data,
+        id.width,
+        id.height,
+        dx,
+        dy,
+        dirtyX || 0,
+        dirtyY || 0,
+        dirtyWidth,
+        dirtyHeight
+      );
+      this.dirty = true;
+    };
+  });
 
-    if (height < 0) {
-      dirtyY += height;
-      height = Math.abs(height);
-    }
+  // toPngBufferAsync([options], [fn]): PNG encoded off the main thread,
+  // takes the same options as toPngBuffer
+  override('toPngBufferAsync', function(toPngBufferAsync) {
+    return function(options, fn) {
+      if (typeof options === 'function') {
+        fn = options;
+        options = undefined;
+      }
+      return callbackOrPromise(this, toPngBufferAsync, [options], fn);
+    };
+  });
 
-    if (width + dx > ret.width) {
-      width = ret.width - (dx + width)
-    }
+  // writePngToFdAsync(fd, [options], [fn]): PNG written to fd off the main
+  // thread, calls back with the number of bytes written
+  override('writePngToFdAsync', function(writePngToFdAsync) {
+    return function(fd, options, fn) {
+      if (typeof options === 'function') {
+        fn = options;
+        options = undefined;
+      }
+      return callbackOrPromise(this, writePngToFdAsync, [fd, options], fn);
+    };
+  });
 
-    if (height + dy > ret.height) {
-      height = ret.height - (dy + height)
-    }
+  // createPNGStream([options]): a Readable of the current frame as a PNG,
+  // takes the same options as toPngBuffer. Later drawing does not show up
+  // in it.
+  proto.createPNGStream = function(options) {
+    return new PngStream(this.createPngEncoder(options));
+  };
 
-    if (width <= 0 || height <= 0 || dx + dirtyX < 0 || dirtyX < 0 || dy + dirtyY < 0  || dirtyY < 0) {
-      return;
-    }
+  // toJpegBufferAsync([quality], [fn]) and toWebpBufferAsync([quality], [fn])
+  ['toJpegBufferAsync', 'toWebpBufferAsync'].forEach(function(name) {
+    override(name, function(encodeAsync) {
+      return function(quality, fn) {
+        if (typeof quality === 'function') {
+          fn = quality;
+          quality = undefined;
+        }
+        return callbackOrPromise(this, encodeAsync, [quality], fn);
+      };
+    });
+  });
 
-    putImageData(new Buffer(id.data), dx, dy, dirtyX, dirtyY, width, height, id.width);
-    ret.dirty = true;
-  })
+  override('unlockPixels', function(unlockPixels) {
+    return function() {
+      unlockPixels.call(this);
+      this.dirty = true;
+    };
+  });
 
-  ret.createImageData = function(obj, h) {
+  proto.createImageData = function(obj, h) {
     if (typeof obj === 'undefined' || obj === null) {
       throw new DOMException('invalid object', DOMException.NOT_SUPPORTED_ERR);
     }
@@ -1172,9 +1514,9 @@ module.exports.createContext = function(canvas, w, h, ContextCtor) {
   };
 
 
-  Object.defineProperty(ret, 'lineWidth', {
+  Object.defineProperty(proto, 'lineWidth', {
     get : function() {
-      return state.lineWidth;
+      return this._state.lineWidth;
     },
     set : function(width) {
       width = Number(width);
@@ -1183,206 +1525,346 @@ module.exports.createContext = function(canvas, w, h, ContextCtor) {
         return;
       }
 
-      state.lineWidth = width;
-      ret.setLineWidth(width);
+      this._state.lineWidth = width;
+      this.setLineWidth(width);
     }
   });
 
-  override('isPointInPath', function(isPointInPath, x, y) {
-    requireArgs(arguments, 3);
+  override('isPointInPath', function(isPointInPath) {
+    return function(x, y) {
+      requireArgs(arguments, 2);
 
-    return isPointInPath(x, y);
+      return isPointInPath.call(this, x, y);
+    };
   });
 
-  var nonspaceRemoval = /[\x00-\x1f]+[\x00-\x1f ]+[\x00-\x1f]+/g;
-  var collapseText = function(str) {
-    str = (str + '').replace(/  /g, ' ');
-    return str.replace(nonspaceRemoval, '').trim();
-  };
-
-  override('fillText', function(fillText, str, x, y, maxWidth) {
-    requireArgs(arguments, 4);
+  override('fillText', function(fillText) {
+    return function(str, x, y, maxWidth) {
+      requireArgs(arguments, 3);
 
 
-    var bounds = ret.measureText(str);
-    str = bounds.collapsedString;
-    bounds.height -= y;
+      var bounds = this.measureText(str);
+      str = bounds.collapsedString;
+      bounds.height -= y;
 
-    var emsquare = cssfont(state.font).size;
-    var padding = (bounds.height-emsquare);
+      var emsquare = this._state.fontSize;
+      var padding = (bounds.height-emsquare);
 
-    switch (state.textBaseline) {
-      case 'bottom':
-        y -= (bounds.height-emsquare)/2;
-      break;
+      switch (this._state.textBaseline) {
+        case 'bottom':
+          y -= (bounds.height-emsquare)/2;
+        break;
 
-      case 'ideographic':
-        y += padding/8;
-      break;
+        case 'ideographic':
+          y += padding/8;
+        break;
 
-      case 'middle':
-        y += emsquare/4;
-      break;
+        case 'middle':
+          y += emsquare/4;
+        break;
 
-      case 'top':
-        y += emsquare * .75;
-      break;
+        case 'top':
+          y += emsquare * .75;
+        break;
 
-      case 'hanging':
-        y += ((bounds.height-emsquare)/2) - padding/8;
-      break;
-    }
+        case 'hanging':
+          y += ((bounds.height-emsquare)/2) - padding/8;
+        break;
+      }
 
-    fillText(str, x, y, maxWidth);
-    ret.dirty = true;
+      fillText.call(this, str, x, y, maxWidth);
+      this.dirty = true;
+    };
   });
 
-  override('strokeText', function(strokeText, str, x, y) {
-    requireArgs(arguments, 4);
+  override('strokeText', function(strokeText) {
+    return function(str, x, y) {
+      requireArgs(arguments, 3);
 
-    strokeText(str, x, y);
-    ret.dirty = true;
+      strokeText.call(this, str, x, y);
+      this.dirty = true;
+    };
   });
 
 
-  override('arc', function(arc, x, y, radius, startAngle, endAngle, ccw) {
-    requireArgs(arguments, 7);
+  override('arc', function(arc) {
+    return function(x, y, radius, startAngle, endAngle, ccw) {
+      requireArgs(arguments, 6);
 
-    if (!valid(x) ||
-        !valid(y) ||
-        !valid(radius) ||
-        !valid(startAngle) ||
-        !valid(endAngle) ||
-        !valid(ccw))
-    {
-      return;
-    }
+      if (!valid(x) ||
+          !valid(y) ||
+          !valid(radius) ||
+          !valid(startAngle) ||
+          !valid(endAngle) ||
+          !valid(ccw))
+      {
+        return;
+      }
 
-    if (radius < 0) {
-      throw new DOMException('radius must be > 0', DOMException.INDEX_SIZE_ERR);
-    }
+      if (radius < 0) {
+        throw new DOMException('radius must be > 0', DOMException.INDEX_SIZE_ERR);
+      }
 
-    if (startAngle === endAngle) {
-      return;
-    }
+      if (startAngle === endAngle) {
+        return;
+      }
 
-    var diff = TAU-Math.abs(startAngle - endAngle);
+      var diff = TAU-Math.abs(startAngle - endAngle);
 
-    if (ccw && diff > 0 && diff < 0.0001) {
-      return;
-    }
+      if (ccw && diff > 0 && diff < 0.0001) {
+        return;
+      }
 
-    arc(x, y, radius, startAngle, endAngle, ccw);
-  })
+      arc.call(this, x, y, radius, startAngle, endAngle, ccw);
+    };
+  });
 
-  override('arcTo', function(arcTo, x1, y1, x2, y2, radius) {
-    requireArgs(arguments, 6);
+  override('arcTo', function(arcTo) {
+    return function(x1, y1, x2, y2, radius) {
+      requireArgs(arguments, 5);
 
-    if (!valid(x1) ||
-        !valid(y1) ||
-        !valid(x2) ||
-        !valid(y2) ||
-        !valid(radius))
-    {
-      return;
-    }
+      if (!valid(x1) ||
+          !valid(y1) ||
+          !valid(x2) ||
+          !valid(y2) ||
+          !valid(radius))
+      {
+        return;
+      }
 
-    if (radius < 0) {
-      throw new DOMException('radius must be > 0', DOMException.INDEX_SIZE_ERR);
-    }
+      if (radius < 0) {
+        throw new DOMException('radius must be > 0', DOMException.INDEX_SIZE_ERR);
+      }
 
-    if (x1 === x2 && y1 === y2 || radius === 0) {
-      ret.lineTo(x1, y1);
-    } else {
-      arcTo(x1, y1, x2, y2, radius);
-    }
-  })
+      if (x1 === x2 && y1 === y2 || radius === 0) {
+        this.lineTo(x1, y1);
+      } else {
+        arcTo.call(this, x1, y1, x2, y2, radius);
+      }
+    };
+  });
 
-  override('lineTo', function(lineTo, x, y) {
-    requireArgs(arguments, 3);
+  override('lineTo', function(lineTo) {
+    return function(x, y) {
+      requireArgs(arguments, 2);
 
-    if (!valid(x) || !valid(y)) {
-      return;
-    }
+      if (!valid(x) || !valid(y)) {
+        return;
+      }
 
-    lineTo(x, y);
+      lineTo.call(this, x, y);
+    };
   });
 
-  override('quadraticCurveTo', function(quadraticCurveTo, cpx, cpy, x, y) {
-    requireArgs(arguments, 5);
+  override('quadraticCurveTo', function(quadraticCurveTo) {
+    return function(cpx, cpy, x, y) {
+      requireArgs(arguments, 4);
 
-    if (!valid(cpx) || !valid(cpy) || !valid(x) || !valid(y)) {
-      return;
-    }
+      if (!valid(cpx) || !valid(cpy) || !valid(x) || !valid(y)) {
+        return;
+      }
 
-    quadraticCurveTo(cpx, cpy, x, y);
+      quadraticCurveTo.call(this, cpx, cpy, x, y);
+    };
   });
 
-  override('bezierCurveTo', function(bezierCurveTo, x1, y1, x2, y2, x3, y3) {
-    requireArgs(arguments, 7);
+  override('bezierCurveTo', function(bezierCurveTo) {
+    return function(x1, y1, x2, y2, x3, y3) {
+      requireArgs(arguments, 6);
 
-    if (!valid(x1) ||
-        !valid(y1) ||
-        !valid(x2) ||
-        !valid(y2) ||
-        !valid(x3) ||
-        !valid(y3))
-    {
-      return;
-    }
+      if (!valid(x1) ||
+          !valid(y1) ||
+          !valid(x2) ||
+          !valid(y2) ||
+          !valid(x3) ||
+          !valid(y3))
+      {
+        return;
+      }
 
-    bezierCurveTo(x1, y1, x2, y2, x3, y3);
+      bezierCurveTo.call(this, x1, y1, x2, y2, x3, y3);
+    };
   });
 
-  override('moveTo', function(moveTo, x, y) {
-    requireArgs(arguments, 3);
+  override('moveTo', function(moveTo) {
+    return function(x, y) {
+      requireArgs(arguments, 2);
 
-    if (!valid(x) || !valid(y)) {
-      return;
-    }
+      if (!valid(x) || !valid(y)) {
+        return;
+      }
 
-    moveTo(x, y);
+      moveTo.call(this, x, y);
+    };
   });
 
-  override('rect', function(rect, x, y, w, h) {
-    requireArgs(arguments, 5);
+  override('rect', function(rect) {
+    return function(x, y, w, h) {
+      requireArgs(arguments, 4);
 
-    if (!valid(x) || !valid(y) || !valid(w) || !valid(h)) {
-      return;
-    }
-    rect(x, y, w, h);
+      if (!valid(x) || !valid(y) || !valid(w) || !valid(h)) {
+        return;
+      }
+      rect.call(this, x, y, w, h);
+    };
   });
 
-  override('measureText', function(measureText, str) {
-    requireArgs(arguments, 2);
+  override('measureText', function(measureText) {
+    return function(str) {
+      requireArgs(arguments, 1);
 
-    if (!str) {
-      return { width: 0, height: 0 };
-    }
+      if (!str) {
+        return { width: 0, height: 0 };
+      }
 
-    str = collapseText(str);
+      str = collapseText(str);
 
-    var ret = measureText(str);
-    ret.collapsedString = str;
+      var ret = measureText.call(this, str);
+      ret.collapsedString = str;
 
-    return ret;
+      return ret;
+    };
+  });
+
+  override('submit', function(submit) {
+    return function(buffer, length) {
+      requireArgs(arguments, 1);
+
+      var data = buffer;
+      if (buffer instanceof commands.CommandBuffer) {
+        data = buffer.data;
+        length = buffer.length;
+      } else if (buffer instanceof ArrayBuffer) {
+        data = new Float64Array(buffer);
+      }
+
+      // patterns and degenerate gradients rely on the fillRect wrapper
+      var fs = this._state.fillStyle;
+      if (fs.type === 'pattern' || (fs.type === 'gradient' && !fs.apply(this))) {
+        commands.replay(this, data, length);
+      } else {
+        // mirror any save/restore the native side performed. A negative
+        // radius anywhere in the stream fails it before anything is drawn,
+        // with the same error arc() and arcTo() throw
+        var depth;
+        try {
+          depth = submit.call(this, data, length);
+        } catch (e) {
+          if (e instanceof RangeError) {
+            throw new DOMException(e.message, DOMException.INDEX_SIZE_ERR);
+          }
+          throw e;
+        }
+        if (depth) {
+          for (var i = depth[0]; i<0; i++) {
+            this._state = this._stateStack.pop();
+          }
+
+          for (var j = depth[0]; j<depth[1]; j++) {
+            this._stateStack.push(this._state);
+            this._state = this._state.clone();
+          }
+        }
+      }
+
+      this.dirty = true;
+    };
+  });
+
+  // a recording is its own save/restore scope: restore() stops where it
+  // began and endRecording() closes whatever it left open, like the
+  // native side does
+  override('beginRecording', function(beginRecording) {
+    return function() {
+      beginRecording.call(this);
+      this._recordingDepth = this._stateStack.length;
+    };
+  });
+
+  override('endRecording', function(endRecording) {
+    return function() {
+      var picture = endRecording.call(this);
+      closeRecording(this);
+      return picture;
+    };
   });
 
   override('save', function(save) {
-    stateStack.push(state);
-    state = state.clone();
-    save();
+    return function() {
+      this._stateStack.push(this._state);
+      this._state = this._state.clone();
+      save.call(this);
+    };
   });
 
   override('restore', function(restore) {
-    var tmp = stateStack.pop(state);
+    return function() {
+      if (this._stateStack.length <= this._recordingDepth) {
+        return;
+      }
 
-    if (tmp) {
-      state = tmp;
-      state.apply(ret);
-      restore();
-    }
+      var tmp = this._stateStack.pop();
+
+      // the native side keeps its own copy of the drawing state, restoring
+      // it does not need the setters to be replayed
+      if (tmp) {
+        this._state = tmp;
+        restore.call(this);
+      }
+    };
+  });
+};
+
+module.exports.createContext = function(canvas, w, h, ContextCtor) {
+
+  ContextCtor = ContextCtor || Context2D;
+
+  if (!ContextCtor) {
+    throw new Error('could not create context, binding not loaded');
+  }
+
+  wrap(ContextCtor);
+
+  canvas = canvas || {
+    width : w || 300,
+    height: h || 150
+  };
+
+  canvas.dir = canvas.dir || 'ltr';
+
+  var ret = new ContextCtor(canvas.width, canvas.height);
+
+  Object.defineProperty(ret, 'canvas', {
+    value : canvas
   });
 
+  ret._state = new ContextState();
+  ret._stateStack = [];
+  ret._recordingDepth = 0;
+  ret._fonts = null;
+  ret.dirty = false;
+
+  if (typeof canvas.width !== 'undefined' &&
+      typeof canvas.width !== 'undefined' &&
+      typeof canvas.addEventListener === 'function'
+    )
+  {
+    canvas.addEventListener('resize', function(ev) {
+      ret.width = canvas.width;
+      ret.height = canvas.height;
+    });
+  }
+
   return ret;
 };
+
+// Contexts take their pixels from a pool of same sized surfaces left by
+// released or collected contexts. release() returns them right away.
+module.exports.acquire = function(w, h) {
+  return module.exports.createContext(null, w, h);
+};
+
+if (Context2D) {
+  module.exports.configurePool = Context2D.configurePool;
+  module.exports.poolStats = Context2D.poolStats;
+}
@@ -0,0 +1,102 @@
+// Opcodes understood by Context2D#submit, keep in sync with
+// Context2D::Command in src/context2d.h
+var commands = module.exports.commands = {
+  beginPath : 1,
+  closePath : 2,
+  moveTo : 3,
+  lineTo : 4,
+  quadraticCurveTo : 5,
+  bezierCurveTo : 6,
+  arcTo : 7,
+  rect : 8,
+  arc : 9,
+  fill : 10,
+  stroke : 11,
+  clip : 12,
+  fillRect : 13,
+  strokeRect : 14,
+  clearRect : 15,
+  scale : 16,
+  rotate : 17,
+  translate : 18,
+  transform : 19,
+  setTransform : 20,
+  resetMatrix : 21,
+  save : 22,
+  restore : 23
+};
+
+var arity = module.exports.arity = [
+  0, 0, 0, 2, 2, 4, 6, 5, 4, 6, 0, 0, 0, 4, 4, 4, 2, 1, 2, 6, 6, 0, 0, 0
+];
+
+var names = module.exports.names = [];
+Object.keys(commands).forEach(function(name) {
+  names[commands[name]] = name;
+});
+
+// Records path, rect and transform calls into a Float64Array so a whole
+// frame can be handed to ctx.submit() in a single native call.
+function CommandBuffer(size) {
+  this.data = new Float64Array(size || 1024);
+  this.length = 0;
+}
+
+CommandBuffer.prototype.reserve = function(count) {
+  var needed = this.length + count;
+  if (needed > this.data.length) {
+    var size = this.data.length * 2;
+    while (size < needed) {
+      size *= 2;
+    }
+
+    var data = new Float64Array(size);
+    data.set(this.data.subarray(0, this.length));
+    this.data = data;
+  }
+};
+
+CommandBuffer.prototype.reset = function() {
+  this.length = 0;
+};
+
+Object.keys(commands).forEach(function(name) {
+  var op = commands[name];
+  var count = arity[op];
+
+  CommandBuffer.prototype[name] = function() {
+    this.reserve(count + 1);
+
+    var data = this.data;
+    var pos = this.length;
+    data[pos++] = op;
+    for (var i = 0; i<count; i++) {
+      data[pos++] = +arguments[i];
+    }
+    this.length = pos;
+    return this;
+  };
+});
+
+module.exports.CommandBuffer = CommandBuffer;
+
+// Compatibility path: walk a command stream and issue each command through
+// the regular context methods.
+module.exports.replay = function(ctx, data, length) {
+  var pos = 0;
+  length = length || data.length;
+  while (pos < length) {
+    var op = data[pos];
+    var name = names[op];
+    if (!name) {
+      throw new Error('invalid command in submitted buffer');
+    }
+
+    var args = Array.prototype.slice.call(data, pos + 1, pos + 1 + arity[op]);
+    if (name === 'arc') {
+      args[5] = !!args[5];
+    }
+    ctx[name].apply(ctx, args);
+    pos += 1 + arity[op];
+  }
+};
@@ -0,0 +1,485 @@
+#include <node.h>
+#include <nan.h>
+
+#include "animatedimage.h"
+#include "imagebitmap.h"
+#include "pixelops.h"
+
+#include <SkColorPriv.h>
+#include <SkTemplates.h>
+#include <SkUtils.h>
+
+#include <math.h>
+
+#ifdef CONTEXT2D_GIF
+#include <gif_lib.h>
+#endif
+
+using namespace node;
+using namespace v8;
+
+Nan::Persistent<FunctionTemplate> AnimatedImage::constructorTemplate;
+
+#ifdef CONTEXT2D_GIF
+
+// giflib reads the encoded bytes straight from data, at readOffset
+int AnimatedImage::readGif(GifFileType *gif, unsigned char *out, int length) {
+  AnimatedImage *image = (AnimatedImage *)gif->UserData;
+  size_t size = image->data->size();
+  size_t offset = SkTMin<size_t>(image->readOffset, size);
+  size_t count = SkTMin<size_t>((size_t)length, size - offset);
+  memcpy(out, image->data->bytes() + offset, count);
+  image->readOffset = offset + count;
+  return (int)count;
+}
+
+static void closeGif(GifFileType *gif) {
+#if GIFLIB_MAJOR > 5 || (GIFLIB_MAJOR == 5 && GIFLIB_MINOR >= 1)
+  DGifCloseFile(gif, NULL);
+#else
+  DGifCloseFile(gif);
+#endif
+}
+
+// Appends cmap to colors, returning its size. Like SkMovie_gif, tables
+// whose size is not a power of two are not used.
+static int appendColors(SkTDArray<SkPMColor> *colors, const ColorMapObject *cmap) {
+  if (!cmap || cmap->ColorCount != (1 << cmap->BitsPerPixel)) {
+    return 0;
+  }
+
+  for (int i = 0; i<cmap->ColorCount; i++) {
+    const GifColorType &col = cmap->Colors[i];
+    *colors->append() = SkPackARGB32(0xFF, col.Red, col.Green, col.Blue);
+  }
+  return cmap->ColorCount;
+}
+
+static void copyLine(SkPMColor *dst, const GifByteType *src, const SkPMColor *colors,
+                     int colorCount, int transparent, int width)
+{
+  for (; width > 0; width--, src++, dst++) {
+    if (*src != transparent && *src < colorCount) {
+      *dst = colors[*src];
+    }
+  }
+}
+
+// True when next, opaque, hides all of cur
+static bool covers(const AnimatedFrameInfo &next, const AnimatedFrameInfo &cur) {
+  return next.transparent < 0 && next.bounds.contains(cur.bounds);
+}
+
+// Gets the canvas ready for next once cur has been shown. backup holds
+// the canvas as it was before cur when cur restores to previous.
+static void disposeFrame(SkBitmap *canvas, SkBitmap *backup, const AnimatedFrameInfo &cur,
+                         const AnimatedFrameInfo &next, SkPMColor background)
+{
+  if ((cur.disposal == 2 || cur.disposal == 3) && !covers(next, cur)) {
+    SkIRect bounds = cur.bounds;
+    if (cur.disposal == 3) {
+      canvas->swap(*backup);
+    } else if (bounds.intersect(0, 0, canvas->width(), canvas->height())) {
+      for (int y = bounds.fTop; y < bounds.fBottom; y++) {
+        sk_memset32(canvas->getAddr32(bounds.fLeft, y), background, bounds.width());
+      }
+    }
+  }
+
+  if (next.disposal == 3) {
+    memcpy(backup->getPixels(), canvas->getPixels(), canvas->getSize());
+  }
+}
+
+bool AnimatedImage::open() {
+  if (this->gif) {
+    closeGif(this->gif);
+  }
+
+  this->readOffset = 0;
+  this->cursor = 0;
+#if GIFLIB_MAJOR < 5
+  this->gif = DGifOpen(this, readGif);
+#else
+  this->gif = DGifOpen(this, readGif, NULL);
+#endif
+  return this->gif != NULL;
+}
+
+// Walks the records once. The compressed pixels are skipped block by block
+// and only the frame descriptors, color tables and graphics control
+// extensions are kept. A truncated GIF keeps the frames before the break.
+bool AnimatedImage::scan() {
+  GifFileType *gif = this->gif;
+  int globalCount = appendColors(&this->colors, gif->SColorMap);
+
+  // from the graphics control extension before the next frame
+  int transparent = -1, disposal = 0;
+  uint32_t delay = 0;
+
+  bool ok = true;
+  while (ok) {
+    GifRecordType type;
+    if (DGifGetRecordType(gif, &type) != GIF_OK || type == TERMINATE_RECORD_TYPE) {
+      break;
+    }
+
+    if (type == EXTENSION_RECORD_TYPE) {
+      int code;
+      GifByteType *ext;
+      ok = DGifGetExtension(gif, &code, &ext) == GIF_OK;
+      if (ok && code == GRAPHICS_EXT_FUNC_CODE && ext && ext[0] == 4) {
+        transparent = ext[1] & 1 ? ext[4] : -1;
+        disposal = (ext[1] >> 2) & 7;
+        delay = ((ext[3] << 8) | ext[2]) * 10;
+      }
+
+      while (ok && ext) {
+        ok = DGifGetExtensionNext(gif, &ext) == GIF_OK;
+      }
+    } else if (type == IMAGE_DESC_RECORD_TYPE) {
+      // the record type byte is already read
+      size_t offset = this->readOffset - 1;
+      if (DGifGetImageDesc(gif) != GIF_OK) {
+        break;
+      }
+
+      AnimatedFrameInfo frame;
+      const GifImageDesc &desc = gif->Image;
+      frame.bounds.setXYWH(desc.Left, desc.Top, desc.Width, desc.Height);
+      frame.interlaced = desc.Interlace;
+      frame.transparent = transparent;
+      frame.disposal = disposal;
+      frame.offset = offset;
+      frame.colorOffset = desc.ColorMap ? this->colors.count() : 0;
+      frame.colorCount = desc.ColorMap ? appendColors(&this->colors, desc.ColorMap) : globalCount;
+
+      int codeSize;
+      GifByteType *block;
+      ok = DGifGetCode(gif, &codeSize, &block) == GIF_OK;
+      while (ok && block) {
+        ok = DGifGetCodeNext(gif, &block) == GIF_OK;
+      }
+
+      if (ok) {
+        // delays of 10ms and under play at 100ms, as browsers do
+        *this->frames.append() = frame;
+        *this->delays.append() = delay <= 10 ? 100 : delay;
+        this->duration += this->delays.top();
+      }
+
+      transparent = -1;
+      disposal = 0;
+      delay = 0;
+    }
+  }
+
+  return this->frames.count() > 0;
+}
+
+// Decodes frame index over canvas, following SkMovie_gif. giflib adds to
+// its own list of frames for every descriptor it reads, so the cursor is
+// only reopened to go back, which keeps that list to one pass.
+bool AnimatedImage::drawFrame(SkBitmap *canvas, int index) {
+  const AnimatedFrameInfo &frame = this->frames[index];
+  SkIRect bounds = frame.bounds;
+  if (!frame.colorCount || !bounds.intersect(0, 0, canvas->width(), canvas->height())) {
+    return true;
+  }
+
+  if ((!this->gif || index < this->cursor) && !this->open()) {
+    return false;
+  }
+
+  this->readOffset = frame.offset;
+  this->cursor = index + 1;
+
+  GifRecordType type;
+  if (DGifGetRecordType(this->gif, &type) != GIF_OK || type != IMAGE_DESC_RECORD_TYPE ||
+      DGifGetImageDesc(this->gif) != GIF_OK)
+  {
+    return false;
+  }
+
+  int width = frame.bounds.width();
+  int height = frame.bounds.height();
+  const SkPMColor *colors = this->colors.begin() + frame.colorOffset;
+  SkAutoTMalloc<GifByteType> line(width);
+
+  // interlaced frames store every 8th row from 0, every 8th from 4, every
+  // 4th from 2 and then every 2nd from 1
+  static const int interlacedStart[] = { 0, 4, 2, 1 };
+  static const int interlacedStep[] = { 8, 8, 4, 2 };
+  int passes = frame.interlaced ? 4 : 1;
+
+  for (int pass = 0; pass<passes; pass++) {
+    int start = frame.interlaced ? interlacedStart[pass] : 0;
+    int step = frame.interlaced ? interlacedStep[pass] : 1;
+    for (int row = start; row < height; row += step) {
+      if (DGifGetLine(this->gif, line.get(), width) != GIF_OK) {
+        return false;
+      }
+
+      int y = frame.bounds.fTop + row;
+      if (y < bounds.fBottom) {
+        copyLine(canvas->getAddr32(bounds.fLeft, y), line.get(), colors,
+                 frame.colorCount, frame.transparent, bounds.width());
+      }
+    }
+  }
+  return true;
+}
+
+#endif
+
+void AnimatedImage::Init(Handle<Object> exports) {
+  Local<FunctionTemplate> tpl = Nan::New<FunctionTemplate>(New);
+  tpl->SetClassName(Nan::New("AnimatedImage").ToLocalChecked());
+  tpl->InstanceTemplate()->SetInternalFieldCount(1);
+
+  Nan::SetPrototypeMethod(tpl, "getFrame", GetFrame);
+  Nan::SetPrototypeMethod(tpl, "frameAtTime", FrameAtTime);
+  Nan::SetPrototypeMethod(tpl, "close", Close);
+  Nan::SetPrototypeMethod(tpl, "cacheStats", CacheStats);
+
+  constructorTemplate.Reset(tpl);
+  exports->Set(Nan::New("AnimatedImage").ToLocalChecked(), tpl->GetFunction());
+}
+
+bool AnimatedImage::HasInstance(Local<Value> value) {
+  return Nan::New(constructorTemplate)->HasInstance(value);
+}
+
+AnimatedImage::~AnimatedImage() {
+  this->close();
+}
+
+void AnimatedImage::close() {
+#ifdef CONTEXT2D_GIF
+  if (this->gif) {
+    closeGif(this->gif);
+  }
+#endif
+  this->gif = NULL;
+
+  SkSafeUnref(this->data);
+  this->data = NULL;
+
+  SkDELETE_ARRAY(this->ring);
+  this->ring = NULL;
+}
+
+AnimatedFrame *AnimatedImage::findFrame(int index) {
+  for (int i = 0; i<this->ringSize; i++) {
+    if (this->ring[i].index == index) {
+      return &this->ring[i];
+    }
+  }
+  return NULL;
+}
+
+AnimatedFrame *AnimatedImage::getFrame(int index) {
+  AnimatedFrame *found = this->findFrame(index);
+  if (found) {
+    this->hits++;
+    return found;
+  }
+  this->misses++;
+
+#ifdef CONTEXT2D_GIF
+  // resume from the latest frame before index still in the ring
+  AnimatedFrame *start = NULL;
+  for (int i = 0; i<this->ringSize; i++) {
+    AnimatedFrame *frame = &this->ring[i];
+    if (frame->index >= 0 && frame->index < index && (!start || frame->index > start->index)) {
+      start = frame;
+    }
+  }
+
+  SkBitmap canvas, backup;
+  canvas.setConfig(SkBitmap::kARGB_8888_Config, this->width, this->height);
+  backup.setConfig(SkBitmap::kARGB_8888_Config, this->width, this->height);
+  if (!canvas.allocPixels() || !backup.allocPixels()) {
+    Nan::ThrowError("could not allocate animation frame");
+    return NULL;
+  }
+
+  SkPMColor background = SkPreMultiplyColor(this->background);
+  int first = 0;
+  if (start) {
+    memcpy(canvas.getPixels(), start->bitmap.getPixels(), canvas.getSize());
+    if (!start->backup.isNull()) {
+      memcpy(backup.getPixels(), start->backup.getPixels(), backup.getSize());
+    }
+    first = start->index + 1;
+  } else {
+    canvas.eraseColor(this->background);
+    backup.eraseColor(this->background);
+  }
+
+  for (int i = first; i <= index; i++) {
+    if (i > 0) {
+      disposeFrame(&canvas, &backup, this->frames[i - 1], this->frames[i], background);
+    }
+    if (!this->drawFrame(&canvas, i)) {
+      Nan::ThrowError("could not decode image");
+      return NULL;
+    }
+    this->composited++;
+  }
+
+  // overwrite the oldest slot, ImageBitmaps of what was there keep its pixels
+  AnimatedFrame *frame = &this->ring[this->ringNext];
+  this->ringNext = (this->ringNext + 1) % this->ringSize;
+
+  canvas.setImmutable();
+  frame->index = index;
+  frame->bitmap.swap(canvas);
+  frame->backup.reset();
+  if (this->frames[index].disposal == 3) {
+    frame->backup.swap(backup);
+  }
+  return frame;
+#else
+  Nan::ThrowError("animated images need a build with -Dwith_gif=1");
+  return NULL;
+#endif
+}
+
+void AnimatedImage::New(const Nan::FunctionCallbackInfo<Value>& info) {
+  uint8_t *bytes;
+  size_t length;
+  if (!GetPixelData(info[0], &bytes, &length)) {
+    return Nan::ThrowTypeError("First argument needs to be a Buffer or a typed array");
+  }
+
+  int frameCache = 8;
+  if (info[1]->IsObject()) {
+    Local<Value> v = info[1]->ToObject()->Get(Nan::New("frameCache").ToLocalChecked());
+    if (!v->IsUndefined()) {
+      frameCache = v->Int32Value();
+      if (!v->IsNumber() || frameCache < 1) {
+        return Nan::ThrowRangeError("frameCache needs to be 1 or more");
+      }
+    }
+  }
+
+#ifdef CONTEXT2D_GIF
+  AnimatedImage *image = new AnimatedImage();
+  image->data = SkData::NewWithCopy(bytes, length);
+  if (!image->open()) {
+    delete image;
+    return Nan::ThrowError("animated images need a GIF");
+  }
+
+  GifFileType *gif = image->gif;
+  if (gif->SWidth <= 0 || gif->SHeight <= 0 || gif->SWidth > 0x7fff || gif->SHeight > 0x7fff) {
+    delete image;
+    return Nan::ThrowRangeError("invalid image dimensions");
+  }
+
+  // reads where the frames are, decoding waits for getFrame()
+  if (!image->scan()) {
+    delete image;
+    return Nan::ThrowError("could not decode image");
+  }
+
+  image->width = gif->SWidth;
+  image->height = gif->SHeight;
+  image->ringSize = SkMin32(frameCache, image->frames.count());
+  image->ring = SkNEW_ARRAY(AnimatedFrame, image->ringSize);
+
+  // like SkMovie_gif, an opaque first frame starts on the background color
+  image->background = SK_ColorTRANSPARENT;
+  const AnimatedFrameInfo &first = image->frames[0];
+  if (first.transparent < 0 && gif->SColorMap && gif->SBackGroundColor < gif->SColorMap->ColorCount) {
+    const GifColorType &col = gif->SColorMap->Colors[gif->SBackGroundColor];
+    image->background = SkColorSetRGB(col.Red, col.Green, col.Blue);
+  }
+
+  // the cursor opens again on the first decode
+  closeGif(gif);
+  image->gif = NULL;
+
+  image->Wrap(info.This());
+  info.This()->Set(Nan::New("width").ToLocalChecked(), Nan::New(image->width));
+  info.This()->Set(Nan::New("height").ToLocalChecked(), Nan::New(image->height));
+  info.This()->Set(Nan::New("frameCount").ToLocalChecked(), Nan::New(image->frames.count()));
+  info.This()->Set(Nan::New("duration").ToLocalChecked(), Nan::New(image->duration));
+  info.This()->Set(Nan::New("currentFrame").ToLocalChecked(), Nan::New(0));
+  info.GetReturnValue().Set(info.This());
+#else
+  Nan::ThrowError("animated images need a build with -Dwith_gif=1");
+#endif
+}
+
+
+// getFrame(index): an ImageBitmap of the frame as it is shown, composited
+// over the frames before it
+void AnimatedImage::GetFrame(const Nan::FunctionCallbackInfo<Value>& info) {
+  AnimatedImage *image = ObjectWrap::Unwrap<AnimatedImage>(info.This());
+  if (!image->ring) {
+    return Nan::ThrowError("animated image is closed");
+  }
+
+  int index = info[0]->Int32Value();
+  if (!info[0]->IsNumber() || index < 0 || index >= image->delays.count()) {
+    return Nan::ThrowRangeError("frame index out of range");
+  }
+
+  AnimatedFrame *frame = image->getFrame(index);
+  if (frame) {
+    info.GetReturnValue().Set(ImageBitmap::NewInstance(frame->bitmap));
+  }
+}
+
+// frameAtTime(ms): the index of the frame showing ms into the animation,
+// which loops
+void AnimatedImage::FrameAtTime(const Nan::FunctionCallbackInfo<Value>& info) {
+  AnimatedImage *image = ObjectWrap::Unwrap<AnimatedImage>(info.This());
+  if (!image->ring) {
+    return Nan::ThrowError("animated image is closed");
+  }
+
+  double ms = info[0]->NumberValue();
+  if (!info[0]->IsNumber() || ms != ms || ms < 0) {
+    return Nan::ThrowRangeError("time needs to be 0 or more");
+  }
+
+  uint32_t t = (uint32_t)fmod(ms, (double)image->duration);
+  int index = 0;
+  for (; index < image->delays.count() - 1; index++) {
+    if (t < image->delays[index]) {
+      break;
+    }
+    t -= image->delays[index];
+  }
+
+  info.GetReturnValue().Set(Nan::New(index));
+}
+
+// close(): frees the frames, drawing it afterwards throws
+void AnimatedImage::Close(const Nan::FunctionCallbackInfo<Value>& info) {
+  AnimatedImage *image = ObjectWrap::Unwrap<AnimatedImage>(info.This());
+
+  image->close();
+  info.This()->Set(Nan::New("width").ToLocalChecked(), Nan::New(0));
+  info.This()->Set(Nan::New("height").ToLocalChecked(), Nan::New(0));
+}
+
+void AnimatedImage::CacheStats(const Nan::FunctionCallbackInfo<Value>& info) {
+  AnimatedImage *image = ObjectWrap::Unwrap<AnimatedImage>(info.This());
+
+  int frames = 0;
+  for (int i = 0; image->ring && i<image->ringSize; i++) {
+    frames += image->ring[i].index >= 0;
+  }
+
+  Local<Object> stats = Nan::New<Object>();
+  stats->Set(Nan::New("hits").ToLocalChecked(), Nan::New(image->hits));
+  stats->Set(Nan::New("misses").ToLocalChecked(), Nan::New(image->misses));
+  stats->Set(Nan::New("composited").ToLocalChecked(), Nan::New(image->composited));
+  stats->Set(Nan::New("frames").ToLocalChecked(), Nan::New(frames));
+  stats->Set(Nan::New("limit").ToLocalChecked(), Nan::New(image->ringSize));
+  info.GetReturnValue().Set(stats);
+}
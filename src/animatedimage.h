@@ -0,0 +1,108 @@
+#ifndef _ANIMATEDIMAGE_H_
+#define _ANIMATEDIMAGE_H_
+
+#include <node.h>
+#include <nan.h>
+#include <SkBitmap.h>
+#include <SkData.h>
+#include <SkRect.h>
+#include <SkTDArray.h>
+
+using namespace node;
+using namespace v8;
+
+struct GifFileType;
+
+// A composited frame of an AnimatedImage
+class AnimatedFrame {
+  public:
+    AnimatedFrame() : index(-1) {}
+
+    int index;
+    SkBitmap bitmap;    // immutable, shared with the ImageBitmaps handed out
+    SkBitmap backup;    // the canvas under this frame, when it restores to previous
+};
+
+// Where a frame's pixels are in the GIF and how they are shown
+struct AnimatedFrameInfo {
+  SkIRect bounds;
+  bool interlaced;
+  int transparent;      // color index, -1 for none
+  int disposal;
+  int colorOffset;      // into AnimatedImage::colors
+  int colorCount;       // 0 when the frame has no usable color table
+  size_t offset;        // of the image descriptor in the encoded bytes
+};
+
+// An animated GIF that drawImage draws one frame of.
+//
+//   new AnimatedImage(buffer, { frameCache: 8 })
+//
+// The constructor copies the encoded bytes and only walks the records,
+// noting where each frame starts without decompressing it. Frames are
+// decoded and composited on demand, each one from the nearest earlier
+// frame still in a ring of the frameCache most recently composited ones.
+// A decode cursor stays open on the GIF beside the ring: playing forward
+// reads on from it, seeking back reopens it. Playing forward composites
+// one frame per step, and seeking back to a recent frame costs nothing.
+//
+//   currentFrame: the frame drawImage draws, 0 to begin with
+//   frameCount, duration (ms), width, height
+//   getFrame(index): the composited frame as an ImageBitmap
+//   frameAtTime(ms): the frame showing ms into the animation, looping
+//   close(): drops the frames
+//   cacheStats(): { hits, misses, composited, frames, limit }
+//
+// Needs the build to be configured with -Dwith_gif=1.
+class AnimatedImage : public Nan::ObjectWrap {
+  public:
+    static void Init(Handle<Object> exports);
+    static bool HasInstance(Local<Value> value);
+
+  private:
+    AnimatedImage() : data(NULL), readOffset(0), gif(NULL), cursor(0),
+                      width(0), height(0), duration(0),
+                      ring(NULL), ringSize(8), ringNext(0),
+                      hits(0), misses(0), composited(0) {}
+    ~AnimatedImage();
+
+    void close();
+    // (re)opens gif at the start of data, false when it is no GIF
+    bool open();
+    // reads the frame records, false when there are none
+    bool scan();
+    // decodes frame index over canvas, false on a broken frame
+    bool drawFrame(SkBitmap *canvas, int index);
+    AnimatedFrame *findFrame(int index);
+    // Throws and returns NULL on failure
+    AnimatedFrame *getFrame(int index);
+
+    static int readGif(GifFileType *gif, unsigned char *out, int length);
+
+    static Nan::Persistent<FunctionTemplate> constructorTemplate;
+    static NAN_METHOD(New);
+    static NAN_METHOD(GetFrame);
+    static NAN_METHOD(FrameAtTime);
+    static NAN_METHOD(Close);
+    static NAN_METHOD(CacheStats);
+
+    SkData *data;
+    size_t readOffset;
+
+    // the decode cursor, cursor is the frame after the last one it read
+    GifFileType *gif;
+    int cursor;
+
+    int width, height;
+    SkTDArray<AnimatedFrameInfo> frames;
+    SkTDArray<SkPMColor> colors;
+    SkTDArray<uint32_t> delays;
+    uint32_t duration;
+    SkColor background;
+
+    AnimatedFrame *ring;
+    int ringSize, ringNext;
+    double hits, misses, composited;
+};
+
+#endif
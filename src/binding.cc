@@ -1,12 +1,32 @@
 #include <node.h>
 
+#include "animatedimage.h"
 #include "context2d.h"
+#include "color.h"
+#include "decoder.h"
+#include "encoder.h"
+#include "fontcache.h"
+#include "imagecache.h"
+#include "imagebitmap.h"
+#include "picture.h"
+#include "pixelops.h"
+#include "regionimage.h"
 
 using namespace v8;
 using namespace node;
 
 void InitializeBinding(Local<Object> exports) {
   Context2D::Init(exports);
+  InitColor(exports);
+  InitFontCache(exports);
+  InitPixelOps(exports);
+  ImageBitmap::Init(exports);
+  RegionImage::Init(exports);
+  AnimatedImage::Init(exports);
+  Picture::Init(exports);
+  InitEncoder(exports);
+  InitDecoder(exports);
+  InitImageCache(exports);
 }
 
 NODE_MODULE(context2d, InitializeBinding);
@@ -0,0 +1,674 @@
+#include <node.h>
+#include <nan.h>
+
+#include "color.h"
+
+#include <SkTypes.h>
+#include <SkString.h>
+
+#include <ctype.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+using namespace node;
+using namespace v8;
+
+struct NamedColor {
+  const char *name;
+  SkColor color;
+};
+
+// sorted for bsearch, see http://www.w3.org/TR/css3-color/#svg-color
+static const NamedColor kNamedColors[] = {
+  { "aliceblue", 0xFFF0F8FF },
+  { "antiquewhite", 0xFFFAEBD7 },
+  { "aqua", 0xFF00FFFF },
+  { "aquamarine", 0xFF7FFFD4 },
+  { "azure", 0xFFF0FFFF },
+  { "beige", 0xFFF5F5DC },
+  { "bisque", 0xFFFFE4C4 },
+  { "black", 0xFF000000 },
+  { "blanchedalmond", 0xFFFFEBCD },
+  { "blue", 0xFF0000FF },
+  { "blueviolet", 0xFF8A2BE2 },
+  { "brown", 0xFFA52A2A },
+  { "burlywood", 0xFFDEB887 },
+  { "cadetblue", 0xFF5F9EA0 },
+  { "chartreuse", 0xFF7FFF00 },
+  { "chocolate", 0xFFD2691E },
+  { "coral", 0xFFFF7F50 },
+  { "cornflowerblue", 0xFF6495ED },
+  { "cornsilk", 0xFFFFF8DC },
+  { "crimson", 0xFFDC143C },
+  { "cyan", 0xFF00FFFF },
+  { "darkblue", 0xFF00008B },
+  { "darkcyan", 0xFF008B8B },
+  { "darkgoldenrod", 0xFFB8860B },
+  { "darkgray", 0xFFA9A9A9 },
+  { "darkgreen", 0xFF006400 },
+  { "darkgrey", 0xFFA9A9A9 },
+  { "darkkhaki", 0xFFBDB76B },
+  { "darkmagenta", 0xFF8B008B },
+  { "darkolivegreen", 0xFF556B2F },
+  { "darkorange", 0xFFFF8C00 },
+  { "darkorchid", 0xFF9932CC },
+  { "darkred", 0xFF8B0000 },
+  { "darksalmon", 0xFFE9967A },
+  { "darkseagreen", 0xFF8FBC8F },
+  { "darkslateblue", 0xFF483D8B },
+  { "darkslategray", 0xFF2F4F4F },
+  { "darkslategrey", 0xFF2F4F4F },
+  { "darkturquoise", 0xFF00CED1 },
+  { "darkviolet", 0xFF9400D3 },
+  { "deeppink", 0xFFFF1493 },
+  { "deepskyblue", 0xFF00BFFF },
+  { "dimgray", 0xFF696969 },
+  { "dimgrey", 0xFF696969 },
+  { "dodgerblue", 0xFF1E90FF },
+  { "firebrick", 0xFFB22222 },
+  { "floralwhite", 0xFFFFFAF0 },
+  { "forestgreen", 0xFF228B22 },
+  { "fuchsia", 0xFFFF00FF },
+  { "gainsboro", 0xFFDCDCDC },
+  { "ghostwhite", 0xFFF8F8FF },
+  { "gold", 0xFFFFD700 },
+  { "goldenrod", 0xFFDAA520 },
+  { "gray", 0xFF808080 },
+  { "green", 0xFF008000 },
+  { "greenyellow", 0xFFADFF2F },
+  { "grey", 0xFF808080 },
+  { "honeydew", 0xFFF0FFF0 },
+  { "hotpink", 0xFFFF69B4 },
+  { "indianred", 0xFFCD5C5C },
+  { "indigo", 0xFF4B0082 },
+  { "ivory", 0xFFFFFFF0 },
+  { "khaki", 0xFFF0E68C },
+  { "lavender", 0xFFE6E6FA },
+  { "lavenderblush", 0xFFFFF0F5 },
+  { "lawngreen", 0xFF7CFC00 },
+  { "lemonchiffon", 0xFFFFFACD },
+  { "lightblue", 0xFFADD8E6 },
+  { "lightcoral", 0xFFF08080 },
+  { "lightcyan", 0xFFE0FFFF },
+  { "lightgoldenrodyellow", 0xFFFAFAD2 },
+  { "lightgray", 0xFFD3D3D3 },
+  { "lightgreen", 0xFF90EE90 },
+  { "lightgrey", 0xFFD3D3D3 },
+  { "lightpink", 0xFFFFB6C1 },
+  { "lightsalmon", 0xFFFFA07A },
+  { "lightseagreen", 0xFF20B2AA },
+  { "lightskyblue", 0xFF87CEFA },
+  { "lightslategray", 0xFF778899 },
+  { "lightslategrey", 0xFF778899 },
+  { "lightsteelblue", 0xFFB0C4DE },
+  { "lightyellow", 0xFFFFFFE0 },
+  { "lime", 0xFF00FF00 },
+  { "limegreen", 0xFF32CD32 },
+  { "linen", 0xFFFAF0E6 },
+  { "magenta", 0xFFFF00FF },
+  { "maroon", 0xFF800000 },
+  { "mediumaquamarine", 0xFF66CDAA },
+  { "mediumblue", 0xFF0000CD },
+  { "mediumorchid", 0xFFBA55D3 },
+  { "mediumpurple", 0xFF9370DB },
+  { "mediumseagreen", 0xFF3CB371 },
+  { "mediumslateblue", 0xFF7B68EE },
+  { "mediumspringgreen", 0xFF00FA9A },
+  { "mediumturquoise", 0xFF48D1CC },
+  { "mediumvioletred", 0xFFC71585 },
+  { "midnightblue", 0xFF191970 },
+  { "mintcream", 0xFFF5FFFA },
+  { "mistyrose", 0xFFFFE4E1 },
+  { "moccasin", 0xFFFFE4B5 },
+  { "navajowhite", 0xFFFFDEAD },
+  { "navy", 0xFF000080 },
+  { "oldlace", 0xFFFDF5E6 },
+  { "olive", 0xFF808000 },
+  { "olivedrab", 0xFF6B8E23 },
+  { "orange", 0xFFFFA500 },
+  { "orangered", 0xFFFF4500 },
+  { "orchid", 0xFFDA70D6 },
+  { "palegoldenrod", 0xFFEEE8AA },
+  { "palegreen", 0xFF98FB98 },
+  { "paleturquoise", 0xFFAFEEEE },
+  { "palevioletred", 0xFFDB7093 },
+  { "papayawhip", 0xFFFFEFD5 },
+  { "peachpuff", 0xFFFFDAB9 },
+  { "peru", 0xFFCD853F },
+  { "pink", 0xFFFFC0CB },
+  { "plum", 0xFFDDA0DD },
+  { "powderblue", 0xFFB0E0E6 },
+  { "purple", 0xFF800080 },
+  { "red", 0xFFFF0000 },
+  { "rosybrown", 0xFFBC8F8F },
+  { "royalblue", 0xFF4169E1 },
+  { "saddlebrown", 0xFF8B4513 },
+  { "salmon", 0xFFFA8072 },
+  { "sandybrown", 0xFFF4A460 },
+  { "seagreen", 0xFF2E8B57 },
+  { "seashell", 0xFFFFF5EE },
+  { "sienna", 0xFFA0522D },
+  { "silver", 0xFFC0C0C0 },
+  { "skyblue", 0xFF87CEEB },
+  { "slateblue", 0xFF6A5ACD },
+  { "slategray", 0xFF708090 },
+  { "slategrey", 0xFF708090 },
+  { "snow", 0xFFFFFAFA },
+  { "springgreen", 0xFF00FF7F },
+  { "steelblue", 0xFF4682B4 },
+  { "tan", 0xFFD2B48C },
+  { "teal", 0xFF008080 },
+  { "thistle", 0xFFD8BFD8 },
+  { "tomato", 0xFFFF6347 },
+  { "transparent", 0x00000000 },
+  { "turquoise", 0xFF40E0D0 },
+  { "violet", 0xFFEE82EE },
+  { "wheat", 0xFFF5DEB3 },
+  { "white", 0xFFFFFFFF },
+  { "whitesmoke", 0xFFF5F5F5 },
+  { "yellow", 0xFFFFFF00 },
+  { "yellowgreen", 0xFF9ACD32 },
+};
+
+// w3c doesn't behave, so neither will we. these are deprecated anyhow
+// and all map to #FF00FF. Matched case sensitively.
+static const char *kSystemColors[] = {
+  "ActiveBorder", "ActiveCaption", "AppWorkspace",
+  "Background", "ButtonFace", "ButtonHighlight",
+  "ButtonShadow", "ButtonText", "CaptionText",
+  "GrayText", "Highlight", "HighlightText",
+  "InactiveBorder", "InactiveCaption",
+  "InactiveCaptionText", "InfoBackground", "InfoText",
+  "Menu", "MenuText", "Scrollbar", "ThreeDDarkShadow",
+  "ThreeDFace", "ThreeDHighlight", "ThreeDLightShadow",
+  "ThreeDShadow", "Window", "WindowFrame", "WindowText"
+};
+
+static int compareNamedColor(const void *key, const void *item) {
+  return strcmp((const char *)key, ((const NamedColor *)item)->name);
+}
+
+static inline bool isSpace(char c) {
+  return c == ' ' || c == '\t' || c == '\n' || c == '\r' || c == '\f';
+}
+
+static inline int hexValue(char c) {
+  if (c >= '0' && c <= '9') { return c - '0'; }
+  if (c >= 'a' && c <= 'f') { return c - 'a' + 10; }
+  if (c >= 'A' && c <= 'F') { return c - 'A' + 10; }
+  return -1;
+}
+
+// parseFloat(): reads the longest numeric prefix of [str, end)
+static bool parseFloatPrefix(const char *str, const char *end, double *out) {
+  const char *p = str;
+  char buf[64];
+
+  if (p < end && (*p == '+' || *p == '-')) { p++; }
+
+  int digits = 0;
+  while (p < end && *p >= '0' && *p <= '9') { p++; digits++; }
+  if (p < end && *p == '.') {
+    p++;
+    while (p < end && *p >= '0' && *p <= '9') { p++; digits++; }
+  }
+
+  if (!digits) {
+    return false;
+  }
+
+  if (p < end && (*p == 'e' || *p == 'E')) {
+    const char *e = p + 1;
+    if (e < end && (*e == '+' || *e == '-')) { e++; }
+    if (e < end && *e >= '0' && *e <= '9') {
+      while (e < end && *e >= '0' && *e <= '9') { e++; }
+      p = e;
+    }
+  }
+
+  size_t len = p - str;
+  if (len >= sizeof(buf)) {
+    return false;
+  }
+
+  memcpy(buf, str, len);
+  buf[len] = 0;
+  *out = strtod(buf, NULL);
+  return true;
+}
+
+// parseInt(str, 10)
+static bool parseIntPrefix(const char *str, const char *end, double *out) {
+  const char *p = str;
+  bool negative = false;
+  if (p < end && (*p == '+' || *p == '-')) {
+    negative = *p == '-';
+    p++;
+  }
+
+  if (p >= end || *p < '0' || *p > '9') {
+    return false;
+  }
+
+  double v = 0;
+  while (p < end && *p >= '0' && *p <= '9') {
+    v = v * 10 + (*p - '0');
+    p++;
+  }
+
+  *out = negative ? -v : v;
+  return true;
+}
+
+// Math.round() followed by a clamp to a byte
+static inline int clampByte(double v) {
+  v = floor(v + 0.5);
+  return v < 0 ? 0 : v > 255 ? 255 : (int)v;
+}
+
+static inline double clampFloat(double v) {
+  return v < 0 ? 0 : v > 1 ? 1 : v;
+}
+
+static double hueToRGB(double m1, double m2, double h) {
+  if (h < 0) {
+    h += 1;
+  } else if (h > 1) {
+    h -= 1;
+  }
+
+  if (h * 6 < 1) { return m1 + (m2 - m1) * h * 6; }
+  if (h * 2 < 1) { return m2; }
+  if (h * 3 < 2) { return m1 + (m2 - m1) * (2.0/3.0 - h) * 6; }
+  return m1;
+}
+
+// Number.prototype.toString() for alpha values in [0, 1]
+static void appendNumber(SkString *str, double v) {
+  char buf[32];
+  for (int precision = 1; precision <= 17; precision++) {
+    snprintf(buf, sizeof(buf), "%.*g", precision, v);
+    if (strtod(buf, NULL) == v) {
+      break;
+    }
+  }
+
+  // %g switches to exponents well before javascript does
+  if (strchr(buf, 'e') && v >= 1e-6) {
+    for (int decimals = 1; decimals <= 24; decimals++) {
+      snprintf(buf, sizeof(buf), "%.*f", decimals, v);
+      if (strtod(buf, NULL) == v) {
+        break;
+      }
+    }
+  }
+
+  str->append(buf);
+}
+
+// Serializes the way the fillStyle getter reports colors: #rrggbb when
+// opaque, otherwise the functional notation it was specified with.
+static void serialize(SkString *out, const char *type, int r, int g, int b, double a) {
+  if (a == 1) {
+    out->printf("#%02x%02x%02x", r, g, b);
+    return;
+  }
+
+  out->printf("%s(%d, %d, %d, ", type, r, g, b);
+  if (a) {
+    appendNumber(out, a);
+  } else {
+    out->append("0.0");
+  }
+  out->append(")");
+}
+
+static bool parseFunctional(const char *name, size_t nameLen,
+                            const char *args, const char *argsEnd,
+                            SkColor *color, SkString *canonical)
+{
+  char type[5] = { 0 };
+  if (nameLen < 3 || nameLen > 4) {
+    return false;
+  }
+
+  for (size_t i = 0; i<nameLen; i++) {
+    type[i] = tolower(name[i]);
+  }
+
+  bool hsl;
+  if (!strncmp(type, "rgb", 3)) {
+    hsl = false;
+  } else if (!strncmp(type, "hsl", 3)) {
+    hsl = true;
+  } else {
+    return false;
+  }
+
+  size_t expected = 3;
+  if (nameLen == 4) {
+    if (type[3] != 'a') {
+      return false;
+    }
+    expected = 4;
+  }
+
+  // split on commas, each part trimmed and free of inner whitespace
+  const char *start[4], *end[4];
+  size_t count = 0;
+  const char *p = args;
+  while (true) {
+    const char *comma = p;
+    while (comma < argsEnd && *comma != ',') { comma++; }
+
+    if (count == expected) {
+      return false;
+    }
+
+    const char *s = p, *e = comma;
+    while (s < e && isSpace(*s)) { s++; }
+    while (e > s && isSpace(e[-1])) { e--; }
+    if (s == e) {
+      return false;
+    }
+
+    for (const char *c = s; c < e; c++) {
+      if (isSpace(*c)) {
+        return false;
+      }
+    }
+
+    start[count] = s;
+    end[count] = e;
+    count++;
+
+    if (comma == argsEnd) {
+      break;
+    }
+    p = comma + 1;
+  }
+
+  if (count != expected) {
+    return false;
+  }
+
+  double alpha = 1;
+  if (expected == 4) {
+    if (memchr(start[3], '%', end[3] - start[3]) ||
+        !parseFloatPrefix(start[3], end[3], &alpha))
+    {
+      return false;
+    }
+    alpha = clampFloat(alpha);
+  }
+
+  int percents = 0;
+  bool percent[3];
+  for (int i = 0; i<3; i++) {
+    percent[i] = end[i][-1] == '%';
+    if (percent[i]) {
+      percents++;
+    }
+  }
+
+  int rgb[3];
+  if (!hsl) {
+    // either all or none of the channels are percentages, no fractions
+    if (percents && percents != 3) {
+      return false;
+    }
+
+    for (int i = 0; i<3; i++) {
+      if (memchr(start[i], '.', end[i] - start[i])) {
+        return false;
+      }
+
+      double v;
+      if (!parseIntPrefix(start[i], end[i], &v)) {
+        return false;
+      }
+
+      rgb[i] = clampByte(percent[i] ? v / 100 * 255 : v);
+    }
+  } else {
+    if (percents && percents != 2) {
+      return false;
+    }
+
+    double v[3];
+    for (int i = 0; i<3; i++) {
+      if (!parseIntPrefix(start[i], end[i], &v[i])) {
+        return false;
+      }
+      parseFloatPrefix(start[i], end[i], &v[i]);
+    }
+
+    double h = fmod(fmod(v[0], 360) + 360, 360) / 360;
+    double s = clampFloat(percent[1] ? v[1] / 100 : v[1]);
+    double l = clampFloat(percent[2] ? v[2] / 100 : v[2]);
+    double m2 = l <= 0.5 ? l * (s + 1) : l + s - l * s;
+    double m1 = l * 2 - m2;
+
+    rgb[0] = clampByte(hueToRGB(m1, m2, h + 1.0/3.0) * 255);
+    rgb[1] = clampByte(hueToRGB(m1, m2, h) * 255);
+    rgb[2] = clampByte(hueToRGB(m1, m2, h - 1.0/3.0) * 255);
+  }
+
+  *color = SkColorSetARGB((U8CPU)(alpha * 255), rgb[0], rgb[1], rgb[2]);
+  if (canonical) {
+    serialize(canonical, type, rgb[0], rgb[1], rgb[2], alpha);
+  }
+  return true;
+}
+
+bool ParseCSSColor(const char *str, size_t len, SkColor *color, SkString *canonical) {
+  const char *end = str + len;
+  while (str < end && isSpace(*str)) { str++; }
+  while (end > str && isSpace(end[-1])) { end--; }
+  len = end - str;
+
+  if (!len) {
+    return false;
+  }
+
+  for (size_t i = 0; i<SK_ARRAY_COUNT(kSystemColors); i++) {
+    if (strlen(kSystemColors[i]) == len && !strncmp(kSystemColors[i], str, len)) {
+      *color = 0xFFFF00FF;
+      if (canonical) {
+        canonical->set("#ff00ff");
+      }
+      return true;
+    }
+  }
+
+  if (str[0] == '#') {
+    int digits[6];
+    if (len != 4 && len != 7) {
+      return false;
+    }
+
+    for (size_t i = 1; i<len; i++) {
+      digits[i - 1] = hexValue(str[i]);
+      if (digits[i - 1] < 0) {
+        return false;
+      }
+    }
+
+    int r, g, b;
+    if (len == 4) {
+      r = digits[0] * 17;
+      g = digits[1] * 17;
+      b = digits[2] * 17;
+    } else {
+      r = digits[0] << 4 | digits[1];
+      g = digits[2] << 4 | digits[3];
+      b = digits[4] << 4 | digits[5];
+    }
+
+    *color = SkColorSetARGB(0xFF, r, g, b);
+    if (canonical) {
+      serialize(canonical, NULL, r, g, b, 1);
+    }
+    return true;
+  }
+
+  const char *paren = (const char *)memchr(str, '(', len);
+  if (paren) {
+    if (end[-1] != ')') {
+      return false;
+    }
+
+    const char *nameEnd = paren;
+    while (nameEnd > str && isSpace(nameEnd[-1])) { nameEnd--; }
+
+    return parseFunctional(str, nameEnd - str, paren + 1, end - 1, color, canonical);
+  }
+
+  char name[32];
+  if (len >= sizeof(name)) {
+    return false;
+  }
+
+  for (size_t i = 0; i<len; i++) {
+    name[i] = tolower(str[i]);
+  }
+  name[len] = 0;
+
+  const NamedColor *named = (const NamedColor *)bsearch(
+    name,
+    kNamedColors,
+    SK_ARRAY_COUNT(kNamedColors),
+    sizeof(NamedColor),
+    compareNamedColor
+  );
+
+  if (!named) {
+    return false;
+  }
+
+  *color = named->color;
+  if (canonical) {
+    serialize(
+      canonical,
+      "rgba",
+      SkColorGetR(named->color),
+      SkColorGetG(named->color),
+      SkColorGetB(named->color),
+      SkColorGetA(named->color) / 255.0
+    );
+  }
+  return true;
+}
+
+// Direct mapped, so a colliding string simply evicts the previous one.
+// Invalid strings are cached as well so repeated bad input stays cheap.
+#define COLOR_CACHE_SIZE 1024
+
+struct ColorCacheEntry {
+  uint32_t hash;
+  bool used, valid;
+  SkColor color;
+  SkString key;
+  Nan::Persistent<String> canonical;
+};
+
+// allocated once in InitColor and never freed, the persistent handles
+// must not outlive the isolate in a static destructor
+static ColorCacheEntry *colorCache = NULL;
+
+static struct {
+  double hits, misses, evictions;
+  uint32_t entries;
+} colorCacheCounters = { 0, 0, 0, 0 };
+
+// FNV-1a
+static inline uint32_t hashString(const char *str, size_t len) {
+  uint32_t hash = 2166136261u;
+  for (size_t i = 0; i<len; i++) {
+    hash ^= (uint8_t)str[i];
+    hash *= 16777619u;
+  }
+  return hash;
+}
+
+bool LookupCSSColor(Handle<Value> value, SkColor *color, Local<String> *canonical) {
+  if (!value->IsString()) {
+    return false;
+  }
+
+  Nan::Utf8String str(value);
+  size_t len = str.length();
+  uint32_t hash = hashString(*str, len);
+  ColorCacheEntry *entry = &colorCache[hash & (COLOR_CACHE_SIZE - 1)];
+
+  if (entry->used && entry->hash == hash && entry->key.equals(*str, len)) {
+    colorCacheCounters.hits++;
+  } else {
+    colorCacheCounters.misses++;
+    if (entry->used) {
+      colorCacheCounters.evictions++;
+    } else {
+      colorCacheCounters.entries++;
+    }
+
+    SkString serialized;
+    entry->used = true;
+    entry->hash = hash;
+    entry->key.set(*str, len);
+    entry->valid = ParseCSSColor(*str, len, &entry->color, &serialized);
+
+    if (entry->valid) {
+      entry->canonical.Reset(Nan::New(serialized.c_str()).ToLocalChecked());
+    } else {
+      entry->canonical.Reset();
+    }
+  }
+
+  if (!entry->valid) {
+    return false;
+  }
+
+  *color = entry->color;
+  if (canonical) {
+    *canonical = Nan::New(entry->canonical);
+  }
+  return true;
+}
+
+// parseColor(str): the color as an unpremultiplied 0xAARRGGBB number, or
+// undefined when str is not a valid css color
+static NAN_METHOD(ParseColor) {
+  SkColor color;
+  if (LookupCSSColor(info[0], &color, NULL)) {
+    info.GetReturnValue().Set(Nan::New<Number>(color));
+  }
+}
+
+static NAN_METHOD(ColorCacheStats) {
+  Local<Object> stats = Nan::New<Object>();
+  double lookups = colorCacheCounters.hits + colorCacheCounters.misses;
+
+  stats->Set(Nan::New("hits").ToLocalChecked(), Nan::New(colorCacheCounters.hits));
+  stats->Set(Nan::New("misses").ToLocalChecked(), Nan::New(colorCacheCounters.misses));
+  stats->Set(Nan::New("evictions").ToLocalChecked(), Nan::New(colorCacheCounters.evictions));
+  stats->Set(Nan::New("entries").ToLocalChecked(), Nan::New(colorCacheCounters.entries));
+  stats->Set(Nan::New("capacity").ToLocalChecked(), Nan::New(COLOR_CACHE_SIZE));
+  stats->Set(
+    Nan::New("hitRate").ToLocalChecked(),
+    Nan::New(lookups ? colorCacheCounters.hits / lookups : 0)
+  );
+
+  info.GetReturnValue().Set(stats);
+}
+
+void InitColor(Handle<Object> exports) {
+  colorCache = new ColorCacheEntry[COLOR_CACHE_SIZE];
+  for (int i = 0; i<COLOR_CACHE_SIZE; i++) {
+    colorCache[i].used = false;
+  }
+
+  Nan::SetMethod(exports, "parseColor", ParseColor);
+  Nan::SetMethod(exports, "colorCacheStats", ColorCacheStats);
+}
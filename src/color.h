@@ -0,0 +1,24 @@
+#ifndef _COLOR_H_
+#define _COLOR_H_
+
+#include <node.h>
+#include <nan.h>
+#include <SkColor.h>
+#include <SkString.h>
+
+using namespace node;
+using namespace v8;
+
+// Parses a CSS color (#rgb, #rrggbb, rgb(), rgba(), hsl(), hsla(), named
+// and system colors). On success fills in the color and, when asked for,
+// the serialized form reported by the fillStyle/strokeStyle getters.
+bool ParseCSSColor(const char *str, size_t len, SkColor *color, SkString *canonical);
+
+// Same as above, but resolved through a bounded cache of previously seen
+// strings. canonical may be NULL when only the color is needed.
+bool LookupCSSColor(Handle<Value> value, SkColor *color, Local<String> *canonical);
+
+// exposes parseColor() and colorCacheStats() on the binding
+void InitColor(Handle<Object> exports);
+
+#endif
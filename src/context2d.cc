@@ -5,6 +5,14 @@
 #define _USE_MATH_DEFINES 1
 
 #include "context2d.h"
+#include "color.h"
+#include "encoder.h"
+#include "fontcache.h"
+#include "imagebitmap.h"
+#include "picture.h"
+#include "pixelops.h"
+#include "regionimage.h"
+#include "surfacepool.h"
 #include <SkCanvas.h>
 #include <SkPaint.h>
 #include <SkPath.h>
@@ -40,6 +48,47 @@ using namespace v8;
 
 #define DEGREES(rads) ((rads) * (180/M_PI))
 
+Nan::Persistent<Function> Context2D::constructor;
+Nan::Persistent<FunctionTemplate> Context2D::constructorTemplate;
+
+// number of arguments following each Context2D::Command in a submit() stream
+static const uint8_t kCommandArity[Context2D::kCommandCount] = {
+  0, // unused
+  0, // beginPath
+  0, // closePath
+  2, // moveTo
+  2, // lineTo
+  4, // quadraticCurveTo
+  6, // bezierCurveTo
+  5, // arcTo
+  4, // rect
+  6, // arc
+  0, // fill
+  0, // stroke
+  0, // clip
+  4, // fillRect
+  4, // strokeRect
+  4, // clearRect
+  2, // scale
+  1, // rotate
+  2, // translate
+  6, // transform
+  6, // setTransform
+  0, // resetMatrix
+  0, // save
+  0, // restore
+};
+
+// NaN and +/-Infinity are the only values where v - v != 0
+static inline bool valid(const double *args, int count) {
+  for (int i=0; i<count; i++) {
+    if (args[i] - args[i] != 0) {
+      return false;
+    }
+  }
+  return true;
+}
+
 void Context2D::Init(Handle<Object> exports) {
   SkAutoGraphics ag;
 
@@ -49,11 +98,29 @@ void Context2D::Init(Handle<Object> exports) {
 
   // Non-standard
   Nan::SetPrototypeMethod(tpl, "toPngBuffer", ToPngBuffer);
+  Nan::SetPrototypeMethod(tpl, "toPngBufferAsync", ToPngBufferAsync);
+  Nan::SetPrototypeMethod(tpl, "toJpegBuffer", ToJpegBuffer);
+  Nan::SetPrototypeMethod(tpl, "toJpegBufferAsync", ToJpegBufferAsync);
+  Nan::SetPrototypeMethod(tpl, "toWebpBuffer", ToWebpBuffer);
+  Nan::SetPrototypeMethod(tpl, "toWebpBufferAsync", ToWebpBufferAsync);
+  Nan::SetPrototypeMethod(tpl, "writePngToFd", WritePngToFd);
+  Nan::SetPrototypeMethod(tpl, "writePngToFdAsync", WritePngToFdAsync);
+  Nan::SetPrototypeMethod(tpl, "createPngEncoder", CreatePngEncoder);
   Nan::SetPrototypeMethod(tpl, "dumpState", DumpState);
   Nan::SetPrototypeMethod(tpl, "toBuffer", ToBuffer);
+  Nan::SetPrototypeMethod(tpl, "lockPixels", LockPixels);
+  Nan::SetPrototypeMethod(tpl, "unlockPixels", UnlockPixels);
   Nan::SetPrototypeMethod(tpl, "getPixel", GetPixel);
+  Nan::SetPrototypeMethod(tpl, "getPixels", GetPixels);
   Nan::SetPrototypeMethod(tpl, "resize", Resize);
   Nan::SetPrototypeMethod(tpl, "addFont", AddFont);
+  Nan::SetPrototypeMethod(tpl, "submit", Submit);
+  Nan::SetPrototypeMethod(tpl, "release", Release);
+
+  // surface pool
+  Nan::SetMethod(tpl, "acquire", Acquire);
+  Nan::SetMethod(tpl, "configurePool", ConfigurePool);
+  Nan::SetMethod(tpl, "poolStats", PoolStats);
 
 
   // Standard
@@ -102,6 +169,12 @@ void Context2D::Init(Handle<Object> exports) {
   Nan::SetPrototypeMethod(tpl, "getTextBaseline", GetTextBaseline);
   Nan::SetPrototypeMethod(tpl, "setTextBaseline", SetTextBaseline);
   Nan::SetPrototypeMethod(tpl, "drawImageBuffer", DrawImageBuffer);
+  Nan::SetPrototypeMethod(tpl, "drawImageBitmap", DrawImageBitmap);
+  Nan::SetPrototypeMethod(tpl, "drawRegionImage", DrawRegionImage);
+  Nan::SetPrototypeMethod(tpl, "drawContext", DrawContext);
+  Nan::SetPrototypeMethod(tpl, "beginRecording", BeginRecording);
+  Nan::SetPrototypeMethod(tpl, "endRecording", EndRecording);
+  Nan::SetPrototypeMethod(tpl, "drawPicture", DrawPicture);
   Nan::SetPrototypeMethod(tpl, "createImageData", CreateImageData);
   Nan::SetPrototypeMethod(tpl, "getImageData", GetImageData);
   Nan::SetPrototypeMethod(tpl, "putImageData", PutImageData);
@@ -115,59 +188,199 @@ void Context2D::Init(Handle<Object> exports) {
   Nan::SetPrototypeMethod(tpl, "setLineDashOffset", SetLineDashOffset);
   Nan::SetPrototypeMethod(tpl, "getLineDashOffset", GetLineDashOffset);
 
-  Local<Function> constructor = Nan::New(tpl->GetFunction());
-  exports->Set(Nan::New("Context2D").ToLocalChecked(), constructor);
+  constructorTemplate.Reset(tpl);
+  Local<Function> fn = Nan::New(tpl->GetFunction());
+  constructor.Reset(fn);
+  exports->Set(Nan::New("Context2D").ToLocalChecked(), fn);
+
+}
 
+bool Context2D::HasInstance(Local<Value> value) {
+  return Nan::New(constructorTemplate)->HasInstance(value);
 }
 
-Context2D::Context2D(uint32_t w, uint32_t h) {
+Context2D::Context2D(uint32_t w, uint32_t h)
+  : stateStack(sizeof(ContextState), 8), lockedPixels(NULL),
+    recording(NULL), surfaceCanvas(NULL), recordingDepth(0)
+{
+  this->createSurface(w, h);
 
-  this->bitmap.setConfig(SkBitmap::kARGB_8888_Config, w, h);
-  this->bitmap.allocPixels();
+  this->state = SkNEW_PLACEMENT(this->stateStack.push_back(), ContextState);
 
-  this->device = new SkDevice(bitmap);
-  this->canvas = new SkCanvas(device);
-  this->canvas->clear(SkColorSetARGBInline(0, 0, 0, 0));
+  this->state->globalAlpha = 255;
+  this->state->globalCompositeOperation = SkXfermode::kSrcOver_Mode;
 
-  this->globalAlpha = 255;
-  this->globalCompositeOperation = SkXfermode::kSrcOver_Mode;
+  this->state->paint.setXfermodeMode(this->state->globalCompositeOperation);
+  this->state->paint.setColor(SK_ColorBLACK);
+  this->state->paint.setStyle(SkPaint::kFill_Style);
+  this->state->paint.setLCDRenderText(true);
+  this->state->paint.setHinting(SkPaint::kSlight_Hinting);
+  this->state->paint.setSubpixelText(true);
+  this->state->paint.setAntiAlias(true);
+  this->state->paint.setDither(true);
 
-  this->paint.setXfermodeMode(this->globalCompositeOperation);
-  this->paint.setColor(SK_ColorBLACK);
-  this->paint.setStyle(SkPaint::kFill_Style);
-  this->paint.setLCDRenderText(true);
-  this->paint.setHinting(SkPaint::kSlight_Hinting);
-  this->paint.setSubpixelText(true);
-  this->paint.setAntiAlias(true);
-  this->paint.setDither(true);
+  this->state->strokePaint.setColor(SK_ColorBLACK);
+  this->state->strokePaint.setStrokeMiter(10);
+  this->state->strokePaint.setStrokeWidth(1);
+  this->state->strokePaint.setStyle(SkPaint::kStroke_Style);
+  this->state->strokePaint.setLCDRenderText(true);
+  this->state->strokePaint.setHinting(SkPaint::kSlight_Hinting);
+  this->state->strokePaint.setSubpixelText(true);
+  this->state->strokePaint.setAntiAlias(true);
+  this->state->strokePaint.setDither(true);
 
-  this->strokePaint.setColor(SK_ColorBLACK);
-  this->strokePaint.setStrokeMiter(10);
-  this->strokePaint.setStrokeWidth(1);
-  this->strokePaint.setStyle(SkPaint::kStroke_Style);
-  this->strokePaint.setLCDRenderText(true);
-  this->strokePaint.setHinting(SkPaint::kSlight_Hinting);
-  this->strokePaint.setSubpixelText(true);
-  this->strokePaint.setAntiAlias(true);
-  this->strokePaint.setDither(true);
+  this->state->paint.getFontMetrics(&this->state->fontMetrics);
 
-  this->defaultLineWidth = true;
+  this->state->defaultLineWidth = true;
+  this->state->textBaseline = 3; // alphabetic
 
-  this->shadowX = 0;
-  this->shadowY = 0;
-  this->shadowBlur = 0;
-  this->shadowPaint.setColor(0x00000000);
+  this->state->shadowX = 0;
+  this->state->shadowY = 0;
+  this->state->shadowBlur = 0;
+  this->state->shadowPaint.setColor(0x00000000);
 }
 
 Context2D::~Context2D() {
-  this->canvas->unref();
+  while (this->stateStack.count() > 0) {
+    ((ContextState *)this->stateStack.back())->~ContextState();
+    this->stateStack.pop_back();
+  }
+
+  this->releaseSurface();
+}
+
+// Takes a cleared surface of the given size from the pool, or allocates one.
+// Empty surfaces never go through the pool, they would only skew its stats.
+void Context2D::createSurface(uint32_t w, uint32_t h) {
+  if (!w || !h || !SurfacePool::Acquire(w, h, &this->bitmap, &this->device, &this->canvas)) {
+    this->bitmap.setConfig(SkBitmap::kARGB_8888_Config, w, h);
+    this->bitmap.allocPixels();
+
+    this->device = new SurfaceDevice(this->bitmap);
+    this->canvas = new SkCanvas(this->device);
+  }
+
+  this->canvas->clear(SkColorSetARGBInline(0, 0, 0, 0));
+}
+
+void Context2D::releaseSurface() {
+  if (this->recording) {
+    SkSafeUnref(this->endRecording());
+  }
+
+  this->unlockPixels();
+
+  if (this->pixelsShared() || !this->bitmap.getSize()) {
+    // recycling would draw over pixels a buffer still shows
+    SkSafeUnref(this->canvas);
+    SkSafeUnref(this->device);
+  } else {
+    SurfacePool::Release(this->bitmap, this->device, this->canvas);
+  }
+  this->bitmap.reset();
+  this->device = NULL;
+  this->canvas = NULL;
+}
+
+bool Context2D::pixelsShared() {
+  SkPixelRef *pixels = this->bitmap.pixelRef();
+
+  // one ref is ours, one the device's and one the lockPixels() view's, if
+  // any; each shared buffer holds another
+  int32_t refs = pixels && pixels == this->lockedPixels ? 3 : 2;
+  return pixels && pixels->getRefCnt() > refs;
+}
+
+// Copy on write: the buffers keep the old pixels, the canvas moves onto a
+// copy. Costs one full surface copy per frame that was shared, only when
+// the frame is drawn over while a buffer is still alive. Drawing into a
+// recording leaves the surface alone, so it copies nothing.
+void Context2D::aboutToDraw() {
+  if (this->recording) {
+    return;
+  }
+
+  this->aboutToWritePixels();
+}
+
+void Context2D::aboutToWritePixels() {
+  if (!this->pixelsShared()) {
+    return;
+  }
+
+  SkBitmap copy;
+  if (!this->bitmap.copyTo(&copy, this->bitmap.config())) {
+    return;
+  }
+
+  static_cast<SurfaceDevice *>(this->device)->replaceBitmap(copy);
+  this->bitmap = copy;
+}
+
+bool Context2D::snapshot(SkBitmap *out) {
+  if (!this->bitmap.pixelRef() || !this->bitmap.getSize()) {
+    return false;
+  }
+
+  this->canvas->flush();
+
+  // a locked view writes to the pixels without going through aboutToDraw
+  if (this->lockedPixels) {
+    return this->bitmap.copyTo(out, this->bitmap.config());
+  }
+
+  *out = this->bitmap;
+  return true;
+}
+
+void Context2D::save() {
+  ContextState *next = (ContextState *)this->stateStack.push_back();
+  this->state = SkNEW_PLACEMENT_ARGS(next, ContextState, (*this->state));
+  this->canvas->save();
+}
+
+bool Context2D::restore() {
+  if (this->stateStack.count() < 2 || this->stateStack.count() <= this->recordingDepth) {
+    return false;
+  }
+
+  this->state->~ContextState();   // balanced in save()
+  this->stateStack.pop_back();
+  this->state = (ContextState *)this->stateStack.back();
+  this->canvas->restore();
+  return true;
+}
+
+// The recording starts out with an identity matrix and no clip, so it
+// plays back relative to wherever drawPicture() puts it. Paint state
+// carries over as is.
+void Context2D::beginRecording() {
+  this->recording = SkNEW(SkPicture);
+  this->surfaceCanvas = this->canvas;
+  this->canvas = this->recording->beginRecording(this->bitmap.width(), this->bitmap.height());
+  this->recordingDepth = this->stateStack.count();
+}
+
+SkPicture *Context2D::endRecording() {
+  while (this->stateStack.count() > this->recordingDepth) {
+    this->restore();
+  }
+
+  SkPicture *picture = this->recording;
+  picture->endRecording();
+
+  this->canvas = this->surfaceCanvas;
+  this->surfaceCanvas = NULL;
+  this->recording = NULL;
+  this->recordingDepth = 0;
+  return picture;
 }
 
 bool Context2D::setupShadow(SkPaint *paint) {
-  SkColor shadowColor = this->shadowPaint.getColor();
-  int shadowAlpha = SkColorGetA(this->shadowPaint.getColor());
+  SkColor shadowColor = this->state->shadowPaint.getColor();
+  int shadowAlpha = SkColorGetA(this->state->shadowPaint.getColor());
   if (shadowAlpha &&
-      (this->shadowX || this->shadowY || this->shadowBlur))
+      (this->state->shadowX || this->state->shadowY || this->state->shadowBlur))
   {
 
     if (shadowAlpha == 255) {
@@ -184,12 +397,12 @@ bool Context2D::setupShadow(SkPaint *paint) {
     SkMatrix m = this->canvas->getTotalMatrix();
 
     SkPoint shadowOffset;
-    m.mapXY(this->shadowX, this->shadowY, &shadowOffset);
+    m.mapXY(this->state->shadowX, this->state->shadowY, &shadowOffset);
 
     SkDrawLooper* dl = new SkBlurDrawLooper(
-      this->shadowBlur,
-      this->shadowX,
-      this->shadowY,
+      this->state->shadowBlur,
+      this->state->shadowX,
+      this->state->shadowY,
       c,
       SkBlurDrawLooper::kAll_BlurFlag | SkBlurDrawLooper::kOverrideColor_BlurFlag | SkBlurDrawLooper::kIgnoreTransform_BlurFlag
     );
@@ -202,19 +415,13 @@ bool Context2D::setupShadow(SkPaint *paint) {
 }
 
 void Context2D::resizeCanvas(uint32_t width, uint32_t height) {
-  this->bitmap.setConfig(SkBitmap::kARGB_8888_Config, width, height);
-  this->bitmap.allocPixels();
-
-  SkSafeUnref(this->canvas);
-  SkSafeUnref(this->device);
-
-  this->device = new SkDevice(this->bitmap);
-  this->canvas = new SkCanvas(this->device);
+  this->releaseSurface();
+  this->createSurface(width, height);
 }
 
 void *Context2D::getTextureData() {
   if (this->canvas) {
-    SkBitmap bitmap = this->canvas->getDevice()->accessBitmap(false);
+    SkBitmap bitmap = this->device->accessBitmap(false);
     bitmap.lockPixels();
     void *data = bitmap.getPixels();
     bitmap.unlockPixels();
@@ -233,6 +440,69 @@ void Context2D::New(const Nan::FunctionCallbackInfo<Value>& info) {
   info.GetReturnValue().Set(info.This());
 }
 
+// Context2D.acquire(w, h): same as new Context2D(w, h), spelled out for
+// callers that pair it with release()
+void Context2D::Acquire(const Nan::FunctionCallbackInfo<Value>& info) {
+  Local<Value> argv[2] = { info[0], info[1] };
+  Local<Function> ctor = Nan::New(constructor);
+
+  info.GetReturnValue().Set(Nan::NewInstance(ctor, 2, argv).ToLocalChecked());
+}
+
+// Hands the pixels back to the pool right away instead of waiting for the
+// garbage collector. The context is left with an empty 0x0 surface, which
+// the JS wrapper reports as its size, until it is resized.
+void Context2D::Release(const Nan::FunctionCallbackInfo<Value>& info) {
+  Context2D *ctx = ObjectWrap::Unwrap<Context2D>(info.This());
+
+  ctx->releaseSurface();
+  ctx->createSurface(0, 0);
+  ctx->path.reset();
+  ctx->subpath.reset();
+}
+
+// Context2D.configurePool({ perSize: n, maxBytes: n })
+void Context2D::ConfigurePool(const Nan::FunctionCallbackInfo<Value>& info) {
+  const SurfacePool::Stats &stats = SurfacePool::GetStats();
+  double perSize = stats.perSize;
+  double maxBytes = stats.maxBytes;
+
+  if (info[0]->IsObject()) {
+    Local<Object> opts = info[0]->ToObject();
+    Local<Value> v = opts->Get(Nan::New("perSize").ToLocalChecked());
+    if (!v->IsUndefined()) {
+      perSize = v->NumberValue();
+    }
+
+    v = opts->Get(Nan::New("maxBytes").ToLocalChecked());
+    if (!v->IsUndefined()) {
+      maxBytes = v->NumberValue();
+    }
+  }
+
+  if (!(perSize >= 0) || !(maxBytes >= 0)) {
+    return Nan::ThrowRangeError("pool limits must be >= 0");
+  }
+
+  SurfacePool::Configure((uint32_t)perSize, (size_t)maxBytes);
+}
+
+void Context2D::PoolStats(const Nan::FunctionCallbackInfo<Value>& info) {
+  const SurfacePool::Stats &stats = SurfacePool::GetStats();
+  Local<Object> obj = Nan::New<Object>();
+
+  obj->Set(Nan::New("hits").ToLocalChecked(), Nan::New(stats.hits));
+  obj->Set(Nan::New("misses").ToLocalChecked(), Nan::New(stats.misses));
+  obj->Set(Nan::New("released").ToLocalChecked(), Nan::New(stats.released));
+  obj->Set(Nan::New("discarded").ToLocalChecked(), Nan::New(stats.discarded));
+  obj->Set(Nan::New("entries").ToLocalChecked(), Nan::New(stats.entries));
+  obj->Set(Nan::New("bytes").ToLocalChecked(), Nan::New((double)stats.bytes));
+  obj->Set(Nan::New("perSize").ToLocalChecked(), Nan::New(stats.perSize));
+  obj->Set(Nan::New("maxBytes").ToLocalChecked(), Nan::New((double)stats.maxBytes));
+
+  info.GetReturnValue().Set(obj);
+}
+
 void Context2D::Resize(const Nan::FunctionCallbackInfo<Value>& info) {
   Context2D *ctx = ObjectWrap::Unwrap<Context2D>(info.This());
 
@@ -252,7 +522,7 @@ void Context2D::DumpState(const Nan::FunctionCallbackInfo<Value>& info) {
 void Context2D::GetPixel(const Nan::FunctionCallbackInfo<Value>& info) {
   Context2D *ctx = ObjectWrap::Unwrap<Context2D>(info.This());
 
-  SkBitmap bitmap = ctx->canvas->getDevice()->accessBitmap(false);
+  SkBitmap bitmap = ctx->device->accessBitmap(false);
 
   ctx->canvas->flush();
 
@@ -275,34 +545,385 @@ void Context2D::GetPixel(const Nan::FunctionCallbackInfo<Value>& info) {
   info.GetReturnValue().Set(obj);
 }
 
+// getPixels(xy[, out]): the unpremultiplied RGBA bytes at each x, y pair of
+// the Int32Array xy, 4 per point, transparent black for points outside the
+// surface. Fills and returns out when given a Uint8Array large enough,
+// which saves an allocation per call for callers probing every frame.
+void Context2D::GetPixels(const Nan::FunctionCallbackInfo<Value>& info) {
+  Context2D *ctx = ObjectWrap::Unwrap<Context2D>(info.This());
+
+  if (!info[0]->IsInt32Array()) {
+    return Nan::ThrowTypeError("First argument needs to be an Int32Array");
+  }
+
+  Nan::TypedArrayContents<int32_t> xy(info[0]);
+  size_t count = xy.length() / 2;
+
+  Local<Uint8Array> out;
+  if (info[1]->IsUint8Array()) {
+    out = Local<Uint8Array>::Cast(info[1]);
+    if (out->Length() < count * 4) {
+      return Nan::ThrowRangeError("output array is too small");
+    }
+  } else {
+    out = Uint8Array::New(ArrayBuffer::New(Isolate::GetCurrent(), count * 4), 0, count * 4);
+  }
+
+  Nan::TypedArrayContents<uint8_t> contents(out);
+  uint8_t *dst = *contents;
+  const int32_t *points = *xy;
+
+  ctx->canvas->flush();
+  SkBitmap bitmap = ctx->device->accessBitmap(false);
+  bitmap.lockPixels();
+
+  uint32_t w = bitmap.width(), h = bitmap.height();
+  for (size_t i = 0; i<count; i++) {
+    int32_t x = points[i * 2];
+    int32_t y = points[i * 2 + 1];
+
+    if ((uint32_t)x < w && (uint32_t)y < h) {
+      UnpremultiplyRow(dst + i * 4, bitmap.getAddr32(x, y), 1);
+    } else {
+      memset(dst + i * 4, 0, 4);
+    }
+  }
+
+  bitmap.unlockPixels();
+
+  info.GetReturnValue().Set(out);
+}
+
+// Shared by the to*Buffer methods: the current frame encoded right away
+static void encodeFrame(const Nan::FunctionCallbackInfo<Value>& info,
+                        const EncodeOptions &options)
+{
+  Context2D *ctx = Nan::ObjectWrap::Unwrap<Context2D>(info.This());
+
+  if (!HasEncoder(options.type)) {
+    return Nan::ThrowError("this build has no encoder for that format");
+  }
+
+  if (!ctx->bitmap.getSize()) {
+    info.GetReturnValue().Set(Nan::NewBuffer(0).ToLocalChecked());
+    return;
+  }
+
+  ctx->canvas->flush();
+  SkData *data = EncodeImage(ctx->bitmap, options);
+  if (!data) {
+    return Nan::ThrowError("could not encode image");
+  }
+
+  info.GetReturnValue().Set(NewBufferFromData(data));
+}
+
+// Shared by the to*BufferAsync methods: encodes a snapshot of the current
+// frame on the threadpool and calls the function argument at index fn
+// with (err, buffer), or with (err, bytesWritten) when writing to fd.
+// Drawing can go on meanwhile, the first draw moves the context onto a
+// copy of the pixels.
+static void encodeFrameAsync(const Nan::FunctionCallbackInfo<Value>& info,
+                             const EncodeOptions &options,
+                             int fn,
+                             int fd = -1)
+{
+  Context2D *ctx = Nan::ObjectWrap::Unwrap<Context2D>(info.This());
+
+  if (!info[fn]->IsFunction()) {
+    return Nan::ThrowTypeError("Last argument needs to be a function");
+  }
+
+  if (!HasEncoder(options.type)) {
+    return Nan::ThrowError("this build has no encoder for that format");
+  }
+
+  SkBitmap bitmap;
+  if (!ctx->snapshot(&bitmap)) {
+    return Nan::ThrowError("canvas has no pixels to encode");
+  }
+
+  Nan::Callback *callback = new Nan::Callback(info[fn].As<Function>());
+  Nan::AsyncQueueWorker(new EncodeWorker(callback, bitmap, options, fd));
+}
+
+// quality of the lossy encoders, 0 to 100
+static bool parseQuality(Local<Value> value, int *quality) {
+  if (value->IsUndefined()) {
+    return true;
+  }
+
+  double q = value->NumberValue();
+  if (!value->IsNumber() || !(q >= 0 && q <= 100)) {
+    Nan::ThrowRangeError("quality needs to be between 0 and 100");
+    return false;
+  }
+
+  *quality = (int)q;
+  return true;
+}
+
+// toPngBuffer([options]): the current frame as a PNG, see ParsePngOptions
+// for the options
 void Context2D::ToPngBuffer(const Nan::FunctionCallbackInfo<Value>& info) {
+  EncodeOptions options;
+  if (ParsePngOptions(info[0], &options.png)) {
+    encodeFrame(info, options);
+  }
+}
+
+// toPngBufferAsync([options], fn)
+void Context2D::ToPngBufferAsync(const Nan::FunctionCallbackInfo<Value>& info) {
+  EncodeOptions options;
+  if (ParsePngOptions(info[0], &options.png)) {
+    encodeFrameAsync(info, options, 1);
+  }
+}
+
+// toJpegBuffer([quality]): the current frame as a JPEG, alpha is dropped
+void Context2D::ToJpegBuffer(const Nan::FunctionCallbackInfo<Value>& info) {
+  EncodeOptions options;
+  options.type = SkImageEncoder::kJPEG_Type;
+  if (parseQuality(info[0], &options.quality)) {
+    encodeFrame(info, options);
+  }
+}
+
+// toJpegBufferAsync([quality], fn)
+void Context2D::ToJpegBufferAsync(const Nan::FunctionCallbackInfo<Value>& info) {
+  EncodeOptions options;
+  options.type = SkImageEncoder::kJPEG_Type;
+  if (parseQuality(info[0], &options.quality)) {
+    encodeFrameAsync(info, options, 1);
+  }
+}
+
+// toWebpBuffer([quality]): the current frame as a lossy WebP
+void Context2D::ToWebpBuffer(const Nan::FunctionCallbackInfo<Value>& info) {
+  EncodeOptions options;
+  options.type = SkImageEncoder::kWEBP_Type;
+  if (parseQuality(info[0], &options.quality)) {
+    encodeFrame(info, options);
+  }
+}
+
+// toWebpBufferAsync([quality], fn)
+void Context2D::ToWebpBufferAsync(const Nan::FunctionCallbackInfo<Value>& info) {
+  EncodeOptions options;
+  options.type = SkImageEncoder::kWEBP_Type;
+  if (parseQuality(info[0], &options.quality)) {
+    encodeFrameAsync(info, options, 1);
+  }
+}
+
+// writePngToFd(fd, [options]): writes the current frame to fd as a PNG as
+// libpng produces it, nothing but one row is buffered. Returns the number
+// of bytes written.
+void Context2D::WritePngToFd(const Nan::FunctionCallbackInfo<Value>& info) {
   Context2D *ctx = ObjectWrap::Unwrap<Context2D>(info.This());
 
+  if (!info[0]->IsInt32() || info[0]->Int32Value() < 0) {
+    return Nan::ThrowTypeError("First argument needs to be a file descriptor");
+  }
+
+  PngOptions options;
+  if (!ParsePngOptions(info[1], &options)) {
+    return;
+  }
+
   ctx->canvas->flush();
-  SkBitmap bitmap = ctx->canvas->getDevice()->accessBitmap(false);
-  size_t size = bitmap.getSize();
+  FdWStream stream(info[0]->Int32Value());
+  if (!EncodePng(&stream, ctx->bitmap, options)) {
+    return Nan::ThrowError("could not write image");
+  }
 
-  void *data = malloc(size);
-  SkMemoryWStream stream(data, size);
-  SkImageEncoder::EncodeStream(&stream, bitmap, SkImageEncoder::kPNG_Type, 100);
+  info.GetReturnValue().Set(Nan::New((double)stream.bytesWritten()));
+}
 
-  Nan::MaybeLocal<v8::Object> buffer = Nan::NewBuffer((char *)data, size);
+// writePngToFdAsync(fd, [options], fn): the same from the threadpool, on a
+// snapshot of the current frame. Calls fn(err, bytesWritten).
+void Context2D::WritePngToFdAsync(const Nan::FunctionCallbackInfo<Value>& info) {
+  if (!info[0]->IsInt32() || info[0]->Int32Value() < 0) {
+    return Nan::ThrowTypeError("First argument needs to be a file descriptor");
+  }
 
-  info.GetReturnValue().Set(buffer.ToLocalChecked());
+  EncodeOptions options;
+  if (ParsePngOptions(info[1], &options.png)) {
+    encodeFrameAsync(info, options, 2, info[0]->Int32Value());
+  }
+}
+
+// createPngEncoder([options]): an incremental PNG encode of a snapshot of
+// the current frame, see PngEncoder. Backs createPNGStream().
+void Context2D::CreatePngEncoder(const Nan::FunctionCallbackInfo<Value>& info) {
+  Context2D *ctx = ObjectWrap::Unwrap<Context2D>(info.This());
+
+  PngOptions options;
+  if (!ParsePngOptions(info[0], &options)) {
+    return;
+  }
+
+  SkBitmap bitmap;
+  if (!ctx->snapshot(&bitmap)) {
+    return Nan::ThrowError("canvas has no pixels to encode");
+  }
+
+  Local<Value> encoder = PngEncoder::NewInstance(bitmap, options);
+  if (!encoder.IsEmpty()) {
+    info.GetReturnValue().Set(encoder);
+  }
 }
 
+// lockPixels(): a Uint8ClampedArray directly over the surface pixels,
+// premultiplied and in native channel order (its format property says
+// which), with rows stride bytes apart. Drawing while locked goes to the
+// same memory. Locking again returns the same view.
+void Context2D::LockPixels(const Nan::FunctionCallbackInfo<Value>& info) {
+  Context2D *ctx = ObjectWrap::Unwrap<Context2D>(info.This());
+
+  if (ctx->lockedPixels) {
+    info.GetReturnValue().Set(Nan::New(ctx->lockedPixelsView));
+    return;
+  }
+
+  size_t size = ctx->bitmap.getSize();
+  if (!ctx->bitmap.pixelRef() || !size) {
+    return Nan::ThrowError("canvas has no pixels to lock");
+  }
+
+  // writes through the view have to land where the canvas draws
+  ctx->aboutToWritePixels();
+  ctx->canvas->flush();
+
+  SkPixelRef *pixels = ctx->bitmap.pixelRef();
+  pixels->ref();
+  pixels->lockPixels();
+  ctx->lockedPixels = pixels;
+
+  Local<ArrayBuffer> buffer = ArrayBuffer::New(Isolate::GetCurrent(), pixels->pixels(), size);
+  Local<Uint8ClampedArray> view = Uint8ClampedArray::New(buffer, 0, size);
+
+  view->Set(Nan::New("width").ToLocalChecked(), Nan::New(ctx->bitmap.width()));
+  view->Set(Nan::New("height").ToLocalChecked(), Nan::New(ctx->bitmap.height()));
+  view->Set(Nan::New("stride").ToLocalChecked(), Nan::New((uint32_t)ctx->bitmap.rowBytes()));
+  view->Set(
+    Nan::New("format").ToLocalChecked(),
+    Nan::New(SK_R32_SHIFT == 0 ? "rgba" : "bgra").ToLocalChecked()
+  );
+
+  ctx->lockedPixelsView.Reset(view);
+  info.GetReturnValue().Set(view);
+}
 
+// unlockPixels(): detaches the view handed out by lockPixels() and marks
+// the pixels as changed
+void Context2D::UnlockPixels(const Nan::FunctionCallbackInfo<Value>& info) {
+  Context2D *ctx = ObjectWrap::Unwrap<Context2D>(info.This());
+
+  ctx->unlockPixels();
+  ctx->canvas->flush();
+}
+
+void Context2D::unlockPixels() {
+  if (!this->lockedPixels) {
+    return;
+  }
+
+  Nan::HandleScope scope;
+
+  // the view must not outlive the lock, it would point at freed or
+  // recycled pixels
+  Nan::New(this->lockedPixelsView)->Buffer()->Neuter();
+  this->lockedPixelsView.Reset();
+
+  this->lockedPixels->notifyPixelsChanged();
+  this->lockedPixels->unlockPixels();
+  this->lockedPixels->unref();
+  this->lockedPixels = NULL;
+}
+
+static void releaseSharedPixels(char *data, void *hint) {
+  SkPixelRef *pixels = (SkPixelRef *)hint;
+  pixels->unlockPixels();
+  pixels->unref();
+}
+
+// toBuffer([options]): the raw pixels of the canvas, as a copy unless
+// options say otherwise.
+//   copy: false - a buffer aliasing the pixels, which holds a ref on them
+//     until it is collected. The context draws into a copy from then on, so
+//     the buffer keeps showing the frame it was created from. Writing into
+//     the buffer is only visible on the canvas until the next draw. Pixels
+//     under lockPixels() and any format other than the native one are
+//     still copied.
+//   format - one of the formats ParsePixelFormat knows, the native format
+//     by default. The native format is returned as is.
+//   premultiplied - keep the colors of a converted format premultiplied,
+//     they are unpremultiplied otherwise.
 void Context2D::ToBuffer(const Nan::FunctionCallbackInfo<Value>& info) {
   Context2D *ctx = ObjectWrap::Unwrap<Context2D>(info.This());
 
+  bool copy = true;
+  bool premultiplied = false;
+  PixelFormat format = kNative_PixelFormat;
+  if (info[0]->IsObject()) {
+    Local<Object> options = info[0]->ToObject();
+    Local<Value> v = options->Get(Nan::New("copy").ToLocalChecked());
+    copy = !v->IsFalse();
+
+    v = options->Get(Nan::New("format").ToLocalChecked());
+    if (!v->IsUndefined()) {
+      Nan::Utf8String name(v);
+      if (!ParsePixelFormat(*name, &format)) {
+        return Nan::ThrowRangeError("unknown pixel format");
+      }
+    }
+
+    v = options->Get(Nan::New("premultiplied").ToLocalChecked());
+    premultiplied = v->IsTrue();
+  }
+
+  // a second alias of locked pixels would move the canvas off them on the
+  // next draw, leaving the view behind
+  SkPixelRef *pixels = ctx->bitmap.pixelRef();
+  if (!copy && !ctx->lockedPixels && format == kNative_PixelFormat &&
+      pixels && ctx->bitmap.getSize())
+  {
+    ctx->canvas->flush();
+
+    pixels->ref();
+    pixels->lockPixels();
+
+    Nan::MaybeLocal<v8::Object> buffer = Nan::NewBuffer(
+      (char *)pixels->pixels(),
+      ctx->bitmap.getSize(),
+      releaseSharedPixels,
+      pixels
+    );
+
+    info.GetReturnValue().Set(buffer.ToLocalChecked());
+    return;
+  }
+
 
-  SkBitmap bitmap = ctx->canvas->getDevice()->accessBitmap(true);
-  size_t size = bitmap.getSize();
-  void *data = malloc(size);
+  SkBitmap bitmap = ctx->device->accessBitmap(false);
+  size_t size = (size_t)bitmap.width() * bitmap.height() * PixelFormatBytes(format);
+  uint8_t *data = (uint8_t *)malloc(size);
+  if (!data && size) {
+    return Nan::ThrowError("could not allocate buffer");
+  }
   ctx->canvas->flush();
 
   bitmap.lockPixels();
-  memcpy(data, (const char *)bitmap.getPixels(), size);
+  if (format == kNative_PixelFormat) {
+    memcpy(data, (const char *)bitmap.getPixels(), size);
+  } else {
+    size_t rowBytes = (size_t)bitmap.width() * PixelFormatBytes(format);
+    for (int y = 0; y<bitmap.height(); y++) {
+      ConvertRow(data + y * rowBytes, bitmap.getAddr32(0, y), bitmap.width(),
+                 format, premultiplied);
+    }
+  }
   bitmap.unlockPixels();
 
   Nan::MaybeLocal<v8::Object> buffer = Nan::NewBuffer((char *)data, size);
@@ -310,17 +931,233 @@ void Context2D::ToBuffer(const Nan::FunctionCallbackInfo<Value>& info) {
   info.GetReturnValue().Set(buffer.ToLocalChecked());
 }
 
+// Replays a Float64Array of commands (see Context2D::Command) onto the
+// canvas in a single call. Arguments are validated the same way the
+// wrappers in context2d.js validate them: commands with non-finite
+// arguments are skipped.
+//
+// When the stream contains save/restore commands the return value is
+// [lowest, final], the lowest and final state depth reached relative to
+// the depth before the call, so the caller can mirror the state stack.
+void Context2D::Submit(const Nan::FunctionCallbackInfo<Value>& info) {
+  Context2D *ctx = ObjectWrap::Unwrap<Context2D>(info.This());
+
+  if (!info[0]->IsFloat64Array()) {
+    return Nan::ThrowTypeError("First argument needs to be a Float64Array");
+  }
+
+  Nan::TypedArrayContents<double> contents(info[0]);
+  const double *cmds = *contents;
+  size_t length = contents.length();
+
+  if (!info[1]->IsUndefined() && info[1]->Uint32Value() < length) {
+    length = info[1]->Uint32Value();
+  }
+
+  // the whole stream is checked up front, so a bad command draws nothing
+  // rather than leaving the commands before it applied
+  size_t pos = 0;
+  while (pos < length) {
+    uint32_t op = (uint32_t)cmds[pos];
+
+    if (op == 0 || op >= kCommandCount || pos + 1 + kCommandArity[op] > length) {
+      return Nan::ThrowError("invalid command in submitted buffer");
+    }
+
+    const double *a = cmds + pos + 1;
+    pos += 1 + kCommandArity[op];
+
+    if (!valid(a, kCommandArity[op])) {
+      continue;
+    }
+
+    if ((op == kArcTo_Command && a[4] < 0) || (op == kArc_Command && a[2] < 0)) {
+      return Nan::ThrowRangeError("radius must be > 0");
+    }
+  }
+
+  pos = 0;
+  int32_t depth = 0, lowest = 0;
+  bool depthChanged = false;
+
+  while (pos < length) {
+    uint32_t op = (uint32_t)cmds[pos];
+    const double *a = cmds + pos + 1;
+    pos += 1 + kCommandArity[op];
+
+    if (!valid(a, kCommandArity[op])) {
+      continue;
+    }
+
+    switch (op) {
+      case kBeginPath_Command:
+        ctx->beginPath();
+      break;
+
+      case kClosePath_Command:
+        ctx->closePath();
+      break;
+
+      case kMoveTo_Command:
+        ctx->moveTo(SkDoubleToScalar(a[0]), SkDoubleToScalar(a[1]));
+      break;
+
+      case kLineTo_Command:
+        ctx->lineTo(SkDoubleToScalar(a[0]), SkDoubleToScalar(a[1]));
+      break;
+
+      case kQuadraticCurveTo_Command:
+        ctx->quadraticCurveTo(
+          SkDoubleToScalar(a[0]), SkDoubleToScalar(a[1]),
+          SkDoubleToScalar(a[2]), SkDoubleToScalar(a[3])
+        );
+      break;
+
+      case kBezierCurveTo_Command:
+        ctx->bezierCurveTo(
+          SkDoubleToScalar(a[0]), SkDoubleToScalar(a[1]),
+          SkDoubleToScalar(a[2]), SkDoubleToScalar(a[3]),
+          SkDoubleToScalar(a[4]), SkDoubleToScalar(a[5])
+        );
+      break;
+
+      case kArcTo_Command:
+        if ((a[0] == a[2] && a[1] == a[3]) || a[4] == 0) {
+          ctx->lineTo(SkDoubleToScalar(a[0]), SkDoubleToScalar(a[1]));
+        } else {
+          ctx->arcTo(
+            SkDoubleToScalar(a[0]), SkDoubleToScalar(a[1]),
+            SkDoubleToScalar(a[2]), SkDoubleToScalar(a[3]),
+            SkDoubleToScalar(a[4])
+          );
+        }
+      break;
+
+      case kRect_Command:
+        ctx->rect(
+          SkDoubleToScalar(a[0]), SkDoubleToScalar(a[1]),
+          SkDoubleToScalar(a[2]), SkDoubleToScalar(a[3])
+        );
+      break;
+
+      case kArc_Command: {
+        if (a[3] == a[4]) {
+          break;
+        }
+
+        double diff = TAU - fabs(a[3] - a[4]);
+        if (a[5] && diff > 0 && diff < 0.0001) {
+          break;
+        }
+
+        ctx->arc(
+          SkDoubleToScalar(a[0]), SkDoubleToScalar(a[1]),
+          SkDoubleToScalar(a[2]), SkDoubleToScalar(a[3]),
+          SkDoubleToScalar(a[4]), a[5] != 0
+        );
+      }
+      break;
+
+      case kFill_Command:
+        ctx->fill();
+      break;
+
+      case kStroke_Command:
+        ctx->stroke();
+      break;
+
+      case kClip_Command:
+        ctx->clip();
+      break;
+
+      case kFillRect_Command:
+        ctx->fillRect(
+          SkDoubleToScalar(a[0]), SkDoubleToScalar(a[1]),
+          SkDoubleToScalar(a[2]), SkDoubleToScalar(a[3])
+        );
+      break;
+
+      case kStrokeRect_Command:
+        if (a[2] || a[3]) {
+          ctx->strokeRect(
+            SkDoubleToScalar(a[0]), SkDoubleToScalar(a[1]),
+            SkDoubleToScalar(a[2]), SkDoubleToScalar(a[3])
+          );
+        }
+      break;
+
+      case kClearRect_Command:
+        if (a[2] || a[3]) {
+          ctx->clearRect(
+            SkDoubleToScalar(a[0]), SkDoubleToScalar(a[1]),
+            SkDoubleToScalar(a[2]), SkDoubleToScalar(a[3])
+          );
+        }
+      break;
+
+      case kScale_Command:
+        ctx->canvas->scale(SkDoubleToScalar(a[0]), SkDoubleToScalar(a[1]));
+      break;
+
+      case kRotate_Command:
+        ctx->canvas->rotate(SkDoubleToScalar(DEGREES(a[0])));
+      break;
+
+      case kTranslate_Command:
+        ctx->canvas->translate(SkDoubleToScalar(a[0]), SkDoubleToScalar(a[1]));
+      break;
+
+      case kSetTransform_Command:
+        ctx->canvas->resetMatrix();
+        // fall through
+      case kTransform_Command:
+        ctx->transform(
+          SkDoubleToScalar(a[0]), SkDoubleToScalar(a[1]),
+          SkDoubleToScalar(a[2]), SkDoubleToScalar(a[3]),
+          SkDoubleToScalar(a[4]), SkDoubleToScalar(a[5])
+        );
+      break;
+
+      case kResetMatrix_Command:
+        ctx->canvas->resetMatrix();
+      break;
+
+      case kSave_Command:
+        ctx->save();
+        depth++;
+        depthChanged = true;
+      break;
+
+      case kRestore_Command:
+        if (ctx->restore()) {
+          depth--;
+          depthChanged = true;
+          if (depth < lowest) {
+            lowest = depth;
+          }
+        }
+      break;
+    }
+  }
+
+  if (depthChanged) {
+    Local<Array> ret = Nan::New<Array>(2);
+    ret->Set(0, Nan::New(lowest));
+    ret->Set(1, Nan::New(depth));
+    info.GetReturnValue().Set(ret);
+  }
+}
 
 void Context2D::Save(const Nan::FunctionCallbackInfo<Value>& info) {
   Context2D *ctx = ObjectWrap::Unwrap<Context2D>(info.This());
 
-  ctx->canvas->save();
+  ctx->save();
 }
 
 void Context2D::Restore(const Nan::FunctionCallbackInfo<Value>& info) {
   Context2D *ctx = ObjectWrap::Unwrap<Context2D>(info.This());
 
-  ctx->canvas->restore();
+  ctx->restore();
 }
 
 void Context2D::Scale(const Nan::FunctionCallbackInfo<Value>& info) {
@@ -369,24 +1206,30 @@ void Context2D::Transform(const Nan::FunctionCallbackInfo<Value>& info) {
     SkScalar e = SkDoubleToScalar(info[4]->NumberValue());
     SkScalar f = SkDoubleToScalar(info[5]->NumberValue());
 
-    SkMatrix m;
-
-    m[0] = a;
-    m[1] = c;
-    m[2] = e;
-    m[3] = b;
-    m[4] = d;
-    m[5] = f;
-    m[6] = 0;
-    m[7] = 0;
-    m[8] = 1;
-
     Context2D *ctx = ObjectWrap::Unwrap<Context2D>(info.This());
 
-    assert(ctx->canvas->concat(m));
+    ctx->transform(a, b, c, d, e, f);
   }
 }
 
+void Context2D::transform(SkScalar a, SkScalar b, SkScalar c,
+                          SkScalar d, SkScalar e, SkScalar f)
+{
+  SkMatrix m;
+
+  m[0] = a;
+  m[1] = c;
+  m[2] = e;
+  m[3] = b;
+  m[4] = d;
+  m[5] = f;
+  m[6] = 0;
+  m[7] = 0;
+  m[8] = 1;
+
+  this->canvas->concat(m);
+}
+
 void Context2D::ResetMatrix(const Nan::FunctionCallbackInfo<Value>& info) {
   Context2D *ctx = ObjectWrap::Unwrap<Context2D>(info.This());
   ctx->canvas->resetMatrix();
@@ -395,18 +1238,18 @@ void Context2D::ResetMatrix(const Nan::FunctionCallbackInfo<Value>& info) {
 void Context2D::SetGlobalAlpha(const Nan::FunctionCallbackInfo<Value>& info) {
   Context2D *ctx = ObjectWrap::Unwrap<Context2D>(info.This());\
 
-  ctx->globalAlpha = (uint8_t)(info[0]->NumberValue()*255);
+  ctx->state->globalAlpha = (uint8_t)(info[0]->NumberValue()*255);
 
-  if (ctx->globalAlpha > 255) {
-    ctx->globalAlpha = 255;
-  } else if (ctx->globalAlpha < 0) {
-    ctx->globalAlpha = 0;
+  if (ctx->state->globalAlpha > 255) {
+    ctx->state->globalAlpha = 255;
+  } else if (ctx->state->globalAlpha < 0) {
+    ctx->state->globalAlpha = 0;
   }
 }
 
 void Context2D::SetGlobalCompositeOperation(const Nan::FunctionCallbackInfo<Value>& info) {
   Context2D *ctx = ObjectWrap::Unwrap<Context2D>(info.This());
-  ctx->globalCompositeOperation = (SkXfermode::Mode)info[0]->IntegerValue();
+  ctx->state->globalCompositeOperation = (SkXfermode::Mode)info[0]->IntegerValue();
 }
 
 void Context2D::SetImageSmoothingEnabled(const Nan::FunctionCallbackInfo<Value>& info) {
@@ -420,15 +1263,17 @@ void Context2D::GetImageSmoothingEnabled(const Nan::FunctionCallbackInfo<Value>&
 void Context2D::SetStrokeStyle(const Nan::FunctionCallbackInfo<Value>& info) {
   Context2D *ctx = ObjectWrap::Unwrap<Context2D>(info.This());
 
-  // Clear off the old shader
-  ctx->strokePaint.setShader(NULL);
+  SkColor color;
+  Local<String> canonical;
+  if (!LookupCSSColor(info[0], &color, &canonical)) {
+    return;
+  }
 
-  U8CPU a = (U8CPU)info[3]->Uint32Value();
-  U8CPU r = (U8CPU)info[0]->Uint32Value();
-  U8CPU g = (U8CPU)info[1]->Uint32Value();
-  U8CPU b = (U8CPU)info[2]->Uint32Value();
+  // Clear off the old shader
+  ctx->state->strokePaint.setShader(NULL);
+  ctx->state->strokePaint.setColor(color);
 
-  ctx->strokePaint.setColor(SkColorSetARGBInline(a,r,g,b));
+  info.GetReturnValue().Set(canonical);
 }
 
 void Context2D::SetFillStylePattern(const Nan::FunctionCallbackInfo<Value>& info) {
@@ -458,22 +1303,24 @@ void Context2D::SetFillStylePattern(const Nan::FunctionCallbackInfo<Value>& info
   src.setPixels(buffer_data);
 
   SkBitmapProcShader *shader = SkNEW_ARGS(SkBitmapProcShader, (src, repeatX, repeatY));
-  ctx->paint.setShader(shader);
+  ctx->state->paint.setShader(shader);
   shader->unref();
 }
 
 void Context2D::SetFillStyle(const Nan::FunctionCallbackInfo<Value>& info) {
   Context2D *ctx = ObjectWrap::Unwrap<Context2D>(info.This());
 
-  // Clear off the old shader
-  ctx->paint.setShader(NULL);
+  SkColor color;
+  Local<String> canonical;
+  if (!LookupCSSColor(info[0], &color, &canonical)) {
+    return;
+  }
 
-  U8CPU a = info[3]->Uint32Value();
-  U8CPU r = info[0]->Uint32Value();
-  U8CPU g = info[1]->Uint32Value();
-  U8CPU b = info[2]->Uint32Value();
+  // Clear off the old shader
+  ctx->state->paint.setShader(NULL);
+  ctx->state->paint.setColor(color);
 
-  ctx->paint.setColor(SkColorSetARGBInline(a,r,g,b));
+  info.GetReturnValue().Set(canonical);
 }
 
 void Context2D::SetLinearGradientShader(const Nan::FunctionCallbackInfo<Value>& info) {
@@ -505,7 +1352,6 @@ void Context2D::SetLinearGradientShader(const Nan::FunctionCallbackInfo<Value>&
       offsets = new SkScalar[stopCount];
 
       Handle<Object> item;
-      Handle<Array> color;
 
       for (uint32_t stop = 0; stop < stopCount; stop++) {
         item = stops->Get(stop)->ToObject();
@@ -514,12 +1360,7 @@ void Context2D::SetLinearGradientShader(const Nan::FunctionCallbackInfo<Value>&
           item->Get(Nan::New("offset").ToLocalChecked())->NumberValue()
         );
 
-        color = Handle<Array>::Cast(item->Get(Nan::New("color").ToLocalChecked()));
-
-        colors[stop] = SkColorSetARGB(color->Get(3)->Uint32Value() & 0xff,
-                                      color->Get(0)->Uint32Value() & 0xff,
-                                      color->Get(1)->Uint32Value() & 0xff,
-                                      color->Get(2)->Uint32Value() & 0xff);
+        colors[stop] = item->Get(Nan::New("color").ToLocalChecked())->Uint32Value();
       }
 
 
@@ -531,7 +1372,7 @@ void Context2D::SetLinearGradientShader(const Nan::FunctionCallbackInfo<Value>&
         SkShader::kRepeat_TileMode
       );
 
-      ctx->paint.setShader(gradientShader);
+      ctx->state->paint.setShader(gradientShader);
 
       delete[] colors;
       delete[] offsets;
@@ -573,7 +1414,6 @@ void Context2D::SetRadialGradientShader(const Nan::FunctionCallbackInfo<Value>&
       offsets = new SkScalar[stopCount];
 
       Handle<Object> item;
-      Handle<Array> color;
 
       for (uint32_t stop = 0; stop < stopCount; stop++) {
         item = stops->Get(stop)->ToObject();
@@ -582,12 +1422,7 @@ void Context2D::SetRadialGradientShader(const Nan::FunctionCallbackInfo<Value>&
           item->Get(Nan::New("offset").ToLocalChecked())->NumberValue()
         );
 
-        color = Handle<Array>::Cast(item->Get(Nan::New("color").ToLocalChecked()));
-
-        colors[stop] = SkColorSetARGB(color->Get(3)->Uint32Value() & 0xff,
-                                      color->Get(0)->Uint32Value() & 0xff,
-                                      color->Get(1)->Uint32Value() & 0xff,
-                                      color->Get(2)->Uint32Value() & 0xff);
+        colors[stop] = item->Get(Nan::New("color").ToLocalChecked())->Uint32Value();
       }
 
       SkShader *gradientShader = SkGradientShader::CreateTwoPointConical(
@@ -603,7 +1438,7 @@ void Context2D::SetRadialGradientShader(const Nan::FunctionCallbackInfo<Value>&
 
       assert(gradientShader);
 
-      ctx->paint.setShader(gradientShader);
+      ctx->state->paint.setShader(gradientShader);
 
       delete[] colors;
       delete[] offsets;
@@ -616,48 +1451,55 @@ void Context2D::SetRadialGradientShader(const Nan::FunctionCallbackInfo<Value>&
 
 void Context2D::SetShadowOffsetX(const Nan::FunctionCallbackInfo<Value>& info) {
   Context2D *ctx = ObjectWrap::Unwrap<Context2D>(info.This());
-  ctx->shadowX = SkDoubleToScalar(info[0]->NumberValue());
+  ctx->state->shadowX = SkDoubleToScalar(info[0]->NumberValue());
 }
 
 void Context2D::SetShadowOffsetY(const Nan::FunctionCallbackInfo<Value>& info) {
   Context2D *ctx = ObjectWrap::Unwrap<Context2D>(info.This());
-  ctx->shadowY = SkDoubleToScalar(info[0]->NumberValue());
+  ctx->state->shadowY = SkDoubleToScalar(info[0]->NumberValue());
 }
 
 void Context2D::SetShadowBlur(const Nan::FunctionCallbackInfo<Value>& info) {
   Context2D *ctx = ObjectWrap::Unwrap<Context2D>(info.This());
-  ctx->shadowBlur = SkDoubleToScalar(info[0]->NumberValue());
+  ctx->state->shadowBlur = SkDoubleToScalar(info[0]->NumberValue());
 }
 
 void Context2D::SetShadowColor(const Nan::FunctionCallbackInfo<Value>& info) {
   Context2D *ctx = ObjectWrap::Unwrap<Context2D>(info.This());
 
-  // Clear off the old shader
-  ctx->shadowPaint.setShader(NULL);
+  SkColor color;
+  Local<String> canonical;
+  if (!LookupCSSColor(info[0], &color, &canonical)) {
+    return;
+  }
 
-  U8CPU a = info[3]->Uint32Value();
-  U8CPU r = info[0]->Uint32Value();
-  U8CPU g = info[1]->Uint32Value();
-  U8CPU b = info[2]->Uint32Value();
+  // Clear off the old shader
+  ctx->state->shadowPaint.setShader(NULL);
+  ctx->state->shadowPaint.setColor(color);
 
-  ctx->shadowPaint.setColor(SkColorSetARGBInline(a,r,g,b));
+  info.GetReturnValue().Set(canonical);
 }
 
 void Context2D::ClearRect(const Nan::FunctionCallbackInfo<Value>& info) {
   Context2D *ctx = ObjectWrap::Unwrap<Context2D>(info.This());
-  SkCanvas *canvas = ctx->canvas;
 
-  SkScalar x = SkDoubleToScalar(info[0]->NumberValue());
-  SkScalar y = SkDoubleToScalar(info[1]->NumberValue());
-  SkScalar w = SkDoubleToScalar(info[2]->NumberValue());
-  SkScalar h = SkDoubleToScalar(info[3]->NumberValue());
+  ctx->clearRect(
+    SkDoubleToScalar(info[0]->NumberValue()),
+    SkDoubleToScalar(info[1]->NumberValue()),
+    SkDoubleToScalar(info[2]->NumberValue()),
+    SkDoubleToScalar(info[3]->NumberValue())
+  );
+}
+
+void Context2D::clearRect(SkScalar x, SkScalar y, SkScalar w, SkScalar h) {
+  this->aboutToDraw();
 
-  canvas->save();
+  this->canvas->save();
   SkPaint clearPaint;
   clearPaint.setColor(SkColorSetARGBInline(0, 0, 0, 0));
   clearPaint.setXfermodeMode(SkXfermode::kSrc_Mode);
 
-  ctx->canvas->drawRectCoords(
+  this->canvas->drawRectCoords(
     x,
     y,
     x+w,
@@ -665,54 +1507,66 @@ void Context2D::ClearRect(const Nan::FunctionCallbackInfo<Value>& info) {
     clearPaint
   );
 
-  canvas->restore();
+  this->canvas->restore();
 }
 
 void Context2D::FillRect(const Nan::FunctionCallbackInfo<Value>& info) {
   Context2D *ctx = ObjectWrap::Unwrap<Context2D>(info.This());
 
-  SkRect rect = SkRect::MakeXYWH(
+  ctx->fillRect(
     SkDoubleToScalar(info[0]->NumberValue()),
-	SkDoubleToScalar(info[1]->NumberValue()),
-	SkDoubleToScalar(info[2]->NumberValue()),
-	SkDoubleToScalar(info[3]->NumberValue())
+    SkDoubleToScalar(info[1]->NumberValue()),
+    SkDoubleToScalar(info[2]->NumberValue()),
+    SkDoubleToScalar(info[3]->NumberValue())
   );
+}
+
+void Context2D::fillRect(SkScalar x, SkScalar y, SkScalar w, SkScalar h) {
+  this->aboutToDraw();
 
-  SkPaint p, spaint(ctx->paint);
-  p.setXfermodeMode(ctx->globalCompositeOperation);
-  p.setAlpha(ctx->globalAlpha);
+  SkRect rect = SkRect::MakeXYWH(x, y, w, h);
+
+  SkPaint p, spaint(this->state->paint);
+  p.setXfermodeMode(this->state->globalCompositeOperation);
+  p.setAlpha(this->state->globalAlpha);
 
   int count;
 
-  if (ctx->setupShadow(&spaint)) {
-    count = ctx->canvas->saveLayer(NULL, &p);
-    ctx->canvas->drawRect(rect, spaint);
-    ctx->canvas->drawRect(rect, ctx->shadowPaint);
-    ctx->canvas->restoreToCount(count);
+  if (this->setupShadow(&spaint)) {
+    count = this->canvas->saveLayer(NULL, &p);
+    this->canvas->drawRect(rect, spaint);
+    this->canvas->drawRect(rect, this->state->shadowPaint);
+    this->canvas->restoreToCount(count);
   }
 
-  count = ctx->canvas->saveLayer(NULL, &p);
-  ctx->canvas->drawRect(rect, ctx->paint);
-  ctx->canvas->restoreToCount(count);
+  count = this->canvas->saveLayer(NULL, &p);
+  this->canvas->drawRect(rect, this->state->paint);
+  this->canvas->restoreToCount(count);
 }
 
 void Context2D::StrokeRect(const Nan::FunctionCallbackInfo<Value>& info) {
   Context2D *ctx = ObjectWrap::Unwrap<Context2D>(info.This());
 
-  SkScalar x = SkDoubleToScalar(info[0]->NumberValue());
-  SkScalar y = SkDoubleToScalar(info[1]->NumberValue());
-  SkScalar w = SkDoubleToScalar(info[2]->NumberValue());
-  SkScalar h = SkDoubleToScalar(info[3]->NumberValue());
+  ctx->strokeRect(
+    SkDoubleToScalar(info[0]->NumberValue()),
+    SkDoubleToScalar(info[1]->NumberValue()),
+    SkDoubleToScalar(info[2]->NumberValue()),
+    SkDoubleToScalar(info[3]->NumberValue())
+  );
+}
+
+void Context2D::strokeRect(SkScalar x, SkScalar y, SkScalar w, SkScalar h) {
+  this->aboutToDraw();
 
-  SkPaint p(ctx->strokePaint);
-  p.setXfermodeMode(ctx->globalCompositeOperation);
-  p.setAlpha(ctx->globalAlpha);
+  SkPaint p(this->state->strokePaint);
+  p.setXfermodeMode(this->state->globalCompositeOperation);
+  p.setAlpha(this->state->globalAlpha);
 
   SkScalar bx = (x < 0) ? x : 0;
   SkScalar by = (y < 0) ? y : 0;
 
-  int dw = ctx->canvas->getDevice()->width();
-  int dh = ctx->canvas->getDevice()->height();
+  int dw = this->canvas->getDevice()->width();
+  int dh = this->canvas->getDevice()->height();
 
   SkScalar bw = w + x > dw ? w + x : dw;
   SkScalar bh = h + y > dh ? h + y : dh;
@@ -723,7 +1577,7 @@ void Context2D::StrokeRect(const Nan::FunctionCallbackInfo<Value>& info) {
     bx, by, bw, bh
   };
 
-  int count = ctx->canvas->saveLayer(&bounds, &p);
+  int count = this->canvas->saveLayer(&bounds, &p);
 
   if (!h || !w) {
     SkPath subpath;
@@ -734,9 +1588,9 @@ void Context2D::StrokeRect(const Nan::FunctionCallbackInfo<Value>& info) {
       subpath.lineTo(x+w, y);
     }
 
-    ctx->path.addPath(subpath);
+    this->path.addPath(subpath);
 
-    SkPaint p(ctx->strokePaint);
+    SkPaint p(this->state->strokePaint);
 
     if (p.getStrokeJoin() == SkPaint::kRound_Join) {
       p.setStrokeCap(SkPaint::kRound_Cap);
@@ -744,76 +1598,93 @@ void Context2D::StrokeRect(const Nan::FunctionCallbackInfo<Value>& info) {
       p.setStrokeCap(SkPaint::kButt_Cap);
     }
 
-    ctx->canvas->drawPath(ctx->path, p);
+    this->canvas->drawPath(this->path, p);
 
   } else {
 
-    SkPaint spaint(ctx->strokePaint);
+    SkPaint spaint(this->state->strokePaint);
 
     // TODO: in order to do this properly, it needs to be done like
     //       fillRect
-    ctx->setupShadow(&spaint);
+    this->setupShadow(&spaint);
 
-    ctx->canvas->drawRectCoords(x,y,x+w, y+h, spaint);
+    this->canvas->drawRectCoords(x,y,x+w, y+h, spaint);
   }
 
-  ctx->canvas->restoreToCount(count);
+  this->canvas->restoreToCount(count);
 }
 
 void Context2D::BeginPath(const Nan::FunctionCallbackInfo<Value>& info) {
   Context2D *ctx = ObjectWrap::Unwrap<Context2D>(info.This());
-  ctx->path.rewind();
+  ctx->beginPath();
+}
+
+void Context2D::beginPath() {
+  this->path.rewind();
 }
 
 void Context2D::Fill(const Nan::FunctionCallbackInfo<Value>& info) {
   Context2D *ctx = ObjectWrap::Unwrap<Context2D>(info.This());
+  ctx->fill();
+}
 
-  ctx->canvas->save();
-  ctx->canvas->resetMatrix();
+void Context2D::fill() {
+  this->aboutToDraw();
+
+  this->canvas->save();
+  this->canvas->resetMatrix();
 
-  ctx->canvas->drawPath(ctx->path, ctx->paint);
+  this->canvas->drawPath(this->path, this->state->paint);
 
-  ctx->canvas->restore();
+  this->canvas->restore();
 }
 
 void Context2D::Stroke(const Nan::FunctionCallbackInfo<Value>& info) {
   Context2D *ctx = ObjectWrap::Unwrap<Context2D>(info.This());
+  ctx->stroke();
+}
+
+void Context2D::stroke() {
+  this->aboutToDraw();
 
-  SkPaint stroke(ctx->strokePaint);
-  SkMatrix im, m = ctx->canvas->getTotalMatrix();
+  SkPaint stroke(this->state->strokePaint);
+  SkMatrix im, m = this->canvas->getTotalMatrix();
 
   m.invert(&im);
 
   SkPaint layerPaint;
-  layerPaint.setXfermodeMode(ctx->globalCompositeOperation);
-  layerPaint.setAlpha(ctx->globalAlpha);
+  layerPaint.setXfermodeMode(this->state->globalCompositeOperation);
+  layerPaint.setAlpha(this->state->globalAlpha);
 
   SkPath fillPath;
   bool fill = false;
 
-  if (!ctx->path.isLine(NULL) && (im.getScaleX() > 1 || im.getScaleY() > 1)) {
-    fill = stroke.getFillPath(ctx->path, &fillPath);
+  if (!this->path.isLine(NULL) && (im.getScaleX() > 1 || im.getScaleY() > 1)) {
+    fill = stroke.getFillPath(this->path, &fillPath);
   }
 
-  int count = ctx->canvas->saveLayer(NULL, &layerPaint);
+  int count = this->canvas->saveLayer(NULL, &layerPaint);
 
     // TODO: in order to do this properly, it needs to be done like
     //       fillRect
-    ctx->setupShadow(&stroke);
+    this->setupShadow(&stroke);
     if (fill) {
       fillPath.transform(im);
-      ctx->canvas->drawPath(fillPath, stroke);
+      this->canvas->drawPath(fillPath, stroke);
     } else {
-      ctx->path.transform(im);
-      ctx->canvas->drawPath(ctx->path, stroke);
+      this->path.transform(im);
+      this->canvas->drawPath(this->path, stroke);
     }
-  ctx->canvas->restoreToCount(count);
+  this->canvas->restoreToCount(count);
 }
 
 void Context2D::Clip(const Nan::FunctionCallbackInfo<Value>& info) {
   Context2D *ctx = ObjectWrap::Unwrap<Context2D>(info.This());
+  ctx->clip();
+}
 
-  ctx->canvas->clipPath(ctx->path, SkRegion::kIntersect_Op, true);
+void Context2D::clip() {
+  this->canvas->clipPath(this->path, SkRegion::kIntersect_Op, true);
 }
 
 void Context2D::IsPointInPath(const Nan::FunctionCallbackInfo<Value>& info) {
@@ -843,76 +1714,97 @@ void Context2D::IsPointInPath(const Nan::FunctionCallbackInfo<Value>& info) {
 
 void Context2D::ClosePath(const Nan::FunctionCallbackInfo<Value>& info) {
   Context2D *ctx = ObjectWrap::Unwrap<Context2D>(info.This());
-  ctx->path.close();
+  ctx->closePath();
+}
+
+void Context2D::closePath() {
+  this->path.close();
 }
 
 void Context2D::MoveTo(const Nan::FunctionCallbackInfo<Value>& info) {
   Context2D *ctx = ObjectWrap::Unwrap<Context2D>(info.This());
 
-  SkMatrix m = ctx->canvas->getTotalMatrix();
-
-  SkPoint pt;
-  m.mapXY(
+  ctx->moveTo(
     SkDoubleToScalar(info[0]->NumberValue()),
-    SkDoubleToScalar(info[1]->NumberValue()),
-    &pt
+    SkDoubleToScalar(info[1]->NumberValue())
   );
+}
 
-  ctx->path.moveTo(pt);
+void Context2D::moveTo(SkScalar x, SkScalar y) {
+  SkMatrix m = this->canvas->getTotalMatrix();
+
+  SkPoint pt;
+  m.mapXY(x, y, &pt);
+
+  this->path.moveTo(pt);
 }
 
 void Context2D::LineTo(const Nan::FunctionCallbackInfo<Value>& info) {
   Context2D *ctx = ObjectWrap::Unwrap<Context2D>(info.This());
 
-  SkMatrix m = ctx->canvas->getTotalMatrix();
-
-  SkPoint pt;
-  m.mapXY(
+  ctx->lineTo(
     SkDoubleToScalar(info[0]->NumberValue()),
-    SkDoubleToScalar(info[1]->NumberValue()),
-    &pt
+    SkDoubleToScalar(info[1]->NumberValue())
   );
+}
+
+void Context2D::lineTo(SkScalar x, SkScalar y) {
+  SkMatrix m = this->canvas->getTotalMatrix();
+
+  SkPoint pt;
+  m.mapXY(x, y, &pt);
 
-  if (ctx->path.isEmpty()) {
-    ctx->path.moveTo(pt);
+  if (this->path.isEmpty()) {
+    this->path.moveTo(pt);
   }
 
-  ctx->path.lineTo(pt);
+  this->path.lineTo(pt);
 }
 
 void Context2D::QuadraticCurveTo(const Nan::FunctionCallbackInfo<Value>& info) {
   Context2D *ctx = ObjectWrap::Unwrap<Context2D>(info.This());
 
-  SkScalar cpx = SkDoubleToScalar(info[0]->NumberValue());
-  SkScalar cpy = SkDoubleToScalar(info[1]->NumberValue());
-  SkScalar x = SkDoubleToScalar(info[2]->NumberValue());
-  SkScalar y = SkDoubleToScalar(info[3]->NumberValue());
+  ctx->quadraticCurveTo(
+    SkDoubleToScalar(info[0]->NumberValue()),
+    SkDoubleToScalar(info[1]->NumberValue()),
+    SkDoubleToScalar(info[2]->NumberValue()),
+    SkDoubleToScalar(info[3]->NumberValue())
+  );
+}
 
-  SkMatrix m = ctx->canvas->getTotalMatrix();
+void Context2D::quadraticCurveTo(SkScalar cpx, SkScalar cpy, SkScalar x, SkScalar y) {
+  SkMatrix m = this->canvas->getTotalMatrix();
   SkPoint cp, p;
 
   m.mapXY(cpx, cpy, &cp);
   m.mapXY(x, y, &p);
 
 
-  if (ctx->path.isEmpty()) {
-    ctx->path.moveTo(cp);
+  if (this->path.isEmpty()) {
+    this->path.moveTo(cp);
   }
 
-  ctx->path.quadTo(cp, p);
+  this->path.quadTo(cp, p);
 }
 
 void Context2D::BezierCurveTo(const Nan::FunctionCallbackInfo<Value>& info) {
   Context2D *ctx = ObjectWrap::Unwrap<Context2D>(info.This());
 
-  SkScalar x1 = SkDoubleToScalar(info[0]->NumberValue());
-  SkScalar y1 = SkDoubleToScalar(info[1]->NumberValue());
-  SkScalar x2 = SkDoubleToScalar(info[2]->NumberValue());
-  SkScalar y2 = SkDoubleToScalar(info[3]->NumberValue());
-  SkScalar x3 = SkDoubleToScalar(info[4]->NumberValue());
-  SkScalar y3 = SkDoubleToScalar(info[5]->NumberValue());
+  ctx->bezierCurveTo(
+    SkDoubleToScalar(info[0]->NumberValue()),
+    SkDoubleToScalar(info[1]->NumberValue()),
+    SkDoubleToScalar(info[2]->NumberValue()),
+    SkDoubleToScalar(info[3]->NumberValue()),
+    SkDoubleToScalar(info[4]->NumberValue()),
+    SkDoubleToScalar(info[5]->NumberValue())
+  );
+}
 
-  SkMatrix m = ctx->canvas->getTotalMatrix();
+void Context2D::bezierCurveTo(SkScalar x1, SkScalar y1,
+                              SkScalar x2, SkScalar y2,
+                              SkScalar x3, SkScalar y3)
+{
+  SkMatrix m = this->canvas->getTotalMatrix();
 
   SkPoint pt, p1, p2, p3;
 
@@ -920,30 +1812,39 @@ void Context2D::BezierCurveTo(const Nan::FunctionCallbackInfo<Value>& info) {
   m.mapXY(x2, y2, &p2);
   m.mapXY(x3, y3, &p3);
 
-  if (!ctx->path.getLastPt(&pt)) {
-    ctx->path.moveTo(x1, y1);
+  if (!this->path.getLastPt(&pt)) {
+    this->path.moveTo(x1, y1);
   } else {
-    ctx->path.moveTo(pt);
+    this->path.moveTo(pt);
   }
 
-  ctx->path.cubicTo(p1, p2, p3);
+  this->path.cubicTo(p1, p2, p3);
 }
 
 void Context2D::ArcTo(const Nan::FunctionCallbackInfo<Value>& info) {
   Context2D *ctx = ObjectWrap::Unwrap<Context2D>(info.This());
 
-  SkMatrix m(ctx->canvas->getTotalMatrix());
+  ctx->arcTo(
+    SkDoubleToScalar(info[0]->NumberValue()),
+    SkDoubleToScalar(info[1]->NumberValue()),
+    SkDoubleToScalar(info[2]->NumberValue()),
+    SkDoubleToScalar(info[3]->NumberValue()),
+    SkDoubleToScalar(info[4]->NumberValue())
+  );
+}
+
+void Context2D::arcTo(SkScalar x1, SkScalar y1, SkScalar x2, SkScalar y2, SkScalar r) {
+  SkMatrix m(this->canvas->getTotalMatrix());
 
   SkScalar tx = m.getTranslateX();
   SkScalar ty = m.getTranslateY();
   SkScalar sx = m.getScaleX();
   SkScalar sy = m.getScaleY();
 
-  SkScalar x1 = SkDoubleToScalar(info[0]->NumberValue() * sx) + tx;
-  SkScalar y1 = SkDoubleToScalar(info[1]->NumberValue() * sy) + ty;
-  SkScalar x2 = SkDoubleToScalar(info[2]->NumberValue() * sx) + tx;
-  SkScalar y2 = SkDoubleToScalar(info[3]->NumberValue() * sy) + ty;
-  SkScalar r = SkDoubleToScalar(info[4]->NumberValue());
+  x1 = x1 * sx + tx;
+  y1 = y1 * sy + ty;
+  x2 = x2 * sx + tx;
+  y2 = y2 * sy + ty;
 
   if (sx != 1 && sy != 1) {
     r = m.mapRadius(r);
@@ -955,15 +1856,15 @@ void Context2D::ArcTo(const Nan::FunctionCallbackInfo<Value>& info) {
 
   SkPoint pt;
 
-  bool hasPoint = ctx->path.getLastPt(&pt);
+  bool hasPoint = this->path.getLastPt(&pt);
   if (pt.equals(x1, y1)) {
   } else if (!hasPoint) {
-    ctx->path.moveTo(x1, y1);
+    this->path.moveTo(x1, y1);
   } else {
 
-    ctx->path.arcTo(x1, y1, x2, y2, r);
+    this->path.arcTo(x1, y1, x2, y2, r);
     if (sx != 1 || sy != 1) {
-      ctx->path.lineTo(x2, y2);
+      this->path.lineTo(x2, y2);
     }
   }
 }
@@ -971,35 +1872,45 @@ void Context2D::ArcTo(const Nan::FunctionCallbackInfo<Value>& info) {
 void Context2D::Rect(const Nan::FunctionCallbackInfo<Value>& info) {
   Context2D *ctx = ObjectWrap::Unwrap<Context2D>(info.This());
 
-  SkScalar x = SkDoubleToScalar(info[0]->NumberValue());
-  SkScalar y = SkDoubleToScalar(info[1]->NumberValue());
-  SkScalar w = SkDoubleToScalar(info[2]->NumberValue());
-  SkScalar h = SkDoubleToScalar(info[3]->NumberValue());
+  ctx->rect(
+    SkDoubleToScalar(info[0]->NumberValue()),
+    SkDoubleToScalar(info[1]->NumberValue()),
+    SkDoubleToScalar(info[2]->NumberValue()),
+    SkDoubleToScalar(info[3]->NumberValue())
+  );
+}
 
-  SkMatrix m = ctx->canvas->getTotalMatrix();
+void Context2D::rect(SkScalar x, SkScalar y, SkScalar w, SkScalar h) {
+  SkMatrix m = this->canvas->getTotalMatrix();
   SkPath subpath;
   subpath.addRect(SkRect::MakeXYWH(x, y, w, h));
   subpath.transform(m);
-  ctx->path.addPath(subpath);
+  this->path.addPath(subpath);
 }
 
 void Context2D::Arc(const Nan::FunctionCallbackInfo<Value>& info) {
   Context2D *ctx = ObjectWrap::Unwrap<Context2D>(info.This());
-  SkMatrix m = ctx->canvas->getTotalMatrix();
 
-  SkScalar x = SkDoubleToScalar(info[0]->NumberValue());
-  SkScalar y = SkDoubleToScalar(info[1]->NumberValue());
-  SkScalar r = SkDoubleToScalar(info[2]->NumberValue());
-  SkScalar sa = SkDoubleToScalar(info[3]->NumberValue());
-  SkScalar ea = SkDoubleToScalar(info[4]->NumberValue());
-  bool ccw = info[5]->BooleanValue();
+  ctx->arc(
+    SkDoubleToScalar(info[0]->NumberValue()),
+    SkDoubleToScalar(info[1]->NumberValue()),
+    SkDoubleToScalar(info[2]->NumberValue()),
+    SkDoubleToScalar(info[3]->NumberValue()),
+    SkDoubleToScalar(info[4]->NumberValue()),
+    info[5]->BooleanValue()
+  );
+}
 
+void Context2D::arc(SkScalar x, SkScalar y, SkScalar r,
+                    SkScalar sa, SkScalar ea, bool ccw)
+{
+  SkMatrix m = this->canvas->getTotalMatrix();
 
   SkPoint pt;
   m.mapXY(x, y, &pt);
 
-  if (!ctx->path.isEmpty()) {
-    ctx->path.lineTo(pt);
+  if (!this->path.isEmpty()) {
+    this->path.lineTo(pt);
   }
 
   SkRect rect;
@@ -1026,13 +1937,13 @@ void Context2D::Arc(const Nan::FunctionCallbackInfo<Value>& info) {
   SkScalar sweepDegrees = (SkScalar)DEGREES(diff);
 
   if (sweepDegrees == 0 || sweepDegrees >= 360 || sweepDegrees <= -360 || ea > sa+TAU) {
-    ctx->path.arcTo(rect, startDegrees, 0, false);
-    ctx->path.addOval(
+    this->path.arcTo(rect, startDegrees, 0, false);
+    this->path.addOval(
       rect,
       ccw ? SkPath::kCCW_Direction : SkPath::kCW_Direction
     );
 
-    ctx->path.arcTo(rect, startDegrees + sweepDegrees, 0, true);
+    this->path.arcTo(rect, startDegrees + sweepDegrees, 0, true);
 
   } else {
 
@@ -1043,7 +1954,7 @@ void Context2D::Arc(const Nan::FunctionCallbackInfo<Value>& info) {
     } else if (!ccw && sweepDegrees <= 0) {
       sweepDegrees += 360;
     }
-    ctx->path.arcTo(rect, startDegrees, sweepDegrees, false);
+    this->path.arcTo(rect, startDegrees, sweepDegrees, false);
   }
 }
 
@@ -1053,6 +1964,7 @@ void Context2D::Ellipse(const Nan::FunctionCallbackInfo<Value>& info) {
 
 void Context2D::FillText(const Nan::FunctionCallbackInfo<Value>& info) {
   Context2D *ctx = ObjectWrap::Unwrap<Context2D>(info.This());
+  ctx->aboutToDraw();
 
   String::Utf8Value string(info[0]);
   SkScalar x = SkDoubleToScalar(info[1]->NumberValue());
@@ -1061,14 +1973,15 @@ void Context2D::FillText(const Nan::FunctionCallbackInfo<Value>& info) {
 
   if (!info[3]->IsUndefined()) {
     SkScalar maxWidth = SkDoubleToScalar(info[3]->NumberValue());
-    length = ctx->paint.breakText(*string, length, maxWidth);
+    length = ctx->state->paint.breakText(*string, length, maxWidth);
   }
 
-  ctx->canvas->drawText(*string, length, x, y, ctx->paint);
+  ctx->canvas->drawText(*string, length, x, y, ctx->state->paint);
 }
 
 void Context2D::StrokeText(const Nan::FunctionCallbackInfo<Value>& info) {
   Context2D *ctx = ObjectWrap::Unwrap<Context2D>(info.This());
+  ctx->aboutToDraw();
 
   String::Utf8Value string(info[0]);
   SkScalar x = SkDoubleToScalar(info[1]->NumberValue());
@@ -1077,10 +1990,10 @@ void Context2D::StrokeText(const Nan::FunctionCallbackInfo<Value>& info) {
 
   if (!info[3]->IsUndefined()) {
     SkScalar maxWidth = SkDoubleToScalar(info[3]->NumberValue());
-    length = ctx->strokePaint.breakText(*string, length, maxWidth);
+    length = ctx->state->strokePaint.breakText(*string, length, maxWidth);
   }
 
-  ctx->canvas->drawText(*string, length, x, y, ctx->strokePaint);
+  ctx->canvas->drawText(*string, length, x, y, ctx->state->strokePaint);
 }
 
 void Context2D::MeasureText(const Nan::FunctionCallbackInfo<Value>& info) {
@@ -1089,7 +2002,7 @@ void Context2D::MeasureText(const Nan::FunctionCallbackInfo<Value>& info) {
 
   SkRect bounds;
 
-  SkScalar width = ctx->paint.measureText(
+  SkScalar width = ctx->state->paint.measureText(
     *string,
     string.length(),
     &bounds
@@ -1099,6 +2012,14 @@ void Context2D::MeasureText(const Nan::FunctionCallbackInfo<Value>& info) {
   Local<Object> obj = Nan::New<Object>();
   obj->Set(Nan::New("width").ToLocalChecked(), Nan::New(width));
   obj->Set(Nan::New("height").ToLocalChecked(), Nan::New(bounds.height()));
+  obj->Set(
+    Nan::New("fontBoundingBoxAscent").ToLocalChecked(),
+    Nan::New(-ctx->state->fontMetrics.fAscent)
+  );
+  obj->Set(
+    Nan::New("fontBoundingBoxDescent").ToLocalChecked(),
+    Nan::New(ctx->state->fontMetrics.fDescent)
+  );
 
   info.GetReturnValue().Set(obj);
 }
@@ -1111,8 +2032,8 @@ void Context2D::SetFont(const Nan::FunctionCallbackInfo<Value>& info) {
   bool isItalic = info[2]->BooleanValue();
 
   SkScalar fontSize = SkDoubleToScalar(info[3]->NumberValue());
-  ctx->paint.setTextSize(fontSize);
-  ctx->strokePaint.setTextSize(fontSize);
+  ctx->state->paint.setTextSize(fontSize);
+  ctx->state->strokePaint.setTextSize(fontSize);
 
   SkTypeface::Style style = SkTypeface::kNormal;
 
@@ -1124,19 +2045,14 @@ void Context2D::SetFont(const Nan::FunctionCallbackInfo<Value>& info) {
     style = SkTypeface::kItalic;
   }
 
-  SkTypeface *face = NULL;
-
-  if (info[0]->IsString()) {
-    String::Utf8Value family(info[0]);
-    face = SkTypeface::CreateFromName(*family, style);
-  } else if (info[0]->IsNumber()) {
-    SkFontID id = info[0]->Uint32Value();
-    face = SkTypefaceCache::FindByID(id);
-  }
+  const FontCacheEntry *font = LookupFont(info[0], style, fontSize, ctx->state->paint);
 
-  if (face) {
-    ctx->paint.setTypeface(face);
-    ctx->strokePaint.setTypeface(face);
+  if (font) {
+    ctx->state->paint.setTypeface(font->typeface);
+    ctx->state->strokePaint.setTypeface(font->typeface);
+    ctx->state->fontMetrics = font->metrics;
+  } else {
+    ctx->state->paint.getFontMetrics(&ctx->state->fontMetrics);
   }
 }
 
@@ -1144,16 +2060,20 @@ void Context2D::SetTextAlign(const Nan::FunctionCallbackInfo<Value>& info) {
   Context2D *ctx = ObjectWrap::Unwrap<Context2D>(info.This());
 
   SkPaint::Align align = (SkPaint::Align)info[0]->IntegerValue();
-  ctx->paint.setTextAlign(align);
-  ctx->strokePaint.setTextAlign(align);
+  ctx->state->paint.setTextAlign(align);
+  ctx->state->strokePaint.setTextAlign(align);
 }
 
 void Context2D::GetTextBaseline(const Nan::FunctionCallbackInfo<Value>& info) {
-    // Context2D *ctx = ObjectWrap::Unwrap<Context2D>(info.This());
+  Context2D *ctx = ObjectWrap::Unwrap<Context2D>(info.This());
+
+  info.GetReturnValue().Set(Nan::New(ctx->state->textBaseline));
 }
 
 void Context2D::SetTextBaseline(const Nan::FunctionCallbackInfo<Value>& info) {
-    // Context2D *ctx = ObjectWrap::Unwrap<Context2D>(info.This());
+  Context2D *ctx = ObjectWrap::Unwrap<Context2D>(info.This());
+
+  ctx->state->textBaseline = (uint8_t)info[0]->Uint32Value();
 }
 
 void Context2D::AddFont(const Nan::FunctionCallbackInfo<Value>& info) {
@@ -1197,70 +2117,260 @@ void Context2D::DrawImageBuffer(const Nan::FunctionCallbackInfo<Value>& info) {
   SkRect srcRect = { sx, sy, sx+sw, sy+sh };
   SkRect destRect = { dx, dy, dx+dw, dy+dh };
 
+  ctx->drawImage(src, srcRect, destRect);
+}
+
+// drawImageBitmap(bitmap, sx, sy, sw, sh, dx, dy, dw, dh): draws an
+// ImageBitmap without wrapping or converting anything per call
+void Context2D::DrawImageBitmap(const Nan::FunctionCallbackInfo<Value>& info) {
+  Context2D *ctx = ObjectWrap::Unwrap<Context2D>(info.This());
+
+  if (!ImageBitmap::HasInstance(info[0])) {
+    return Nan::ThrowTypeError("First argument needs to be an ImageBitmap");
+  }
+
+  ImageBitmap *image = ObjectWrap::Unwrap<ImageBitmap>(info[0]->ToObject());
+  if (image->bitmap.isNull()) {
+    return Nan::ThrowError("image bitmap is closed");
+  }
+
+  SkScalar sx = SkDoubleToScalar(info[1]->NumberValue());
+  SkScalar sy = SkDoubleToScalar(info[2]->NumberValue());
+  SkScalar sw = SkDoubleToScalar(info[3]->NumberValue());
+  SkScalar sh = SkDoubleToScalar(info[4]->NumberValue());
+  SkScalar dx = SkDoubleToScalar(info[5]->NumberValue());
+  SkScalar dy = SkDoubleToScalar(info[6]->NumberValue());
+  SkScalar dw = SkDoubleToScalar(info[7]->NumberValue());
+  SkScalar dh = SkDoubleToScalar(info[8]->NumberValue());
+
+  SkRect srcRect = { sx, sy, sx+sw, sy+sh };
+  SkRect destRect = { dx, dy, dx+dw, dy+dh };
+
+  ctx->drawImage(image->bitmap, srcRect, destRect);
+}
+
+// drawContext(context, sx, sy, sw, sh, dx, dy, dw, dh): draws another
+// context's current frame. The snapshot shares its pixels only for the
+// length of the draw (or of the picture, when recording), so the source
+// keeps drawing in place and goes back to the pool on release.
+void Context2D::DrawContext(const Nan::FunctionCallbackInfo<Value>& info) {
+  Context2D *ctx = ObjectWrap::Unwrap<Context2D>(info.This());
+
+  if (!Context2D::HasInstance(info[0])) {
+    return Nan::ThrowTypeError("First argument needs to be a Context2D");
+  }
+
+  Context2D *source = ObjectWrap::Unwrap<Context2D>(info[0]->ToObject());
+  SkBitmap bitmap;
+  if (!source->snapshot(&bitmap)) {
+    return;
+  }
+
+  SkScalar sx = SkDoubleToScalar(info[1]->NumberValue());
+  SkScalar sy = SkDoubleToScalar(info[2]->NumberValue());
+  SkScalar sw = SkDoubleToScalar(info[3]->NumberValue());
+  SkScalar sh = SkDoubleToScalar(info[4]->NumberValue());
+  SkScalar dx = SkDoubleToScalar(info[5]->NumberValue());
+  SkScalar dy = SkDoubleToScalar(info[6]->NumberValue());
+  SkScalar dw = SkDoubleToScalar(info[7]->NumberValue());
+  SkScalar dh = SkDoubleToScalar(info[8]->NumberValue());
+
+  SkRect srcRect = { sx, sy, sx+sw, sy+sh };
+  SkRect destRect = { dx, dy, dx+dw, dy+dh };
+
+  ctx->drawImage(bitmap, srcRect, destRect);
+}
+
+// drawRegionImage(image, sx, sy, sw, sh, dx, dy, dw, dh): decodes only the
+// tiles under the source rect, sampled down as far as the destination
+// size in device pixels allows
+void Context2D::DrawRegionImage(const Nan::FunctionCallbackInfo<Value>& info) {
+  Context2D *ctx = ObjectWrap::Unwrap<Context2D>(info.This());
+
+  if (!RegionImage::HasInstance(info[0])) {
+    return Nan::ThrowTypeError("First argument needs to be a RegionImage");
+  }
+
+  RegionImage *image = ObjectWrap::Unwrap<RegionImage>(info[0]->ToObject());
+  if (image->isClosed()) {
+    return Nan::ThrowError("region image is closed");
+  }
+
+  SkScalar sx = SkDoubleToScalar(info[1]->NumberValue());
+  SkScalar sy = SkDoubleToScalar(info[2]->NumberValue());
+  SkScalar sw = SkDoubleToScalar(info[3]->NumberValue());
+  SkScalar sh = SkDoubleToScalar(info[4]->NumberValue());
+  SkScalar dx = SkDoubleToScalar(info[5]->NumberValue());
+  SkScalar dy = SkDoubleToScalar(info[6]->NumberValue());
+  SkScalar dw = SkDoubleToScalar(info[7]->NumberValue());
+  SkScalar dh = SkDoubleToScalar(info[8]->NumberValue());
+
+  SkRect srcRect = { sx, sy, sx+sw, sy+sh };
+  SkRect destRect = { dx, dy, dx+dw, dy+dh };
+
+  // negative for perspective, which gets the full resolution
+  SkScalar stretch = ctx->canvas->getTotalMatrix().getMaxStretch();
+  if (stretch <= 0) {
+    stretch = SK_Scalar1;
+  }
+
+  SkSize destSize = SkSize::Make(SkScalarMul(SkScalarAbs(dw), stretch),
+                                 SkScalarMul(SkScalarAbs(dh), stretch));
+
+  SkBitmap region;
+  SkRect regionRect;
+  if (!image->getRegion(srcRect, destSize, &region, &regionRect)) {
+    return;
+  }
+
+  if (!region.isNull()) {
+    ctx->drawImage(region, regionRect, destRect);
+  }
+}
+
+// beginRecording(): draws into a Picture instead of the surface until
+// endRecording(). Pixel reads, putImageData and the encoders keep working
+// on the surface, which the recorded drawing never reaches.
+void Context2D::BeginRecording(const Nan::FunctionCallbackInfo<Value>& info) {
+  Context2D *ctx = ObjectWrap::Unwrap<Context2D>(info.This());
+
+  if (ctx->recording) {
+    return Nan::ThrowError("already recording");
+  }
+
+  ctx->beginRecording();
+}
+
+void Context2D::EndRecording(const Nan::FunctionCallbackInfo<Value>& info) {
+  Context2D *ctx = ObjectWrap::Unwrap<Context2D>(info.This());
+
+  if (!ctx->recording) {
+    return Nan::ThrowError("not recording");
+  }
+
+  info.GetReturnValue().Set(Picture::NewInstance(ctx->endRecording()));
+}
+
+// drawPicture(picture, a, b, c, d, e, f): plays picture back with
+// [a b c d e f] applied on top of the current transform
+void Context2D::DrawPicture(const Nan::FunctionCallbackInfo<Value>& info) {
+  Context2D *ctx = ObjectWrap::Unwrap<Context2D>(info.This());
+
+  if (!Picture::HasInstance(info[0])) {
+    return Nan::ThrowTypeError("First argument needs to be a Picture");
+  }
+
+  Picture *picture = ObjectWrap::Unwrap<Picture>(info[0]->ToObject());
+  if (!picture->picture) {
+    return Nan::ThrowError("picture is closed");
+  }
+
+  SkMatrix m;
+  m.setAll(
+    SkDoubleToScalar(info[1]->NumberValue()),
+    SkDoubleToScalar(info[3]->NumberValue()),
+    SkDoubleToScalar(info[5]->NumberValue()),
+    SkDoubleToScalar(info[2]->NumberValue()),
+    SkDoubleToScalar(info[4]->NumberValue()),
+    SkDoubleToScalar(info[6]->NumberValue()),
+    0, 0, SK_Scalar1
+  );
+
+  ctx->drawPicture(*picture->picture, m);
+}
+
+// globalAlpha and globalCompositeOperation apply to the picture as a whole,
+// through a layer, which plain source-over drawing skips
+void Context2D::drawPicture(SkPicture &picture, const SkMatrix &matrix) {
+  this->aboutToDraw();
+
+  int count = this->canvas->save();
+  this->canvas->concat(matrix);
+
+  if (this->state->globalAlpha != 255 ||
+      this->state->globalCompositeOperation != SkXfermode::kSrcOver_Mode)
+  {
+    SkPaint layerPaint;
+    layerPaint.setXfermodeMode(this->state->globalCompositeOperation);
+    layerPaint.setAlpha(this->state->globalAlpha);
+
+    SkRect bounds = SkRect::MakeWH(SkIntToScalar(picture.width()),
+                                   SkIntToScalar(picture.height()));
+    this->canvas->saveLayer(&bounds, &layerPaint);
+  }
+
+  this->canvas->drawPicture(picture);
+  this->canvas->restoreToCount(count);
+}
+
+void Context2D::drawImage(const SkBitmap &src, const SkRect &srcRect, const SkRect &destRect) {
+  this->aboutToDraw();
+
   SkRect bounds = {
     0, 0,
-    SkIntToScalar(ctx->canvas->getDevice()->width()),
-	SkIntToScalar(ctx->canvas->getDevice()->height())
+    SkIntToScalar(this->canvas->getDevice()->width()),
+    SkIntToScalar(this->canvas->getDevice()->height())
   };
 
   SkPaint layerPaint, spaint;
-  layerPaint.setXfermodeMode(ctx->globalCompositeOperation);
-  layerPaint.setAlpha(ctx->globalAlpha);
+  layerPaint.setXfermodeMode(this->state->globalCompositeOperation);
+  layerPaint.setAlpha(this->state->globalAlpha);
 
   // TODO: in order to do this properly, it needs to be done like
   //       fillRect
-  ctx->setupShadow(&spaint);
+  this->setupShadow(&spaint);
 
-  int count = ctx->canvas->saveLayer(&bounds, &layerPaint);
-  ctx->canvas->drawBitmapRectToRect(src, &srcRect, destRect, &spaint);
-  ctx->canvas->restoreToCount(count);
+  int count = this->canvas->saveLayer(&bounds, &layerPaint);
+  this->canvas->drawBitmapRectToRect(src, &srcRect, destRect, &spaint);
+  this->canvas->restoreToCount(count);
 }
 
 void Context2D::CreateImageData(const Nan::FunctionCallbackInfo<Value>& info) {
     // Context2D *ctx = ObjectWrap::Unwrap<Context2D>(info.This());
 }
 
+// Reads back the pixels in the given rect as unpremultiplied RGBA, a row at
+// a time. Parts of the rect outside the surface come back transparent black.
 void Context2D::GetImageData(const Nan::FunctionCallbackInfo<Value>& info) {
   Context2D *ctx = ObjectWrap::Unwrap<Context2D>(info.This());
 
   int32_t sx = info[0]->Int32Value();
   int32_t sy = info[1]->Int32Value();
-  int32_t sw = info[2]->Int32Value();
-  int32_t sh = info[3]->Int32Value();
+  int32_t sw = SkMax32(info[2]->Int32Value(), 0);
+  int32_t sh = SkMax32(info[3]->Int32Value(), 0);
 
-  SkIRect srcRect = SkIRect::MakeXYWH(sx, sy, sw, sh);
+  size_t size = (size_t)sw * sh * 4;
+  uint8_t *data = (uint8_t *)malloc(size);
+  if (!data && size) {
+    return Nan::ThrowError("could not allocate image data");
+  }
 
   ctx->canvas->flush();
-  SkBitmap masterBitmap = ctx->canvas->getDevice()->accessBitmap(false);
-
-  masterBitmap.lockPixels();
-
-  //pxref->readPixels(&bitmap, &srcRect);
-  size_t size = sw*sh*4;
-  void *data = malloc(size);
-  SkColor *buffer_ptr = (SkColor *)data;
-
-  int32_t loc = 0;
-  SkColor current;
-  for (int32_t y = sy; y<sh+sy; y++) {
-    for (int32_t x = sx; x<sw+sx; x++) {
-      current = masterBitmap.getColor(x, y);
-      buffer_ptr[loc++] = SkColorSetARGBInline(
-        SkColorGetA(current),
-        SkColorGetB(current),
-        SkColorGetG(current),
-        SkColorGetR(current)
-      );
-    }
+  SkBitmap bitmap = ctx->device->accessBitmap(false);
+
+  SkIRect srcRect = SkIRect::MakeXYWH(sx, sy, sw, sh);
+  SkIRect area = srcRect;
+  if (!area.intersect(0, 0, bitmap.width(), bitmap.height())) {
+    area.setEmpty();
   }
 
-  masterBitmap.unlockPixels();
+  if (area != srcRect) {
+    memset(data, 0, size);
+  }
 
-// TODO: consider using masterBitmap.extractSubset
-//       tried it before, but had issues with it pulling
-//       the full row of pixels instead of a subset.
-//  Also tried with SkPixelRef directly with the same result.
-//  Perhaps using the GPU device will help with this?
+  if (!area.isEmpty()) {
+    bitmap.lockPixels();
+
+    for (int32_t y = area.fTop; y < area.fBottom; y++) {
+      UnpremultiplyRow(
+        data + ((size_t)(y - sy) * sw + (area.fLeft - sx)) * 4,
+        bitmap.getAddr32(area.fLeft, y),
+        area.width()
+      );
+    }
+
+    bitmap.unlockPixels();
+  }
 
   Local<Object> obj = Nan::New<Object>();
   obj->Set(Nan::New("width").ToLocalChecked(), Nan::New(sw));
@@ -1270,48 +2380,68 @@ void Context2D::GetImageData(const Nan::FunctionCallbackInfo<Value>& info) {
   info.GetReturnValue().Set(obj);
 }
 
+// putImageData(data, width, height, dx, dy, dirtyX, dirtyY, dirtyWidth,
+// dirtyHeight): clips the dirty rect against the image and the surface,
+// then premultiplies whole rows straight out of data (a Buffer or typed
+// array). Like the spec says, the matrix, clip and compositing are ignored.
 void Context2D::PutImageData(const Nan::FunctionCallbackInfo<Value>& info) {
   Context2D *ctx = ObjectWrap::Unwrap<Context2D>(info.This());
 
-  Local<Object> buffer_obj = info[0]->ToObject();
-  SkColor *buffer_ptr = (SkColor *)Buffer::Data(buffer_obj);
-  size_t buffer_length = Buffer::Length(buffer_obj);
-
-  int32_t sx = info[1]->Int32Value();
-  int32_t sy = info[2]->Int32Value();
-  int32_t dx = info[3]->Int32Value();
-  int32_t dy = info[4]->Int32Value();
-  int32_t dw = info[5]->Int32Value();
-  int32_t dh = info[6]->Int32Value();
-  int32_t w  = info[7]->Int32Value();
+  uint8_t *pixels;
+  size_t length;
+  if (!GetPixelData(info[0], &pixels, &length)) {
+    return Nan::ThrowTypeError("First argument needs to be a Buffer or a typed array");
+  }
 
-  ctx->canvas->flush();
+  int64_t iw = info[1]->Int32Value();
+  int64_t ih = info[2]->Int32Value();
+  int64_t dx = info[3]->Int32Value();
+  int64_t dy = info[4]->Int32Value();
+  int64_t left = info[5]->Int32Value();
+  int64_t top = info[6]->Int32Value();
+  int64_t right = left + info[7]->Int32Value();
+  int64_t bottom = top + info[8]->Int32Value();
+
+  if (iw < 0 || ih < 0 || (uint64_t)(iw * ih * 4) > length) {
+    return Nan::ThrowRangeError("image data is smaller than its dimensions");
+  }
 
-  SkBitmap bitmap = ctx->canvas->getDevice()->accessBitmap(true);
-  bitmap.lockPixels();
-  SkColor *dest;
+  // negative dirty sizes extend up and to the left
+  if (right < left) {
+    SkTSwap(left, right);
+  }
 
-  size_t loc = 0;
-  SkColor current;
+  if (bottom < top) {
+    SkTSwap(top, bottom);
+  }
 
-  for (int32_t cy = 0; cy<dh; cy++) {
-    for (int32_t cx = 0; cx<dw; cx++) {
+  // clip to the image, then move to surface space and clip to the surface
+  left = SkTMax<int64_t>(left, 0) + dx;
+  top = SkTMax<int64_t>(top, 0) + dy;
+  right = SkTMin(right, iw) + dx;
+  bottom = SkTMin(bottom, ih) + dy;
 
-      dest = (SkColor *)bitmap.getAddr(cx+dx+sx, cy+dy+sy);
+  left = SkTMax<int64_t>(left, 0);
+  top = SkTMax<int64_t>(top, 0);
+  right = SkTMin<int64_t>(right, ctx->bitmap.width());
+  bottom = SkTMin<int64_t>(bottom, ctx->bitmap.height());
 
-      loc = (dy + cy)*w + dx + cx;
+  if (left >= right || top >= bottom) {
+    return;
+  }
 
-      assert(loc < buffer_length);
+  ctx->aboutToWritePixels();
+  ctx->canvas->flush();
 
-      current = buffer_ptr[loc];
+  SkBitmap bitmap = ctx->device->accessBitmap(true);
+  bitmap.lockPixels();
 
-      *dest = SkPreMultiplyARGB(
-        SkColorGetA(current),
-        SkColorGetB(current),
-        SkColorGetG(current),
-        SkColorGetR(current)
-      );
-    }
+  for (int64_t y = top; y < bottom; y++) {
+    PremultiplyRow(
+      bitmap.getAddr32((int)left, (int)y),
+      pixels + ((y - dy) * iw + (left - dx)) * 4,
+      (int)(right - left)
+    );
   }
 
   bitmap.unlockPixels();
@@ -1319,23 +2449,23 @@ void Context2D::PutImageData(const Nan::FunctionCallbackInfo<Value>& info) {
 
 void Context2D::SetLineWidth(const Nan::FunctionCallbackInfo<Value>& info) {
   Context2D *ctx = ObjectWrap::Unwrap<Context2D>(info.This());
-  ctx->strokePaint.setStrokeWidth(SkDoubleToScalar(info[0]->NumberValue()));
+  ctx->state->strokePaint.setStrokeWidth(SkDoubleToScalar(info[0]->NumberValue()));
 
-  ctx->defaultLineWidth = false;
+  ctx->state->defaultLineWidth = false;
 }
 
 void Context2D::SetLineCap(const Nan::FunctionCallbackInfo<Value>& info) {
   Context2D *ctx = ObjectWrap::Unwrap<Context2D>(info.This());
 
   uint32_t c = info[0]->Uint32Value();
-  ctx->strokePaint.setStrokeCap((SkPaint::Cap)c);
+  ctx->state->strokePaint.setStrokeCap((SkPaint::Cap)c);
 }
 
 void Context2D::SetLineJoin(const Nan::FunctionCallbackInfo<Value>& info) {
   Context2D *ctx = ObjectWrap::Unwrap<Context2D>(info.This());
 
   uint32_t j = info[0]->Uint32Value();
-  ctx->strokePaint.setStrokeJoin((SkPaint::Join)j);
+  ctx->state->strokePaint.setStrokeJoin((SkPaint::Join)j);
 }
 
 void Context2D::GetMiterLimit(const Nan::FunctionCallbackInfo<Value>& info) {
@@ -1347,7 +2477,7 @@ void Context2D::SetMiterLimit(const Nan::FunctionCallbackInfo<Value>& info) {
 
   SkScalar limit = SkDoubleToScalar(info[0]->NumberValue());
 
-  ctx->strokePaint.setStrokeMiter(limit);
+  ctx->state->strokePaint.setStrokeMiter(limit);
 }
 
 void Context2D::SetLineDash(const Nan::FunctionCallbackInfo<Value>& info) {
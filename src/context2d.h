@@ -17,40 +17,167 @@
 #include <SkData.h>
 #include <SkImageEncoder.h>
 #include <SkMatrix44.h>
+#include <SkPicture.h>
+#include <SkDeque.h>
+#include <SkPixelRef.h>
 
 using namespace node;
 using namespace v8;
 
 
 
+// Drawing state that save()/restore() snapshot alongside the canvas
+// matrix and clip. Copying one only bumps the refcounts held by the paints.
+struct ContextState {
+  SkPaint paint, shadowPaint, strokePaint;
+  SkXfermode::Mode globalCompositeOperation;
+  SkScalar shadowX, shadowY, shadowBlur;
+  SkPaint::FontMetrics fontMetrics;
+  uint8_t globalAlpha;
+  uint8_t textBaseline;
+  bool defaultLineWidth;
+};
+
 class Context2D : public Nan::ObjectWrap {
 
   public:
+    // opcodes understood by submit(), each followed by a fixed number of
+    // double arguments (see kCommandArity in context2d.cc). Keep in sync
+    // with lib/commands.js
+    enum Command {
+      kBeginPath_Command = 1,
+      kClosePath_Command,
+      kMoveTo_Command,
+      kLineTo_Command,
+      kQuadraticCurveTo_Command,
+      kBezierCurveTo_Command,
+      kArcTo_Command,
+      kRect_Command,
+      kArc_Command,
+      kFill_Command,
+      kStroke_Command,
+      kClip_Command,
+      kFillRect_Command,
+      kStrokeRect_Command,
+      kClearRect_Command,
+      kScale_Command,
+      kRotate_Command,
+      kTranslate_Command,
+      kTransform_Command,
+      kSetTransform_Command,
+      kResetMatrix_Command,
+      kSave_Command,
+      kRestore_Command,
+
+      kCommandCount
+    };
+
     static void Init(v8::Handle<v8::Object> exports);
+    static bool HasInstance(v8::Local<v8::Value> value);
     void resizeCanvas(uint32_t width, uint32_t height);
     void *getTextureData();
+
+    // drawing primitives shared by the NAN_METHODs and submit()
+    void beginPath();
+    void closePath();
+    void moveTo(SkScalar x, SkScalar y);
+    void lineTo(SkScalar x, SkScalar y);
+    void quadraticCurveTo(SkScalar cpx, SkScalar cpy, SkScalar x, SkScalar y);
+    void bezierCurveTo(SkScalar x1, SkScalar y1,
+                       SkScalar x2, SkScalar y2,
+                       SkScalar x3, SkScalar y3);
+    void arcTo(SkScalar x1, SkScalar y1, SkScalar x2, SkScalar y2, SkScalar r);
+    void rect(SkScalar x, SkScalar y, SkScalar w, SkScalar h);
+    void arc(SkScalar x, SkScalar y, SkScalar r,
+             SkScalar sa, SkScalar ea, bool ccw);
+    void fill();
+    void stroke();
+    void clip();
+    void fillRect(SkScalar x, SkScalar y, SkScalar w, SkScalar h);
+    void strokeRect(SkScalar x, SkScalar y, SkScalar w, SkScalar h);
+    void clearRect(SkScalar x, SkScalar y, SkScalar w, SkScalar h);
+    void transform(SkScalar a, SkScalar b, SkScalar c,
+                   SkScalar d, SkScalar e, SkScalar f);
+    void drawImage(const SkBitmap &src, const SkRect &srcRect, const SkRect &destRect);
+    void drawPicture(SkPicture &picture, const SkMatrix &matrix);
+    void save();
+    bool restore();
+
+    // raster backing, recycled through SurfacePool
+    void createSurface(uint32_t w, uint32_t h);
+    void releaseSurface();
+
+    // true while a buffer from toBuffer({ copy: false }) aliases the pixels
+    bool pixelsShared();
+    // call before drawing through canvas, detaches shared pixels unless
+    // canvas is recording
+    void aboutToDraw();
+    // call before writing to the surface pixels directly
+    void aboutToWritePixels();
+    // ends a lockPixels() view, a no-op when nothing is locked
+    void unlockPixels();
+    // the current frame as a bitmap later draws leave alone, sharing the
+    // pixels copy on write like toBuffer({ copy: false })
+    bool snapshot(SkBitmap *out);
+
+    // Points canvas at a new SkPicture until endRecording(), which hands
+    // the picture back with a ref for the caller and puts the surface
+    // canvas back. Whatever save()s the recording left open are restored.
+    void beginRecording();
+    SkPicture *endRecording();
+
     SkBitmap bitmap;
     SkCanvas *canvas;
     SkDevice *device;
     SkPath path, subpath;
-    SkPaint paint, shadowPaint, strokePaint;
-    SkXfermode::Mode globalCompositeOperation;
-    SkScalar shadowX, shadowY, shadowBlur;
-    uint8_t globalAlpha;
-    bool defaultLineWidth;
+
+    // top of stateStack, kept in step with the canvas save stack
+    ContextState *state;
+    SkDeque stateStack;
+
+    // pinned by lockPixels(), NULL when unlocked
+    SkPixelRef *lockedPixels;
+    Nan::Persistent<Uint8ClampedArray> lockedPixelsView;
+
+    // between beginRecording() and endRecording() canvas is the
+    // recording's and surfaceCanvas the one drawing into bitmap.
+    // restore() stops at recordingDepth, the state stack depth the
+    // recording started at.
+    SkPicture *recording;
+    SkCanvas *surfaceCanvas;
+    int recordingDepth;
   private:
     Context2D(uint32_t w, uint32_t h);
     ~Context2D();
     bool setupShadow(SkPaint *paint);
 
-    static Persistent<Function> constructor;
+    static Nan::Persistent<Function> constructor;
+    static Nan::Persistent<FunctionTemplate> constructorTemplate;
     static NAN_METHOD(New);
     static NAN_METHOD(ToPngBuffer);
+    static NAN_METHOD(ToPngBufferAsync);
+    static NAN_METHOD(ToJpegBuffer);
+    static NAN_METHOD(ToJpegBufferAsync);
+    static NAN_METHOD(ToWebpBuffer);
+    static NAN_METHOD(ToWebpBufferAsync);
+    static NAN_METHOD(WritePngToFd);
+    static NAN_METHOD(WritePngToFdAsync);
+    static NAN_METHOD(CreatePngEncoder);
     static NAN_METHOD(ToBuffer);
     static NAN_METHOD(GetPixel);
+    static NAN_METHOD(GetPixels);
     static NAN_METHOD(Resize);
     static NAN_METHOD(DumpState);
     static NAN_METHOD(AddFont);
+    static NAN_METHOD(Submit);
+    static NAN_METHOD(Release);
+    static NAN_METHOD(LockPixels);
+    static NAN_METHOD(UnlockPixels);
+
+    // surface pool
+    static NAN_METHOD(Acquire);
+    static NAN_METHOD(ConfigurePool);
+    static NAN_METHOD(PoolStats);
 
     // state
     static NAN_METHOD(Save); // push state on state stack
@@ -119,6 +246,14 @@ class Context2D : public Nan::ObjectWrap {
 
     // drawing images
     static NAN_METHOD(DrawImageBuffer);
+    static NAN_METHOD(DrawImageBitmap);
+    static NAN_METHOD(DrawRegionImage);
+    static NAN_METHOD(DrawContext);
+
+    // recording
+    static NAN_METHOD(BeginRecording);
+    static NAN_METHOD(EndRecording);
+    static NAN_METHOD(DrawPicture);
 
     // pixel manipulation
     static NAN_METHOD(CreateImageData);
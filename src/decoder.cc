@@ -0,0 +1,294 @@
+#include <node.h>
+#include <node_buffer.h>
+#include <nan.h>
+
+#include "decoder.h"
+#include "imagebitmap.h"
+#include "pixelops.h"
+
+#include <SkCanvas.h>
+#include <SkPaint.h>
+
+using namespace node;
+using namespace v8;
+
+bool HasDecoder(SkImageDecoder::Format format) {
+  switch (format) {
+    case SkImageDecoder::kPNG_Format:
+      return true;
+#ifdef CONTEXT2D_JPEG
+    case SkImageDecoder::kJPEG_Format:
+      return true;
+#endif
+#ifdef CONTEXT2D_WEBP
+    case SkImageDecoder::kWEBP_Format:
+      return true;
+#endif
+#ifdef CONTEXT2D_GIF
+    case SkImageDecoder::kGIF_Format:
+      return true;
+#endif
+    default:
+      return false;
+  }
+}
+
+// The decoders are created by name rather than through
+// SkImageDecoder::Factory, which only finds the ones whose registration
+// the linker happened to keep. Referencing them here keeps them and their
+// format sniffers.
+SkImageDecoder *CreateDecoder(SkStream *stream) {
+  switch (SkImageDecoder::GetStreamFormat(stream)) {
+    case SkImageDecoder::kPNG_Format:
+      return CreatePNGImageDecoder();
+#ifdef CONTEXT2D_JPEG
+    case SkImageDecoder::kJPEG_Format:
+      return CreateJPEGImageDecoder();
+#endif
+#ifdef CONTEXT2D_WEBP
+    case SkImageDecoder::kWEBP_Format:
+      return CreateWEBPImageDecoder();
+#endif
+#ifdef CONTEXT2D_GIF
+    case SkImageDecoder::kGIF_Format:
+      return CreateGIFImageDecoder();
+#endif
+    default:
+      return NULL;
+  }
+}
+
+bool ParseDecodeOptions(Local<Value> value, DecodeOptions *options) {
+  if (value->IsUndefined() || value->IsNull()) {
+    return true;
+  }
+
+  if (!value->IsObject()) {
+    Nan::ThrowTypeError("decode options need to be an object");
+    return false;
+  }
+
+  Local<Object> obj = value->ToObject();
+  Local<Value> width = obj->Get(Nan::New("width").ToLocalChecked());
+  Local<Value> height = obj->Get(Nan::New("height").ToLocalChecked());
+  Local<Value> sampleSize = obj->Get(Nan::New("sampleSize").ToLocalChecked());
+
+  if (!width->IsUndefined()) {
+    options->width = width->Int32Value();
+    if (!width->IsNumber() || options->width < 0) {
+      Nan::ThrowRangeError("decode width needs to be 0 or more");
+      return false;
+    }
+  }
+
+  if (!height->IsUndefined()) {
+    options->height = height->Int32Value();
+    if (!height->IsNumber() || options->height < 0) {
+      Nan::ThrowRangeError("decode height needs to be 0 or more");
+      return false;
+    }
+  }
+
+  if (!sampleSize->IsUndefined()) {
+    options->sampleSize = sampleSize->Int32Value();
+    if (!sampleSize->IsNumber() || options->sampleSize < 1) {
+      Nan::ThrowRangeError("decode sampleSize needs to be 1 or more");
+      return false;
+    }
+  }
+
+  return true;
+}
+
+int ChooseSampleSize(int width, int height, const DecodeOptions &options) {
+  if (options.sampleSize > 0) {
+    return options.sampleSize;
+  }
+
+  if (!options.width && !options.height) {
+    return 1;
+  }
+
+  // SkScaledBitmapSampler rounds the sampled size down
+  int sampleSize = 1;
+  while (width / (sampleSize * 2) >= SkMax32(options.width, 1) &&
+         height / (sampleSize * 2) >= SkMax32(options.height, 1)) {
+    sampleSize *= 2;
+  }
+
+  return sampleSize;
+}
+
+bool DecodeImage(const void *data, size_t length, const DecodeOptions &options,
+                 SkBitmap *bitmap, const char **error)
+{
+  SkMemoryStream stream(data, length);
+  SkAutoTDelete<SkImageDecoder> decoder(CreateDecoder(&stream));
+  if (!decoder.get()) {
+    *error = "unsupported image format";
+    return false;
+  }
+
+  SkBitmap decoded;
+  if (options.width || options.height) {
+    // the header is enough to pick the sample size
+    if (!decoder->decode(&stream, &decoded, SkBitmap::kARGB_8888_Config,
+                         SkImageDecoder::kDecodeBounds_Mode) || !stream.rewind()) {
+      *error = "could not decode image";
+      return false;
+    }
+  }
+
+  decoder->setSampleSize(ChooseSampleSize(decoded.width(), decoded.height(), options));
+
+  if (!decoder->decode(&stream, &decoded, SkBitmap::kARGB_8888_Config,
+                       SkImageDecoder::kDecodePixels_Mode)) {
+    *error = "could not decode image";
+    return false;
+  }
+
+  // palette images (GIF) come out as Index8 whatever the preference
+  if (decoded.config() != SkBitmap::kARGB_8888_Config) {
+    SkBitmap converted;
+    if (!decoded.copyTo(&converted, SkBitmap::kARGB_8888_Config)) {
+      *error = "could not allocate image bitmap";
+      return false;
+    }
+    decoded.swap(converted);
+  }
+
+  decoded.setImmutable();
+  bitmap->swap(decoded);
+  return true;
+}
+
+// Lets a decoder write straight into a target when it produces pixels
+// that fit, anything else (Index8) gets its own memory
+class TargetAllocator : public SkBitmap::Allocator {
+  public:
+    TargetAllocator(const SkBitmapFactory::Target *target) : target(target) {}
+
+    virtual bool allocPixelRef(SkBitmap *bitmap, SkColorTable *table) SK_OVERRIDE {
+      if (table || bitmap->config() != SkBitmap::kARGB_8888_Config) {
+        return bitmap->allocPixels(NULL, table);
+      }
+
+      bitmap->setConfig(SkBitmap::kARGB_8888_Config, bitmap->width(), bitmap->height(),
+                        this->target->fRowBytes);
+      bitmap->setPixels(this->target->fAddr);
+      return true;
+    }
+
+  private:
+    const SkBitmapFactory::Target *target;
+};
+
+bool DecodeToTarget(const void *data, size_t length, SkImage::Info *info,
+                    const SkBitmapFactory::Target *target)
+{
+  SkMemoryStream stream(data, length);
+  SkAutoTDelete<SkImageDecoder> decoder(CreateDecoder(&stream));
+  if (!decoder.get()) {
+    return false;
+  }
+
+  SkBitmap decoded;
+  if (!target) {
+    if (!decoder->decode(&stream, &decoded, SkBitmap::kARGB_8888_Config,
+                         SkImageDecoder::kDecodeBounds_Mode)) {
+      return false;
+    }
+
+    info->fWidth = decoded.width();
+    info->fHeight = decoded.height();
+    info->fColorType = SkImage::kPMColor_ColorType;
+    info->fAlphaType = SkImage::kPremul_AlphaType;
+    return true;
+  }
+
+  SkAutoTUnref<TargetAllocator> allocator(SkNEW_ARGS(TargetAllocator, (target)));
+  decoder->setAllocator(allocator);
+  bool ok = decoder->decode(&stream, &decoded, SkBitmap::kARGB_8888_Config,
+                            SkImageDecoder::kDecodePixels_Mode);
+  decoder->setAllocator(NULL);
+
+  if (!ok || decoded.width() != info->fWidth || decoded.height() != info->fHeight) {
+    return false;
+  }
+
+  SkAutoLockPixels lock(decoded);
+  if (decoded.getPixels() != target->fAddr) {
+    SkBitmap dst;
+    dst.setConfig(SkBitmap::kARGB_8888_Config, info->fWidth, info->fHeight, target->fRowBytes);
+    dst.setPixels(target->fAddr);
+
+    SkCanvas canvas(dst);
+    SkPaint paint;
+    paint.setXfermodeMode(SkXfermode::kSrc_Mode);
+    canvas.drawBitmap(decoded, 0, 0, &paint);
+  }
+
+  return true;
+}
+
+DecodeWorker::DecodeWorker(Nan::Callback *callback, Local<Object> buffer,
+                           const uint8_t *data, size_t length,
+                           const DecodeOptions &options)
+  : Nan::AsyncWorker(callback),
+    data(data),
+    length(length),
+    options(options)
+{
+  this->SaveToPersistent("buffer", buffer);
+}
+
+void DecodeWorker::Execute() {
+  const char *error;
+  if (!DecodeImage(this->data, this->length, this->options, &this->bitmap, &error)) {
+    this->SetErrorMessage(error);
+  }
+}
+
+void DecodeWorker::HandleOKCallback() {
+  Nan::HandleScope scope;
+
+  Local<Value> image = ImageBitmap::NewInstance(this->bitmap);
+  this->bitmap.reset();
+
+  Local<Value> argv[] = { Nan::Null(), image };
+  this->callback->Call(2, argv);
+}
+
+// decodeImage(buffer, options, fn): decodes a PNG, JPEG, WebP or GIF off
+// the main thread and calls back with (err, imageBitmap). GIFs give their
+// first frame. See ParseDecodeOptions for the options.
+static NAN_METHOD(DecodeImageAsync) {
+  uint8_t *data;
+  size_t length;
+  if (!GetPixelData(info[0], &data, &length)) {
+    return Nan::ThrowTypeError("First argument needs to be a Buffer or a typed array");
+  }
+
+  DecodeOptions options;
+  if (!ParseDecodeOptions(info[1], &options)) {
+    return;
+  }
+
+  if (!info[2]->IsFunction()) {
+    return Nan::ThrowTypeError("Third argument needs to be a function");
+  }
+
+  Nan::Callback *callback = new Nan::Callback(info[2].As<Function>());
+  Nan::AsyncQueueWorker(new DecodeWorker(callback, info[0]->ToObject(), data, length, options));
+}
+
+void InitDecoder(Handle<Object> exports) {
+  Nan::SetMethod(exports, "decodeImage", DecodeImageAsync);
+
+  Local<Object> decoders = Nan::New<Object>();
+  decoders->Set(Nan::New("png").ToLocalChecked(), Nan::New(HasDecoder(SkImageDecoder::kPNG_Format)));
+  decoders->Set(Nan::New("jpeg").ToLocalChecked(), Nan::New(HasDecoder(SkImageDecoder::kJPEG_Format)));
+  decoders->Set(Nan::New("webp").ToLocalChecked(), Nan::New(HasDecoder(SkImageDecoder::kWEBP_Format)));
+  decoders->Set(Nan::New("gif").ToLocalChecked(), Nan::New(HasDecoder(SkImageDecoder::kGIF_Format)));
+  exports->Set(Nan::New("decoders").ToLocalChecked(), decoders);
+}
@@ -0,0 +1,81 @@
+#ifndef _DECODER_H_
+#define _DECODER_H_
+
+#include <node.h>
+#include <nan.h>
+#include <SkBitmap.h>
+#include <SkBitmapFactory.h>
+#include <SkImageDecoder.h>
+#include <SkStream.h>
+
+using namespace node;
+using namespace v8;
+
+// PNG is always there. JPEG, WebP and GIF need the build to be configured
+// with -Dwith_jpeg=1 / -Dwith_webp=1 / -Dwith_gif=1, which link the system
+// libjpeg / libwebp / giflib.
+bool HasDecoder(SkImageDecoder::Format format);
+
+// A decoder for the image in stream, which is left rewound. NULL when the
+// format is unknown or its decoder is not compiled in.
+SkImageDecoder *CreateDecoder(SkStream *stream);
+
+// How much of an image to decode. Images drawn far smaller than they are
+// can skip most of their pixels: the decoder reads every sampleSize-th
+// pixel and row (JPEG scales in the DCT), which cuts both the decode time
+// and the memory to hold the result.
+struct DecodeOptions {
+  DecodeOptions() : width(0), height(0), sampleSize(0) {}
+
+  int width;        // size the result needs to cover, 0 when unconstrained
+  int height;
+  int sampleSize;   // fixed sample size, 0 picks one from width and height
+};
+
+// Fills in options from a JS object:
+//
+//   { width: n, height: n } or { sampleSize: n }
+//
+// Undefined decodes at full size. Throws and returns false on anything
+// else.
+bool ParseDecodeOptions(Local<Value> value, DecodeOptions *options);
+
+// The largest power of two sample size that still leaves an image of
+// width x height at least as large as options asks for
+int ChooseSampleSize(int width, int height, const DecodeOptions &options);
+
+// Decodes the image in data into bitmap as premultiplied, immutable
+// ARGB_8888 pixels, ready for drawImage. Safe to call off the main thread.
+// On failure error points at a message and bitmap is left untouched.
+bool DecodeImage(const void *data, size_t length, const DecodeOptions &options,
+                 SkBitmap *bitmap, const char **error);
+
+// SkBitmapFactory::DecodeProc for lazily decoded images (see imagecache.h).
+// Without a target it only reads the size, with one it decodes the image
+// into it as premultiplied ARGB_8888.
+bool DecodeToTarget(const void *data, size_t length, SkImage::Info *info,
+                    const SkBitmapFactory::Target *target);
+
+// Decodes a Buffer on the libuv threadpool and calls back with
+// (err, imageBitmap). The buffer is kept alive until then and must not be
+// written to meanwhile.
+class DecodeWorker : public Nan::AsyncWorker {
+  public:
+    DecodeWorker(Nan::Callback *callback, Local<Object> buffer,
+                 const uint8_t *data, size_t length, const DecodeOptions &options);
+
+    virtual void Execute();
+    virtual void HandleOKCallback();
+
+  private:
+    const uint8_t *data;
+    size_t length;
+    DecodeOptions options;
+    SkBitmap bitmap;
+};
+
+// exposes decodeImage() and decoders, which lists the available formats,
+// on the binding
+void InitDecoder(Handle<Object> exports);
+
+#endif
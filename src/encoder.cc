@@ -0,0 +1,536 @@
+#include <node.h>
+#include <node_buffer.h>
+#include <nan.h>
+
+#include "encoder.h"
+#include "pixelops.h"
+#include "pngparallel.h"
+
+#include <SkColorPriv.h>
+#include <SkTemplates.h>
+
+#include <png.h>
+#include <zlib.h>
+#include <string.h>
+#include <uv.h>
+
+struct NamedValue {
+  const char *name;
+  int value;
+};
+
+static const NamedValue kStrategies[] = {
+  { "default", Z_DEFAULT_STRATEGY },
+  { "filtered", Z_FILTERED },
+  { "huffman", Z_HUFFMAN_ONLY },
+  { "rle", Z_RLE },
+  { "fixed", Z_FIXED },
+  { NULL, 0 }
+};
+
+static const NamedValue kFilters[] = {
+  { "none", PNG_FILTER_NONE },
+  { "sub", PNG_FILTER_SUB },
+  { "up", PNG_FILTER_UP },
+  { "average", PNG_FILTER_AVG },
+  { "paeth", PNG_FILTER_PAETH },
+  { "all", PNG_ALL_FILTERS },
+  { NULL, 0 }
+};
+
+static bool lookup(const NamedValue *table, Local<Value> name, int *value) {
+  if (!name->IsString()) {
+    return false;
+  }
+
+  Nan::Utf8String str(name);
+  for (; table->name; table++) {
+    if (!strcmp(table->name, *str)) {
+      *value = table->value;
+      return true;
+    }
+  }
+  return false;
+}
+
+static bool parseFilters(Local<Value> value, int *filters) {
+  if (!value->IsArray()) {
+    return lookup(kFilters, value, filters);
+  }
+
+  Local<Array> list = value.As<Array>();
+  if (!list->Length()) {
+    return false;
+  }
+
+  *filters = 0;
+  for (uint32_t i = 0; i<list->Length(); i++) {
+    int filter;
+    if (!lookup(kFilters, list->Get(i), &filter)) {
+      return false;
+    }
+    *filters |= filter;
+  }
+  return true;
+}
+
+bool ParsePngOptions(Local<Value> value, PngOptions *options) {
+  if (value->IsUndefined() || value->IsNull()) {
+    return true;
+  }
+
+  if (!value->IsObject()) {
+    Nan::ThrowTypeError("png options need to be an object");
+    return false;
+  }
+
+  Local<Object> obj = value->ToObject();
+  Local<Value> preset = obj->Get(Nan::New("preset").ToLocalChecked());
+  Local<Value> level = obj->Get(Nan::New("level").ToLocalChecked());
+  Local<Value> strategy = obj->Get(Nan::New("strategy").ToLocalChecked());
+  Local<Value> filters = obj->Get(Nan::New("filters").ToLocalChecked());
+  Local<Value> threads = obj->Get(Nan::New("threads").ToLocalChecked());
+  Local<Value> dropAlpha = obj->Get(Nan::New("dropAlpha").ToLocalChecked());
+
+  if (!preset->IsUndefined()) {
+    Nan::Utf8String name(preset);
+    if (!strcmp(*name, "fastest")) {
+      // previews: barely filtered, run length matches only
+      options->level = 1;
+      options->strategy = Z_RLE;
+      options->filters = PNG_FILTER_SUB;
+    } else if (!strcmp(*name, "smallest")) {
+      // cached assets: every filter, full effort, no dead alpha bytes
+      options->level = 9;
+      options->strategy = Z_DEFAULT_STRATEGY;
+      options->filters = PNG_ALL_FILTERS;
+      options->dropAlpha = true;
+    } else if (strcmp(*name, "default")) {
+      Nan::ThrowRangeError("unknown png preset");
+      return false;
+    }
+  }
+
+  if (!level->IsUndefined()) {
+    int32_t l = level->Int32Value();
+    if (!level->IsNumber() || l < 0 || l > 9) {
+      Nan::ThrowRangeError("png level needs to be between 0 and 9");
+      return false;
+    }
+    options->level = l;
+  }
+
+  if (!strategy->IsUndefined() && !lookup(kStrategies, strategy, &options->strategy)) {
+    Nan::ThrowRangeError("unknown png strategy");
+    return false;
+  }
+
+  if (!filters->IsUndefined() && !parseFilters(filters, &options->filters)) {
+    Nan::ThrowRangeError("unknown png filters");
+    return false;
+  }
+
+  if (!threads->IsUndefined()) {
+    int32_t t = threads->Int32Value();
+    if (!threads->IsNumber() || t < 0) {
+      Nan::ThrowRangeError("png threads needs to be 0 or more");
+      return false;
+    }
+    options->threads = t;
+  }
+
+  if (!dropAlpha->IsUndefined()) {
+    options->dropAlpha = dropAlpha->BooleanValue();
+  }
+
+  return true;
+}
+
+static bool isOpaque(const SkBitmap &bitmap) {
+  for (int y = 0; y<bitmap.height(); y++) {
+    const SkPMColor *row = bitmap.getAddr32(0, y);
+    for (int x = 0; x<bitmap.width(); x++) {
+      if (SkGetPackedA32(row[x]) != 0xff) {
+        return false;
+      }
+    }
+  }
+  return true;
+}
+
+static void pngError(png_structp png, png_const_charp message) {
+  longjmp(png_jmpbuf(png), 1);
+}
+
+static void pngWarning(png_structp png, png_const_charp message) {
+}
+
+static void pngWrite(png_structp png, png_bytep data, png_size_t length) {
+  SkWStream *stream = (SkWStream *)png_get_io_ptr(png);
+  if (!stream->write(data, length)) {
+    png_error(png, "write failed");
+  }
+}
+
+static void pngFlush(png_structp png) {
+  ((SkWStream *)png_get_io_ptr(png))->flush();
+}
+
+// A write struct for options writing to stream, NULL on failure. libpng
+// errors longjmp to png_jmpbuf(png), which every caller has to set up.
+static png_structp createPng(SkWStream *stream, const PngOptions &options, png_infop *info) {
+  png_structp png = png_create_write_struct(PNG_LIBPNG_VER_STRING, NULL, pngError, pngWarning);
+  if (!png) {
+    return NULL;
+  }
+
+  *info = png_create_info_struct(png);
+  if (!*info) {
+    png_destroy_write_struct(&png, NULL);
+    return NULL;
+  }
+
+  png_set_write_fn(png, stream, pngWrite, pngFlush);
+
+  if (options.level >= 0) {
+    png_set_compression_level(png, options.level);
+  }
+
+  if (options.strategy >= 0) {
+    png_set_compression_strategy(png, options.strategy);
+  }
+
+  if (options.filters >= 0) {
+    png_set_filter(png, PNG_FILTER_TYPE_BASE, options.filters);
+  }
+
+  return png;
+}
+
+static void writeHeader(png_structp png, png_infop info, const SkBitmap &bitmap, bool alpha) {
+  png_set_IHDR(png, info, bitmap.width(), bitmap.height(), 8,
+               alpha ? PNG_COLOR_TYPE_RGB_ALPHA : PNG_COLOR_TYPE_RGB,
+               PNG_INTERLACE_NONE, PNG_COMPRESSION_TYPE_BASE,
+               PNG_FILTER_TYPE_BASE);
+
+  png_write_info(png, info);
+
+  // rows are always handed over as RGBA, libpng strips the alpha bytes
+  if (!alpha) {
+    png_set_filler(png, 0, PNG_FILLER_AFTER);
+  }
+}
+
+// row is scratch space for one unpremultiplied RGBA row
+static void writeRow(png_structp png, const SkBitmap &bitmap, int y, png_bytep row) {
+  UnpremultiplyRow(row, bitmap.getAddr32(0, y), bitmap.width());
+  png_write_row(png, row);
+}
+
+bool EncodePng(SkWStream *stream, const SkBitmap &bitmap, const PngOptions &options) {
+  if (bitmap.config() != SkBitmap::kARGB_8888_Config) {
+    return false;
+  }
+
+  SkAutoLockPixels lock(bitmap);
+  if (!bitmap.getPixels()) {
+    return false;
+  }
+
+  bool alpha = !(options.dropAlpha && isOpaque(bitmap));
+  if (options.threads != 1) {
+    return EncodePngParallel(stream, bitmap, options, alpha);
+  }
+
+  SkAutoMalloc row(bitmap.width() * 4);
+
+  png_infop info;
+  png_structp png = createPng(stream, options, &info);
+  if (!png) {
+    return false;
+  }
+
+  if (setjmp(png_jmpbuf(png))) {
+    png_destroy_write_struct(&png, &info);
+    return false;
+  }
+
+  writeHeader(png, info, bitmap, alpha);
+
+  for (int y = 0; y<bitmap.height(); y++) {
+    writeRow(png, bitmap, y, (png_bytep)row.get());
+  }
+
+  png_write_end(png, info);
+  png_destroy_write_struct(&png, &info);
+  return true;
+}
+
+bool FdWStream::write(const void *buffer, size_t size) {
+  const char *bytes = (const char *)buffer;
+  while (size) {
+    uv_fs_t req;
+    uv_buf_t buf = uv_buf_init((char *)bytes, (unsigned int)size);
+    int result = uv_fs_write(uv_default_loop(), &req, this->fd, &buf, 1, -1, NULL);
+    uv_fs_req_cleanup(&req);
+
+    if (result <= 0) {
+      return false;
+    }
+
+    bytes += result;
+    size -= result;
+    this->written += result;
+  }
+  return true;
+}
+
+bool HasEncoder(SkImageEncoder::Type type) {
+  switch (type) {
+    case SkImageEncoder::kPNG_Type:
+      return true;
+#ifdef CONTEXT2D_JPEG
+    case SkImageEncoder::kJPEG_Type:
+      return true;
+#endif
+#ifdef CONTEXT2D_WEBP
+    case SkImageEncoder::kWEBP_Type:
+      return true;
+#endif
+    default:
+      return false;
+  }
+}
+
+bool EncodeImage(SkWStream *stream, const SkBitmap &bitmap, const EncodeOptions &options) {
+  if (options.type == SkImageEncoder::kPNG_Type) {
+    return EncodePng(stream, bitmap, options.png);
+  }
+
+  // straight to the codec, the encoder registry is not linked in
+  SkAutoTDelete<SkImageEncoder> encoder(NULL);
+  switch (options.type) {
+#ifdef CONTEXT2D_JPEG
+    case SkImageEncoder::kJPEG_Type:
+      encoder.reset(CreateJPEGImageEncoder());
+      break;
+#endif
+#ifdef CONTEXT2D_WEBP
+    case SkImageEncoder::kWEBP_Type:
+      encoder.reset(CreateWEBPImageEncoder());
+      break;
+#endif
+    default:
+      return false;
+  }
+
+  return encoder->encodeStream(stream, bitmap, options.quality);
+}
+
+SkData *EncodeImage(const SkBitmap &bitmap, const EncodeOptions &options) {
+  SkDynamicMemoryWStream stream;
+  if (!EncodeImage(&stream, bitmap, options)) {
+    return NULL;
+  }
+  return stream.copyToData();
+}
+
+static void releaseData(char *bytes, void *hint) {
+  ((SkData *)hint)->unref();
+}
+
+Local<Object> NewBufferFromData(SkData *data) {
+  return Nan::NewBuffer(
+    (char *)data->data(),
+    data->size(),
+    releaseData,
+    data
+  ).ToLocalChecked();
+}
+
+EncodeWorker::EncodeWorker(Nan::Callback *callback,
+                           const SkBitmap &bitmap,
+                           const EncodeOptions &options,
+                           int fd)
+  : Nan::AsyncWorker(callback),
+    bitmap(bitmap),
+    options(options),
+    data(NULL),
+    fd(fd),
+    written(0)
+{
+}
+
+EncodeWorker::~EncodeWorker() {
+  // not handed out when the callback never ran
+  SkSafeUnref(this->data);
+}
+
+void EncodeWorker::Execute() {
+  if (this->fd >= 0) {
+    FdWStream stream(this->fd);
+    if (!EncodeImage(&stream, this->bitmap, this->options)) {
+      this->SetErrorMessage("could not write image");
+    }
+    this->written = stream.bytesWritten();
+    return;
+  }
+
+  this->data = EncodeImage(this->bitmap, this->options);
+  if (!this->data) {
+    this->SetErrorMessage("could not encode image");
+  }
+}
+
+void EncodeWorker::HandleOKCallback() {
+  Nan::HandleScope scope;
+
+  // drop the pixels before calling out, a draw from the callback would
+  // otherwise still see them as shared and copy the surface
+  this->bitmap.reset();
+
+  Local<Value> result;
+  if (this->fd >= 0) {
+    result = Nan::New((double)this->written);
+  } else {
+    result = NewBufferFromData(this->data);
+    this->data = NULL;
+  }
+
+  Local<Value> argv[] = { Nan::Null(), result };
+  this->callback->Call(2, argv);
+}
+
+// raw bytes a single PngEncoder::read() goes through at most, bounds how
+// long it runs when the image compresses too well to produce any output
+static const size_t kPngReadBudget = 256 * 1024;
+
+Nan::Persistent<Function> PngEncoder::constructor;
+
+void PngEncoder::Init() {
+  Local<FunctionTemplate> tpl = Nan::New<FunctionTemplate>(New);
+  tpl->SetClassName(Nan::New("PngEncoder").ToLocalChecked());
+  tpl->InstanceTemplate()->SetInternalFieldCount(1);
+
+  Nan::SetPrototypeMethod(tpl, "read", Read);
+  Nan::SetPrototypeMethod(tpl, "close", Close);
+
+  constructor.Reset(tpl->GetFunction());
+}
+
+Local<Value> PngEncoder::NewInstance(const SkBitmap &bitmap, const PngOptions &options) {
+  Nan::EscapableHandleScope scope;
+
+  Local<Object> obj = Nan::NewInstance(Nan::New(constructor)).ToLocalChecked();
+  PngEncoder *encoder = Nan::ObjectWrap::Unwrap<PngEncoder>(obj);
+
+  if (!encoder->begin(bitmap, options)) {
+    Nan::ThrowError("could not encode image");
+    return Local<Value>();
+  }
+
+  return scope.Escape(obj);
+}
+
+PngEncoder::~PngEncoder() {
+  this->finish();
+}
+
+// writes the header, the first read() returns it
+bool PngEncoder::begin(const SkBitmap &bitmap, const PngOptions &options) {
+  if (bitmap.config() != SkBitmap::kARGB_8888_Config) {
+    return false;
+  }
+
+  this->bitmap = bitmap;
+  this->bitmap.lockPixels();
+  if (!this->bitmap.getPixels()) {
+    this->finish();
+    return false;
+  }
+
+  bool alpha = !(options.dropAlpha && isOpaque(this->bitmap));
+  this->row.reset(this->bitmap.width() * 4);
+
+  this->png = createPng(&this->output, options, &this->info);
+  if (!this->png) {
+    this->finish();
+    return false;
+  }
+
+  if (setjmp(png_jmpbuf(this->png))) {
+    this->finish();
+    return false;
+  }
+
+  writeHeader(this->png, this->info, this->bitmap, alpha);
+  return true;
+}
+
+void PngEncoder::finish() {
+  if (this->png) {
+    png_destroy_write_struct(&this->png, &this->info);
+    this->png = NULL;
+    this->info = NULL;
+  }
+
+  this->bitmap.reset();
+  this->row.free();
+}
+
+void PngEncoder::New(const Nan::FunctionCallbackInfo<Value>& info) {
+  PngEncoder *encoder = new PngEncoder();
+  encoder->Wrap(info.This());
+  info.GetReturnValue().Set(info.This());
+}
+
+void PngEncoder::Read(const Nan::FunctionCallbackInfo<Value>& info) {
+  PngEncoder *encoder = Nan::ObjectWrap::Unwrap<PngEncoder>(info.This());
+
+  if (encoder->png) {
+    if (setjmp(png_jmpbuf(encoder->png))) {
+      encoder->finish();
+      return Nan::ThrowError("could not encode image");
+    }
+
+    int height = encoder->bitmap.height();
+    size_t rowBytes = encoder->bitmap.width() * 4;
+    size_t budget = 0;
+
+    while (encoder->y < height &&
+           !encoder->output.bytesWritten() &&
+           budget < kPngReadBudget)
+    {
+      writeRow(encoder->png, encoder->bitmap, encoder->y++, (png_bytep)encoder->row.get());
+      budget += rowBytes;
+    }
+
+    if (encoder->y == height) {
+      png_write_end(encoder->png, encoder->info);
+      encoder->finish();
+    }
+  } else if (!encoder->output.bytesWritten()) {
+    info.GetReturnValue().SetNull();
+    return;
+  }
+
+  SkData *data = encoder->output.copyToData();
+  encoder->output.reset();
+  info.GetReturnValue().Set(NewBufferFromData(data));
+}
+
+void PngEncoder::Close(const Nan::FunctionCallbackInfo<Value>& info) {
+  PngEncoder *encoder = Nan::ObjectWrap::Unwrap<PngEncoder>(info.This());
+  encoder->finish();
+  encoder->output.reset();
+}
+
+void InitEncoder(Handle<Object> exports) {
+  PngEncoder::Init();
+
+  Local<Object> encoders = Nan::New<Object>();
+  encoders->Set(Nan::New("png").ToLocalChecked(), Nan::New(HasEncoder(SkImageEncoder::kPNG_Type)));
+  encoders->Set(Nan::New("jpeg").ToLocalChecked(), Nan::New(HasEncoder(SkImageEncoder::kJPEG_Type)));
+  encoders->Set(Nan::New("webp").ToLocalChecked(), Nan::New(HasEncoder(SkImageEncoder::kWEBP_Type)));
+  exports->Set(Nan::New("encoders").ToLocalChecked(), encoders);
+}
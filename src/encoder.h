@@ -0,0 +1,146 @@
+#ifndef _ENCODER_H_
+#define _ENCODER_H_
+
+#include <node.h>
+#include <nan.h>
+#include <SkBitmap.h>
+#include <SkData.h>
+#include <SkImageEncoder.h>
+#include <SkStream.h>
+
+#include <png.h>
+
+using namespace node;
+using namespace v8;
+
+// How EncodePng trades size for speed. -1 leaves a setting at the libpng
+// default, which is what a default constructed PngOptions does throughout.
+struct PngOptions {
+  PngOptions() : level(-1), strategy(-1), filters(-1), threads(1), dropAlpha(false) {}
+
+  int level;        // zlib level, 0 (store) to 9 (smallest)
+  int strategy;     // Z_DEFAULT_STRATEGY, Z_FILTERED, Z_HUFFMAN_ONLY, Z_RLE or Z_FIXED
+  int filters;      // PNG_FILTER_* flags libpng picks from for each row
+  int threads;      // strips encoded in parallel, 0 for one per core (see pngparallel.h)
+  bool dropAlpha;   // write RGB instead of RGBA when every pixel is opaque
+};
+
+// Fills in options from a JS object:
+//
+//   { preset: 'fastest' | 'smallest',
+//     level: 0..9,
+//     strategy: 'default' | 'filtered' | 'huffman' | 'rle' | 'fixed',
+//     filters: 'none' | 'sub' | 'up' | 'average' | 'paeth' | 'all' | [...],
+//     threads: 0..n,
+//     dropAlpha: bool }
+//
+// The preset is applied first, the other keys override it. Undefined is
+// the defaults. Throws and returns false on anything it does not know.
+bool ParsePngOptions(Local<Value> value, PngOptions *options);
+
+// Writes bitmap to stream as a PNG. Safe to call off the main thread as
+// long as nothing writes to the pixels meanwhile. Blocks until all strips
+// are done when options.threads is not 1.
+bool EncodePng(SkWStream *stream, const SkBitmap &bitmap, const PngOptions &options);
+
+// What EncodeImage produces. quality only applies to JPEG and WebP.
+struct EncodeOptions {
+  EncodeOptions()
+    : type(SkImageEncoder::kPNG_Type), quality(SkImageEncoder::kDefaultQuality) {}
+
+  SkImageEncoder::Type type;
+  int quality;      // 0 to 100
+  PngOptions png;
+};
+
+// PNG is always there. JPEG and WebP need the build to be configured with
+// -Dwith_jpeg=1 / -Dwith_webp=1, which link the system libjpeg / libwebp.
+bool HasEncoder(SkImageEncoder::Type type);
+
+// Writes bitmap to stream as options.type. Fails when that encoder is not
+// compiled in.
+bool EncodeImage(SkWStream *stream, const SkBitmap &bitmap, const EncodeOptions &options);
+
+// The encoded image as one block sized to the encoded length, NULL on
+// failure
+SkData *EncodeImage(const SkBitmap &bitmap, const EncodeOptions &options);
+
+// Writes straight to a file descriptor, which is left open. Skia's
+// SkFDStream only reads. Fine off the main thread, the synchronous uv_fs
+// calls do not touch the loop.
+class FdWStream : public SkWStream {
+  public:
+    FdWStream(int fd) : fd(fd), written(0) {}
+
+    virtual bool write(const void *buffer, size_t size) SK_OVERRIDE;
+    size_t bytesWritten() const { return this->written; }
+
+  private:
+    int fd;
+    size_t written;
+};
+
+// A Buffer over the bytes of data, which it takes over the ref of
+Local<Object> NewBufferFromData(SkData *data);
+
+// exposes encoders, which lists the available formats, on the binding
+void InitEncoder(Handle<Object> exports);
+
+// Encodes a bitmap on the libuv threadpool and calls back with
+// (err, buffer), or with (err, bytesWritten) when given a file descriptor
+// to write to. The bitmap should be a snapshot (see Context2D::snapshot),
+// it is only released back on the main thread.
+class EncodeWorker : public Nan::AsyncWorker {
+  public:
+    EncodeWorker(Nan::Callback *callback,
+                 const SkBitmap &bitmap,
+                 const EncodeOptions &options,
+                 int fd = -1);
+    virtual ~EncodeWorker();
+
+    virtual void Execute();
+    virtual void HandleOKCallback();
+
+  private:
+    SkBitmap bitmap;
+    EncodeOptions options;
+    SkData *data;
+    int fd;
+    size_t written;
+};
+
+// An encode in progress for createPNGStream. Each read() encodes rows
+// until libpng hands out compressed bytes or a row budget runs out, so
+// neither the whole file nor the whole encode has to happen at once.
+//
+//   read(): a Buffer, empty when nothing came out yet, or null once the
+//           image is complete
+//   close(): stops early and lets go of the pixels
+class PngEncoder : public Nan::ObjectWrap {
+  public:
+    static void Init();
+
+    // throws and returns an empty handle on failure
+    static Local<Value> NewInstance(const SkBitmap &bitmap, const PngOptions &options);
+
+  private:
+    PngEncoder() : png(NULL), info(NULL), y(0) {}
+    ~PngEncoder();
+
+    bool begin(const SkBitmap &bitmap, const PngOptions &options);
+    void finish();
+
+    static Nan::Persistent<Function> constructor;
+    static NAN_METHOD(New);
+    static NAN_METHOD(Read);
+    static NAN_METHOD(Close);
+
+    SkBitmap bitmap;
+    SkAutoMalloc row;
+    SkDynamicMemoryWStream output;
+    png_structp png;
+    png_infop info;
+    int y;
+};
+
+#endif
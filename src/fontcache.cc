@@ -0,0 +1,170 @@
+#include <node.h>
+#include <nan.h>
+
+#include "fontcache.h"
+
+#include <SkFloatBits.h>
+#include <SkTypefaceCache.h>
+
+using namespace node;
+using namespace v8;
+
+#define DEFAULT_FONT_CACHE_LIMIT 64
+
+FontCacheEntry::FontCacheEntry()
+  : fontID(0), style(SkTypeface::kNormal), size(0), hash(0), typeface(NULL)
+{
+}
+
+FontCacheEntry::~FontCacheEntry() {
+  SkSafeUnref(this->typeface);
+}
+
+// most recently used at the head. Lookups walk the list comparing hashes
+// first; with a handful of fonts in play the hit is almost always the
+// head, which makes repeated ctx.font assignments a pointer swap.
+static SkTInternalLList<FontCacheEntry> fontCacheList;
+
+static struct {
+  double hits, misses, evictions;
+  uint32_t entries, limit;
+} fontCacheCounters = { 0, 0, 0, 0, DEFAULT_FONT_CACHE_LIMIT };
+
+static inline uint32_t hashFont(const char *family, size_t len,
+                                SkFontID id,
+                                SkTypeface::Style style,
+                                SkScalar size)
+{
+  // FNV-1a
+  uint32_t hash = 2166136261u;
+  for (size_t i = 0; i<len; i++) {
+    hash ^= (uint8_t)family[i];
+    hash *= 16777619u;
+  }
+
+  uint32_t bits[3] = { id, (uint32_t)style, (uint32_t)SkFloat2Bits(size) };
+
+  for (size_t i = 0; i<3; i++) {
+    hash ^= bits[i];
+    hash *= 16777619u;
+  }
+  return hash;
+}
+
+static void purgeFontCache(uint32_t limit) {
+  while (fontCacheCounters.entries > limit) {
+    FontCacheEntry *entry = fontCacheList.tail();
+    fontCacheList.remove(entry);
+    SkDELETE(entry);
+    fontCacheCounters.entries--;
+    fontCacheCounters.evictions++;
+  }
+}
+
+const FontCacheEntry *LookupFont(Handle<Value> family,
+                                 SkTypeface::Style style,
+                                 SkScalar size,
+                                 const SkPaint &paint)
+{
+  SkString name;
+  SkFontID id = 0;
+
+  if (family->IsString()) {
+    Nan::Utf8String str(family);
+    name.set(*str, str.length());
+  } else if (family->IsNumber()) {
+    id = family->Uint32Value();
+  } else {
+    return NULL;
+  }
+
+  uint32_t hash = hashFont(name.c_str(), name.size(), id, style, size);
+
+  SkTInternalLList<FontCacheEntry>::Iter iter;
+  FontCacheEntry *entry = iter.init(fontCacheList, SkTInternalLList<FontCacheEntry>::Iter::kHead_IterStart);
+  while (entry) {
+    if (entry->hash == hash &&
+        entry->fontID == id &&
+        entry->style == style &&
+        entry->size == size &&
+        entry->family.equals(name))
+    {
+      fontCacheCounters.hits++;
+      if (fontCacheList.head() != entry) {
+        fontCacheList.remove(entry);
+        fontCacheList.addToHead(entry);
+      }
+      return entry;
+    }
+    entry = iter.next();
+  }
+
+  fontCacheCounters.misses++;
+
+  SkTypeface *face = NULL;
+  if (id) {
+    // FindByID does not ref
+    face = SkTypefaceCache::FindByID(id);
+    SkSafeRef(face);
+  } else {
+    face = SkTypeface::CreateFromName(name.c_str(), style);
+  }
+
+  if (!face) {
+    return NULL;
+  }
+
+  entry = SkNEW(FontCacheEntry);
+  entry->family.swap(name);
+  entry->fontID = id;
+  entry->style = style;
+  entry->size = size;
+  entry->hash = hash;
+  entry->typeface = face;
+
+  SkPaint measure(paint);
+  measure.setTypeface(face);
+  measure.setTextSize(size);
+  measure.getFontMetrics(&entry->metrics);
+
+  fontCacheList.addToHead(entry);
+  fontCacheCounters.entries++;
+
+  // the limit is at least 1, so this never evicts the new entry
+  purgeFontCache(fontCacheCounters.limit);
+
+  return entry;
+}
+
+static NAN_METHOD(FontCacheStats) {
+  Local<Object> stats = Nan::New<Object>();
+  double lookups = fontCacheCounters.hits + fontCacheCounters.misses;
+
+  stats->Set(Nan::New("hits").ToLocalChecked(), Nan::New(fontCacheCounters.hits));
+  stats->Set(Nan::New("misses").ToLocalChecked(), Nan::New(fontCacheCounters.misses));
+  stats->Set(Nan::New("evictions").ToLocalChecked(), Nan::New(fontCacheCounters.evictions));
+  stats->Set(Nan::New("entries").ToLocalChecked(), Nan::New(fontCacheCounters.entries));
+  stats->Set(Nan::New("limit").ToLocalChecked(), Nan::New(fontCacheCounters.limit));
+  stats->Set(
+    Nan::New("hitRate").ToLocalChecked(),
+    Nan::New(lookups ? fontCacheCounters.hits / lookups : 0)
+  );
+
+  info.GetReturnValue().Set(stats);
+}
+
+// setFontCacheLimit(n): number of resolved fonts to keep, purging the
+// least recently used ones immediately when lowered
+static NAN_METHOD(SetFontCacheLimit) {
+  if (!info[0]->IsNumber() || info[0]->NumberValue() < 1) {
+    return Nan::ThrowRangeError("font cache limit must be >= 1");
+  }
+
+  fontCacheCounters.limit = info[0]->Uint32Value();
+  purgeFontCache(fontCacheCounters.limit);
+}
+
+void InitFontCache(Handle<Object> exports) {
+  Nan::SetMethod(exports, "fontCacheStats", FontCacheStats);
+  Nan::SetMethod(exports, "setFontCacheLimit", SetFontCacheLimit);
+}
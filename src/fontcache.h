@@ -0,0 +1,46 @@
+#ifndef _FONTCACHE_H_
+#define _FONTCACHE_H_
+
+#include <node.h>
+#include <nan.h>
+#include <SkPaint.h>
+#include <SkString.h>
+#include <SkTypeface.h>
+#include <SkTInternalLList.h>
+
+using namespace node;
+using namespace v8;
+
+// A resolved font: the typeface for a family/style pair plus the metrics
+// it has at a given size. Owns a ref on the typeface.
+class FontCacheEntry {
+  public:
+    FontCacheEntry();
+    ~FontCacheEntry();
+
+    SkString family;      // empty when the font was registered with addFont()
+    SkFontID fontID;
+    SkTypeface::Style style;
+    SkScalar size;
+    uint32_t hash;
+
+    SkTypeface *typeface;
+    SkPaint::FontMetrics metrics;
+
+  private:
+    SK_DECLARE_INTERNAL_LLIST_INTERFACE(FontCacheEntry);
+};
+
+// Resolves family (a name, or a font id returned by addFont) through a
+// bounded LRU of previously resolved fonts. paint supplies the rendering
+// flags the metrics are measured with on a miss. The entry stays valid
+// until the next lookup. Returns NULL if no typeface could be found.
+const FontCacheEntry *LookupFont(Handle<Value> family,
+                                 SkTypeface::Style style,
+                                 SkScalar size,
+                                 const SkPaint &paint);
+
+// exposes fontCacheStats() and setFontCacheLimit() on the binding
+void InitFontCache(Handle<Object> exports);
+
+#endif
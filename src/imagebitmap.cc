@@ -0,0 +1,100 @@
+#include <node.h>
+#include <nan.h>
+
+#include "imagebitmap.h"
+#include "pixelops.h"
+
+using namespace node;
+using namespace v8;
+
+Nan::Persistent<FunctionTemplate> ImageBitmap::constructorTemplate;
+
+void ImageBitmap::Init(Handle<Object> exports) {
+  Local<FunctionTemplate> tpl = Nan::New<FunctionTemplate>(New);
+  tpl->SetClassName(Nan::New("ImageBitmap").ToLocalChecked());
+  tpl->InstanceTemplate()->SetInternalFieldCount(1);
+
+  Nan::SetPrototypeMethod(tpl, "close", Close);
+
+  constructorTemplate.Reset(tpl);
+  exports->Set(Nan::New("ImageBitmap").ToLocalChecked(), tpl->GetFunction());
+}
+
+bool ImageBitmap::HasInstance(Local<Value> value) {
+  return Nan::New(constructorTemplate)->HasInstance(value);
+}
+
+Local<Object> ImageBitmap::NewInstance(const SkBitmap &bitmap) {
+  Nan::EscapableHandleScope scope;
+
+  // New() takes the bitmap over from an External, which JS cannot make
+  Local<Value> argv[] = { Nan::New<External>((void *)&bitmap) };
+  Local<Function> fn = Nan::New(constructorTemplate)->GetFunction();
+  Local<Object> obj = Nan::NewInstance(fn, 1, argv).ToLocalChecked();
+
+  return scope.Escape(obj);
+}
+
+void ImageBitmap::New(const Nan::FunctionCallbackInfo<Value>& info) {
+  if (info[0]->IsExternal()) {
+    const SkBitmap *bitmap = (const SkBitmap *)info[0].As<External>()->Value();
+
+    ImageBitmap *image = new ImageBitmap();
+    image->bitmap = *bitmap;
+
+    image->Wrap(info.This());
+    info.This()->Set(Nan::New("width").ToLocalChecked(), Nan::New(bitmap->width()));
+    info.This()->Set(Nan::New("height").ToLocalChecked(), Nan::New(bitmap->height()));
+    info.GetReturnValue().Set(info.This());
+    return;
+  }
+
+  uint8_t *data;
+  size_t length;
+  if (!GetPixelData(info[0], &data, &length)) {
+    return Nan::ThrowTypeError("First argument needs to be a Buffer or a typed array");
+  }
+
+  int64_t w = info[1]->Int32Value();
+  int64_t h = info[2]->Int32Value();
+  if (w <= 0 || h <= 0) {
+    return Nan::ThrowRangeError("invalid image bitmap dimensions");
+  }
+
+  if ((uint64_t)(w * h * 4) > length) {
+    return Nan::ThrowRangeError("image data is smaller than its dimensions");
+  }
+
+  ImageBitmap *image = new ImageBitmap();
+  SkBitmap &bitmap = image->bitmap;
+
+  bitmap.setConfig(SkBitmap::kARGB_8888_Config, (int)w, (int)h);
+  if (!bitmap.allocPixels()) {
+    delete image;
+    return Nan::ThrowError("could not allocate image bitmap");
+  }
+
+  bitmap.lockPixels();
+  if (info[3]->BooleanValue()) {
+    memcpy(bitmap.getPixels(), data, bitmap.getSize());
+  } else {
+    PremultiplyRow((SkPMColor *)bitmap.getPixels(), data, (int)(w * h));
+  }
+  bitmap.unlockPixels();
+
+  bitmap.setImmutable();
+
+  image->Wrap(info.This());
+  info.This()->Set(Nan::New("width").ToLocalChecked(), Nan::New((uint32_t)w));
+  info.This()->Set(Nan::New("height").ToLocalChecked(), Nan::New((uint32_t)h));
+  info.GetReturnValue().Set(info.This());
+}
+
+// close(): frees the pixels right away, drawing it afterwards throws
+void ImageBitmap::Close(const Nan::FunctionCallbackInfo<Value>& info) {
+  ImageBitmap *image = ObjectWrap::Unwrap<ImageBitmap>(info.This());
+
+  image->bitmap.reset();
+  info.This()->Set(Nan::New("width").ToLocalChecked(), Nan::New(0));
+  info.This()->Set(Nan::New("height").ToLocalChecked(), Nan::New(0));
+}
@@ -0,0 +1,38 @@
+#ifndef _IMAGEBITMAP_H_
+#define _IMAGEBITMAP_H_
+
+#include <node.h>
+#include <nan.h>
+#include <SkBitmap.h>
+
+using namespace node;
+using namespace v8;
+
+// A premultiplied copy of some pixels that drawImage can use as is. The
+// bitmap is immutable and keeps one pixelref, and so one generation ID,
+// for its whole life, which lets Skia recognize repeated draws of it.
+//
+//   new ImageBitmap(data, width, height, premultiplied)
+//
+// data holds width * height RGBA pixels, or native surface pixels when
+// premultiplied is true (what a context's imageData gives).
+class ImageBitmap : public Nan::ObjectWrap {
+  public:
+    static void Init(Handle<Object> exports);
+    static bool HasInstance(Local<Value> value);
+
+    // wraps an immutable ARGB_8888 bitmap, sharing its pixels
+    static Local<Object> NewInstance(const SkBitmap &bitmap);
+
+    // empty once close() was called
+    SkBitmap bitmap;
+
+  private:
+    ImageBitmap() {}
+
+    static Nan::Persistent<FunctionTemplate> constructorTemplate;
+    static NAN_METHOD(New);
+    static NAN_METHOD(Close);
+};
+
+#endif
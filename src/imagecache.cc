@@ -0,0 +1,257 @@
+#include <node.h>
+#include <nan.h>
+
+#include "imagecache.h"
+#include "decoder.h"
+#include "imagebitmap.h"
+#include "pixelops.h"
+
+#include <SkBitmapFactory.h>
+
+using namespace node;
+using namespace v8;
+
+#define DEFAULT_IMAGE_CACHE_LIMIT (64 * 1024 * 1024)
+
+static intptr_t nextCacheID() {
+  static intptr_t id = SkImageCache::UNINITIALIZED_ID;
+  do {
+    id++;
+  } while (id == SkImageCache::UNINITIALIZED_ID);
+  return id;
+}
+
+class CachedImagePixels {
+  public:
+    CachedImagePixels(size_t length)
+      : length(length), id(nextCacheID()), pinned(false)
+    {
+      // NULL when out of memory, which fails the decode rather than the process
+      this->addr = sk_malloc_flags(length, 0);
+    }
+
+    ~CachedImagePixels() {
+      sk_free(this->addr);
+    }
+
+    void *addr;
+    size_t length;
+    intptr_t id;
+    bool pinned;
+
+  private:
+    SK_DECLARE_INTERNAL_LLIST_INTERFACE(CachedImagePixels);
+};
+
+ImageCache::ImageCache(size_t limit) {
+  memset(&this->stats, 0, sizeof(this->stats));
+  this->stats.limit = limit;
+}
+
+ImageCache::~ImageCache() {
+  while (this->list.tail()) {
+    this->remove(this->list.tail());
+  }
+}
+
+#ifdef SK_DEBUG
+SkImageCache::MemoryStatus ImageCache::getMemoryStatus(intptr_t ID) const {
+  SkAutoMutexAcquire lock(this->mutex);
+  CachedImagePixels *pixels = this->findByID(ID);
+  if (!pixels) {
+    return SkImageCache::kFreed_MemoryStatus;
+  }
+  return pixels->pinned ? SkImageCache::kPinned_MemoryStatus
+                        : SkImageCache::kUnpinned_MemoryStatus;
+}
+
+void ImageCache::purgeAllUnpinnedCaches() {
+  SkAutoMutexAcquire lock(this->mutex);
+  this->purge(0);
+}
+#endif
+
+void *ImageCache::allocAndPinCache(size_t bytes, intptr_t *ID) {
+  SkAutoMutexAcquire lock(this->mutex);
+
+  CachedImagePixels *pixels = SkNEW_ARGS(CachedImagePixels, (bytes));
+  if (!pixels->addr) {
+    SkDELETE(pixels);
+    this->stats.failures++;
+    return NULL;
+  }
+  pixels->pinned = true;
+  *ID = pixels->id;
+
+  this->list.addToHead(pixels);
+  this->stats.used += bytes;
+  this->stats.entries++;
+  this->stats.decodes++;
+
+  if (this->stats.limit) {
+    this->purge(this->stats.limit);
+  }
+  return pixels->addr;
+}
+
+void *ImageCache::pinCache(intptr_t ID, SkImageCache::DataStatus *status) {
+  SkAutoMutexAcquire lock(this->mutex);
+
+  CachedImagePixels *pixels = this->findByID(ID);
+  if (!pixels) {
+    this->stats.misses++;
+    return NULL;
+  }
+
+  this->stats.hits++;
+  if (this->list.head() != pixels) {
+    this->list.remove(pixels);
+    this->list.addToHead(pixels);
+  }
+
+  // evicted pixels are freed, never handed out again with stale data
+  *status = SkImageCache::kRetained_DataStatus;
+  pixels->pinned = true;
+  return pixels->addr;
+}
+
+void ImageCache::releaseCache(intptr_t ID) {
+  SkAutoMutexAcquire lock(this->mutex);
+
+  CachedImagePixels *pixels = this->findByID(ID);
+  if (pixels) {
+    pixels->pinned = false;
+  }
+
+  if (this->stats.limit) {
+    this->purge(this->stats.limit);
+  }
+}
+
+void ImageCache::throwAwayCache(intptr_t ID) {
+  SkAutoMutexAcquire lock(this->mutex);
+
+  CachedImagePixels *pixels = this->findByID(ID);
+  if (pixels) {
+    this->remove(pixels);
+  }
+}
+
+void ImageCache::setLimit(size_t limit) {
+  SkAutoMutexAcquire lock(this->mutex);
+
+  this->stats.limit = limit;
+  if (limit) {
+    this->purge(limit);
+  }
+}
+
+ImageCache::Stats ImageCache::getStats() const {
+  SkAutoMutexAcquire lock(this->mutex);
+  return this->stats;
+}
+
+// mutex held by the caller
+CachedImagePixels *ImageCache::findByID(intptr_t ID) const {
+  SkTInternalLList<CachedImagePixels>::Iter iter;
+  CachedImagePixels *pixels = iter.init(this->list, SkTInternalLList<CachedImagePixels>::Iter::kHead_IterStart);
+  while (pixels) {
+    if (pixels->id == ID) {
+      return pixels;
+    }
+    pixels = iter.next();
+  }
+  return NULL;
+}
+
+// mutex held by the caller. Walks from the least recently used end and
+// skips whatever is pinned.
+void ImageCache::purge(size_t limit) {
+  SkTInternalLList<CachedImagePixels>::Iter iter;
+  CachedImagePixels *pixels = iter.init(this->list, SkTInternalLList<CachedImagePixels>::Iter::kTail_IterStart);
+  while (pixels && this->stats.used > limit) {
+    CachedImagePixels *prev = iter.prev();
+    if (!pixels->pinned) {
+      this->remove(pixels);
+      this->stats.evictions++;
+    }
+    pixels = prev;
+  }
+}
+
+void ImageCache::remove(CachedImagePixels *pixels) {
+  this->list.remove(pixels);
+  this->stats.used -= pixels->length;
+  this->stats.entries--;
+  SkDELETE(pixels);
+}
+
+ImageCache *GetImageCache() {
+  static ImageCache *cache = NULL;
+  if (!cache) {
+    cache = SkNEW_ARGS(ImageCache, (DEFAULT_IMAGE_CACHE_LIMIT));
+  }
+  return cache;
+}
+
+bool InstallLazyPixels(SkData *data, SkBitmap *bitmap) {
+  SkBitmapFactory factory(DecodeToTarget);
+  factory.setImageCache(GetImageCache());
+  return factory.installPixelRef(data, bitmap);
+}
+
+// createLazyImage(buffer): an ImageBitmap of the encoded image in buffer,
+// which is copied. Only the header is read up front, the pixels are decoded
+// on draw into the image cache.
+static NAN_METHOD(CreateLazyImage) {
+  uint8_t *bytes;
+  size_t length;
+  if (!GetPixelData(info[0], &bytes, &length)) {
+    return Nan::ThrowTypeError("First argument needs to be a Buffer or a typed array");
+  }
+
+  SkAutoTUnref<SkData> data(SkData::NewWithCopy(bytes, length));
+  SkBitmap bitmap;
+  if (!InstallLazyPixels(data, &bitmap)) {
+    return Nan::ThrowError("could not decode image");
+  }
+
+  info.GetReturnValue().Set(ImageBitmap::NewInstance(bitmap));
+}
+
+static NAN_METHOD(ImageCacheStats) {
+  ImageCache::Stats counters = GetImageCache()->getStats();
+  double lookups = counters.hits + counters.misses;
+
+  Local<Object> stats = Nan::New<Object>();
+  stats->Set(Nan::New("used").ToLocalChecked(), Nan::New((double)counters.used));
+  stats->Set(Nan::New("limit").ToLocalChecked(), Nan::New((double)counters.limit));
+  stats->Set(Nan::New("entries").ToLocalChecked(), Nan::New(counters.entries));
+  stats->Set(Nan::New("decodes").ToLocalChecked(), Nan::New(counters.decodes));
+  stats->Set(Nan::New("hits").ToLocalChecked(), Nan::New(counters.hits));
+  stats->Set(Nan::New("misses").ToLocalChecked(), Nan::New(counters.misses));
+  stats->Set(Nan::New("evictions").ToLocalChecked(), Nan::New(counters.evictions));
+  stats->Set(Nan::New("failures").ToLocalChecked(), Nan::New(counters.failures));
+  stats->Set(
+    Nan::New("hitRate").ToLocalChecked(),
+    Nan::New(lookups ? counters.hits / lookups : 0)
+  );
+
+  info.GetReturnValue().Set(stats);
+}
+
+// setImageCacheLimit(bytes): budget for decoded pixels, 0 for none.
+// Unpinned images are evicted right away when it is lowered.
+static NAN_METHOD(SetImageCacheLimit) {
+  if (!info[0]->IsNumber() || info[0]->NumberValue() < 0) {
+    return Nan::ThrowRangeError("image cache limit must be >= 0");
+  }
+
+  GetImageCache()->setLimit((size_t)info[0]->NumberValue());
+}
+
+void InitImageCache(Handle<Object> exports) {
+  Nan::SetMethod(exports, "createLazyImage", CreateLazyImage);
+  Nan::SetMethod(exports, "imageCacheStats", ImageCacheStats);
+  Nan::SetMethod(exports, "setImageCacheLimit", SetImageCacheLimit);
+}
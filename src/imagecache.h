@@ -0,0 +1,78 @@
+#ifndef _IMAGECACHE_H_
+#define _IMAGECACHE_H_
+
+#include <node.h>
+#include <nan.h>
+#include <SkBitmap.h>
+#include <SkData.h>
+#include <SkImageCache.h>
+#include <SkTInternalLList.h>
+#include <SkThread.h>
+
+using namespace node;
+using namespace v8;
+
+class CachedImagePixels;
+
+// Pixel memory of the lazily decoded images, one budget for the whole
+// process. The least recently drawn images give their pixels up when a
+// decode would go over the budget and decode again on their next draw.
+// Images being drawn are pinned and never evicted, so the cache can go
+// over budget for as long as that lasts.
+//
+// Works like SkLruImageCache, which has no way to tell how often it
+// evicts, plus the counters behind imageCacheStats().
+class ImageCache : public SkImageCache {
+  public:
+    ImageCache(size_t limit);
+    virtual ~ImageCache();
+
+#ifdef SK_DEBUG
+    virtual MemoryStatus getMemoryStatus(intptr_t ID) const SK_OVERRIDE;
+    virtual void purgeAllUnpinnedCaches() SK_OVERRIDE;
+#endif
+
+    virtual void *allocAndPinCache(size_t bytes, intptr_t *ID) SK_OVERRIDE;
+    virtual void *pinCache(intptr_t ID, SkImageCache::DataStatus *status) SK_OVERRIDE;
+    virtual void releaseCache(intptr_t ID) SK_OVERRIDE;
+    virtual void throwAwayCache(intptr_t ID) SK_OVERRIDE;
+
+    // 0 for no limit, purges right away when lowered
+    void setLimit(size_t limit);
+
+    struct Stats {
+      double decodes;     // allocations, first decodes and decodes after eviction
+      double hits;        // draws that found the pixels still there
+      double misses;      // draws that found them evicted and decoded again
+      double evictions;
+      double failures;    // decodes that could not allocate their pixels
+      size_t used, limit;
+      uint32_t entries;
+    };
+    Stats getStats() const;
+
+  private:
+    CachedImagePixels *findByID(intptr_t ID) const;
+    void purge(size_t limit);
+    void remove(CachedImagePixels *pixels);
+
+    // most recently used at the head
+    SkTInternalLList<CachedImagePixels> list;
+    mutable SkMutex mutex;
+    Stats stats;
+};
+
+// The process wide cache, created on first use
+ImageCache *GetImageCache();
+
+// Sets bitmap up to decode data on its first draw into GetImageCache(),
+// keeping a ref on data to decode from again after an eviction. Only the
+// header is read here. Returns false when data is not an image this build
+// can decode.
+bool InstallLazyPixels(SkData *data, SkBitmap *bitmap);
+
+// exposes createLazyImage(), imageCacheStats() and setImageCacheLimit() on
+// the binding
+void InitImageCache(Handle<Object> exports);
+
+#endif
@@ -0,0 +1,62 @@
+#include <node.h>
+#include <nan.h>
+
+#include "picture.h"
+
+using namespace node;
+using namespace v8;
+
+Nan::Persistent<FunctionTemplate> Picture::constructorTemplate;
+
+void Picture::Init(Handle<Object> exports) {
+  Local<FunctionTemplate> tpl = Nan::New<FunctionTemplate>(New);
+  tpl->SetClassName(Nan::New("Picture").ToLocalChecked());
+  tpl->InstanceTemplate()->SetInternalFieldCount(1);
+
+  Nan::SetPrototypeMethod(tpl, "close", Close);
+
+  constructorTemplate.Reset(tpl);
+  exports->Set(Nan::New("Picture").ToLocalChecked(), tpl->GetFunction());
+}
+
+bool Picture::HasInstance(Local<Value> value) {
+  return Nan::New(constructorTemplate)->HasInstance(value);
+}
+
+Local<Object> Picture::NewInstance(SkPicture *picture) {
+  Nan::EscapableHandleScope scope;
+
+  Local<Value> argv[] = { Nan::New<External>((void *)picture) };
+  Local<Function> fn = Nan::New(constructorTemplate)->GetFunction();
+  Local<Object> obj = Nan::NewInstance(fn, 1, argv).ToLocalChecked();
+
+  return scope.Escape(obj);
+}
+
+Picture::~Picture() {
+  SkSafeUnref(this->picture);
+}
+
+// Only endRecording() makes pictures
+void Picture::New(const Nan::FunctionCallbackInfo<Value>& info) {
+  if (!info[0]->IsExternal()) {
+    return Nan::ThrowTypeError("pictures come from endRecording()");
+  }
+
+  Picture *picture = new Picture();
+  picture->picture = (SkPicture *)info[0].As<External>()->Value();
+
+  picture->Wrap(info.This());
+  info.This()->Set(Nan::New("width").ToLocalChecked(), Nan::New(picture->picture->width()));
+  info.This()->Set(Nan::New("height").ToLocalChecked(), Nan::New(picture->picture->height()));
+  info.GetReturnValue().Set(info.This());
+}
+
+void Picture::Close(const Nan::FunctionCallbackInfo<Value>& info) {
+  Picture *picture = ObjectWrap::Unwrap<Picture>(info.This());
+
+  SkSafeUnref(picture->picture);
+  picture->picture = NULL;
+  info.This()->Set(Nan::New("width").ToLocalChecked(), Nan::New(0));
+  info.This()->Set(Nan::New("height").ToLocalChecked(), Nan::New(0));
+}
@@ -0,0 +1,38 @@
+#ifndef _PICTURE_H_
+#define _PICTURE_H_
+
+#include <node.h>
+#include <nan.h>
+#include <SkPicture.h>
+
+using namespace node;
+using namespace v8;
+
+// Drawing commands recorded between a context's beginRecording() and
+// endRecording(). drawPicture() plays them back natively, without going
+// through JS or converting any arguments, onto any context and as often
+// as needed.
+//
+//   width, height: the size of the context it was recorded on
+//   close(): frees the commands, drawing it afterwards throws
+class Picture : public Nan::ObjectWrap {
+  public:
+    static void Init(Handle<Object> exports);
+    static bool HasInstance(Local<Value> value);
+
+    // wraps a finished recording, taking over its ref
+    static Local<Object> NewInstance(SkPicture *picture);
+
+    // NULL once close() was called
+    SkPicture *picture;
+
+  private:
+    Picture() : picture(NULL) {}
+    ~Picture();
+
+    static Nan::Persistent<FunctionTemplate> constructorTemplate;
+    static NAN_METHOD(New);
+    static NAN_METHOD(Close);
+};
+
+#endif
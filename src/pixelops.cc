@@ -0,0 +1,401 @@
+#include <node.h>
+#include <node_buffer.h>
+#include <nan.h>
+
+#include "pixelops.h"
+
+#include <SkColorPriv.h>
+#include <SkUnPreMultiply.h>
+
+#include <string.h>
+
+// the vector paths assume alpha in the top byte and only ever swap R and B
+#if SK_CPU_SSE_LEVEL >= SK_CPU_SSE_LEVEL_SSE2 && \
+    SK_A32_SHIFT == 24 && SK_G32_SHIFT == 8 && \
+    (SK_R32_SHIFT == 0 || SK_B32_SHIFT == 0)
+  #define PIXELOPS_SSE2 1
+  #include <emmintrin.h>
+#endif
+
+static inline void unpremultiplyPixel(uint8_t *dst, SkPMColor c,
+                                      const SkUnPreMultiply::Scale *table)
+{
+  U8CPU a = SkGetPackedA32(c);
+  SkUnPreMultiply::Scale scale = table[a];
+
+  dst[0] = SkUnPreMultiply::ApplyScale(scale, SkGetPackedR32(c));
+  dst[1] = SkUnPreMultiply::ApplyScale(scale, SkGetPackedG32(c));
+  dst[2] = SkUnPreMultiply::ApplyScale(scale, SkGetPackedB32(c));
+  dst[3] = a;
+}
+
+static inline SkPMColor premultiplyPixel(const uint8_t *src) {
+  return SkPremultiplyARGBInline(src[3], src[0], src[1], src[2]);
+}
+
+#ifdef PIXELOPS_SSE2
+
+// native order <-> RGBA, a no-op unless the surface is BGRA
+static inline __m128i swapRB_SSE2(__m128i px) {
+#if SK_R32_SHIFT == 0
+  return px;
+#else
+  const __m128i ag = _mm_set1_epi32(0xff00ff00);
+  __m128i rb = _mm_andnot_si128(ag, px);
+  rb = _mm_or_si128(_mm_slli_epi32(rb, 16), _mm_srli_epi32(rb, 16));
+  return _mm_or_si128(_mm_and_si128(px, ag), rb);
+#endif
+}
+
+// (scale * c + (1 << 23)) >> 24 for the four 32 bit channels of a pixel,
+// SkUnPreMultiply::ApplyScale without the 8 bit clamp. SSE2 has no 32 bit
+// mullo, so the even and odd lanes go through pmuludq separately.
+static inline __m128i applyScale_SSE2(__m128i px, uint32_t scale) {
+  const __m128i round = _mm_set_epi32(0, 1 << 23, 0, 1 << 23);
+  __m128i s = _mm_set1_epi32((int)scale);
+
+  __m128i even = _mm_mul_epu32(px, s);
+  __m128i odd = _mm_mul_epu32(_mm_srli_epi64(px, 32), s);
+
+  even = _mm_srli_epi64(_mm_add_epi64(even, round), 24);
+  odd = _mm_srli_epi64(_mm_add_epi64(odd, round), 24);
+
+  return _mm_or_si128(even, _mm_slli_epi64(odd, 32));
+}
+
+// Four pixels at a time. Groups made of opaque and fully transparent pixels,
+// which is most of a typical canvas, skip the multiplies.
+static int unpremultiplyRow_SSE2(uint8_t *dst, const SkPMColor *src, int count,
+                                 const SkUnPreMultiply::Scale *table)
+{
+  const __m128i zero = _mm_setzero_si128();
+  const __m128i opaque = _mm_set1_epi32(0xff);
+  const __m128i alphaMask = _mm_set1_epi32(0xff000000);
+
+  int i = 0;
+  for (; i + 4 <= count; i += 4) {
+    __m128i px = _mm_loadu_si128((const __m128i *)(src + i));
+    __m128i alpha = _mm_srli_epi32(px, 24);
+    __m128i transparent = _mm_cmpeq_epi32(alpha, zero);
+    __m128i out;
+
+    if (_mm_movemask_epi8(_mm_or_si128(_mm_cmpeq_epi32(alpha, opaque), transparent)) == 0xffff) {
+      // only opaque and transparent pixels, the scale is 1 or 0
+      out = swapRB_SSE2(_mm_andnot_si128(transparent, px));
+    } else {
+      __m128i lo = _mm_unpacklo_epi8(px, zero);
+      __m128i hi = _mm_unpackhi_epi8(px, zero);
+
+      __m128i p0 = applyScale_SSE2(_mm_unpacklo_epi16(lo, zero), table[SkGetPackedA32(src[i])]);
+      __m128i p1 = applyScale_SSE2(_mm_unpackhi_epi16(lo, zero), table[SkGetPackedA32(src[i + 1])]);
+      __m128i p2 = applyScale_SSE2(_mm_unpacklo_epi16(hi, zero), table[SkGetPackedA32(src[i + 2])]);
+      __m128i p3 = applyScale_SSE2(_mm_unpackhi_epi16(hi, zero), table[SkGetPackedA32(src[i + 3])]);
+
+      out = _mm_packus_epi16(_mm_packs_epi32(p0, p1), _mm_packs_epi32(p2, p3));
+
+      // alpha itself passes through
+      out = _mm_or_si128(_mm_andnot_si128(alphaMask, out), _mm_and_si128(px, alphaMask));
+      out = swapRB_SSE2(out);
+    }
+
+    _mm_storeu_si128((__m128i *)(dst + i * 4), out);
+  }
+
+  return i;
+}
+
+// SkMulDiv255Round on eight 16 bit lanes, products stay below 2^16
+static inline __m128i mulDiv255Round_SSE2(__m128i c, __m128i a) {
+  __m128i prod = _mm_add_epi16(_mm_mullo_epi16(c, a), _mm_set1_epi16(128));
+  return _mm_srli_epi16(_mm_add_epi16(prod, _mm_srli_epi16(prod, 8)), 8);
+}
+
+// alpha of each of the two pixels in c copied to all four of its lanes
+static inline __m128i spreadAlpha_SSE2(__m128i c) {
+  c = _mm_shufflelo_epi16(c, _MM_SHUFFLE(3, 3, 3, 3));
+  return _mm_shufflehi_epi16(c, _MM_SHUFFLE(3, 3, 3, 3));
+}
+
+static int premultiplyRow_SSE2(SkPMColor *dst, const uint8_t *src, int count) {
+  const __m128i zero = _mm_setzero_si128();
+  const __m128i opaque = _mm_set1_epi32(0xff);
+  const __m128i alphaMask = _mm_set1_epi32(0xff000000);
+
+  int i = 0;
+  for (; i + 4 <= count; i += 4) {
+    __m128i px = _mm_loadu_si128((const __m128i *)(src + i * 4));
+    __m128i alpha = _mm_srli_epi32(px, 24);
+    __m128i transparent = _mm_cmpeq_epi32(alpha, zero);
+    __m128i out;
+
+    if (_mm_movemask_epi8(_mm_or_si128(_mm_cmpeq_epi32(alpha, opaque), transparent)) == 0xffff) {
+      out = _mm_andnot_si128(transparent, px);
+    } else {
+      __m128i lo = _mm_unpacklo_epi8(px, zero);
+      __m128i hi = _mm_unpackhi_epi8(px, zero);
+
+      lo = mulDiv255Round_SSE2(lo, spreadAlpha_SSE2(lo));
+      hi = mulDiv255Round_SSE2(hi, spreadAlpha_SSE2(hi));
+
+      out = _mm_packus_epi16(lo, hi);
+      out = _mm_or_si128(_mm_andnot_si128(alphaMask, out), _mm_and_si128(px, alphaMask));
+    }
+
+    _mm_storeu_si128((__m128i *)(dst + i), swapRB_SSE2(out));
+  }
+
+  return i;
+}
+
+// Sixteen alpha bytes per iteration, the packs saturate nothing since
+// every lane holds a value below 256 after the shift.
+static int alphaRow_SSE2(uint8_t *dst, const SkPMColor *src, int count) {
+  int i = 0;
+  for (; i + 16 <= count; i += 16) {
+    __m128i a0 = _mm_srli_epi32(_mm_loadu_si128((const __m128i *)(src + i)), 24);
+    __m128i a1 = _mm_srli_epi32(_mm_loadu_si128((const __m128i *)(src + i + 4)), 24);
+    __m128i a2 = _mm_srli_epi32(_mm_loadu_si128((const __m128i *)(src + i + 8)), 24);
+    __m128i a3 = _mm_srli_epi32(_mm_loadu_si128((const __m128i *)(src + i + 12)), 24);
+
+    __m128i out = _mm_packus_epi16(_mm_packs_epi32(a0, a1), _mm_packs_epi32(a2, a3));
+    _mm_storeu_si128((__m128i *)(dst + i), out);
+  }
+
+  return i;
+}
+
+static int swapRow_SSE2(uint8_t *dst, const SkPMColor *src, int count) {
+  int i = 0;
+  for (; i + 4 <= count; i += 4) {
+    __m128i px = _mm_loadu_si128((const __m128i *)(src + i));
+    _mm_storeu_si128((__m128i *)(dst + i * 4), swapRB_SSE2(px));
+  }
+
+  return i;
+}
+
+// RGBA bytes to 565 words, eight pixels at a time. packs_epi32 is signed,
+// so the words are biased into its range and back.
+static inline __m128i pack565_SSE2(__m128i px) {
+  __m128i r = _mm_slli_epi32(_mm_and_si128(px, _mm_set1_epi32(0xf8)), 8);
+  __m128i g = _mm_and_si128(_mm_srli_epi32(px, 5), _mm_set1_epi32(0x7e0));
+  __m128i b = _mm_and_si128(_mm_srli_epi32(px, 19), _mm_set1_epi32(0x1f));
+  return _mm_sub_epi32(_mm_or_si128(_mm_or_si128(r, g), b), _mm_set1_epi32(0x8000));
+}
+
+static int rgb565Row_SSE2(uint8_t *dst, const uint8_t *rgba, int count) {
+  int i = 0;
+  for (; i + 8 <= count; i += 8) {
+    __m128i lo = pack565_SSE2(_mm_loadu_si128((const __m128i *)(rgba + i * 4)));
+    __m128i hi = pack565_SSE2(_mm_loadu_si128((const __m128i *)(rgba + i * 4 + 16)));
+
+    __m128i out = _mm_add_epi16(_mm_packs_epi32(lo, hi), _mm_set1_epi16((short)0x8000));
+    _mm_storeu_si128((__m128i *)(dst + i * 2), out);
+  }
+
+  return i;
+}
+
+#endif
+
+void UnpremultiplyRow(uint8_t *dst, const SkPMColor *src, int count) {
+  const SkUnPreMultiply::Scale *table = SkUnPreMultiply::GetScaleTable();
+  int i = 0;
+
+#ifdef PIXELOPS_SSE2
+  i = unpremultiplyRow_SSE2(dst, src, count, table);
+#endif
+
+  for (; i<count; i++) {
+    unpremultiplyPixel(dst + i * 4, src[i], table);
+  }
+}
+
+void PremultiplyRow(SkPMColor *dst, const uint8_t *src, int count) {
+  int i = 0;
+
+#ifdef PIXELOPS_SSE2
+  i = premultiplyRow_SSE2(dst, src, count);
+#endif
+
+  for (; i<count; i++) {
+    dst[i] = premultiplyPixel(src + i * 4);
+  }
+}
+
+// indexed by PixelFormat
+static const struct {
+  const char *name;
+  PixelFormat format;
+  size_t bytes;
+} kPixelFormats[] = {
+  { "native", kNative_PixelFormat, 4 },
+  { "rgba8888", kRGBA8888_PixelFormat, 4 },
+  { "rgb888", kRGB888_PixelFormat, 3 },
+  { "rgb565", kRGB565_PixelFormat, 2 },
+  { "a8", kA8_PixelFormat, 1 }
+};
+
+bool ParsePixelFormat(const char *name, PixelFormat *format) {
+  for (size_t i = 0; i<SK_ARRAY_COUNT(kPixelFormats); i++) {
+    if (!strcmp(name, kPixelFormats[i].name)) {
+      *format = kPixelFormats[i].format;
+      return true;
+    }
+  }
+
+  return false;
+}
+
+size_t PixelFormatBytes(PixelFormat format) {
+  return kPixelFormats[format].bytes;
+}
+
+// premultiplied surface pixels as RGBA bytes
+static void swapRow(uint8_t *dst, const SkPMColor *src, int count) {
+  int i = 0;
+
+#ifdef PIXELOPS_SSE2
+  i = swapRow_SSE2(dst, src, count);
+#endif
+
+  for (; i<count; i++) {
+    SkPMColor c = src[i];
+    dst[i * 4] = SkGetPackedR32(c);
+    dst[i * 4 + 1] = SkGetPackedG32(c);
+    dst[i * 4 + 2] = SkGetPackedB32(c);
+    dst[i * 4 + 3] = SkGetPackedA32(c);
+  }
+}
+
+static void alphaRow(uint8_t *dst, const SkPMColor *src, int count) {
+  int i = 0;
+
+#ifdef PIXELOPS_SSE2
+  i = alphaRow_SSE2(dst, src, count);
+#endif
+
+  for (; i<count; i++) {
+    dst[i] = SkGetPackedA32(src[i]);
+  }
+}
+
+// SSE2 has no byte shuffle, so the three byte pixels are packed in the
+// scalar loop. It runs on a block that is still in L1.
+static void rgb888Row(uint8_t *dst, const uint8_t *rgba, int count) {
+  for (int i = 0; i<count; i++) {
+    dst[i * 3] = rgba[i * 4];
+    dst[i * 3 + 1] = rgba[i * 4 + 1];
+    dst[i * 3 + 2] = rgba[i * 4 + 2];
+  }
+}
+
+// truncates like SkPack888ToRGB16
+static void rgb565Row(uint8_t *dst, const uint8_t *rgba, int count) {
+  int i = 0;
+
+#ifdef PIXELOPS_SSE2
+  i = rgb565Row_SSE2(dst, rgba, count);
+#endif
+
+  for (; i<count; i++) {
+    const uint8_t *p = rgba + i * 4;
+    uint16_t c = ((p[0] >> 3) << 11) | ((p[1] >> 2) << 5) | (p[2] >> 3);
+    dst[i * 2] = (uint8_t)c;
+    dst[i * 2 + 1] = (uint8_t)(c >> 8);
+  }
+}
+
+// pixels converted to RGBA per pass of the packed formats
+#define CONVERT_BLOCK 256
+
+void ConvertRow(uint8_t *dst, const SkPMColor *src, int count,
+                PixelFormat format, bool premultiplied)
+{
+  switch (format) {
+    case kNative_PixelFormat:
+      memcpy(dst, src, count * 4);
+      return;
+    case kA8_PixelFormat:
+      alphaRow(dst, src, count);
+      return;
+    case kRGBA8888_PixelFormat:
+      if (premultiplied) {
+        swapRow(dst, src, count);
+      } else {
+        UnpremultiplyRow(dst, src, count);
+      }
+      return;
+    default:
+      break;
+  }
+
+  // the packed formats go through RGBA one block at a time
+  uint8_t rgba[CONVERT_BLOCK * 4];
+  size_t bytes = PixelFormatBytes(format);
+
+  for (int i = 0; i<count; i += CONVERT_BLOCK) {
+    int n = SkMin32(CONVERT_BLOCK, count - i);
+
+    if (premultiplied) {
+      swapRow(rgba, src + i, n);
+    } else {
+      UnpremultiplyRow(rgba, src + i, n);
+    }
+
+    if (format == kRGB888_PixelFormat) {
+      rgb888Row(dst + i * bytes, rgba, n);
+    } else {
+      rgb565Row(dst + i * bytes, rgba, n);
+    }
+  }
+}
+
+bool GetPixelData(Local<Value> value, uint8_t **data, size_t *length) {
+  if (Buffer::HasInstance(value)) {
+    *data = (uint8_t *)Buffer::Data(value);
+    *length = Buffer::Length(value);
+    return true;
+  }
+
+  if (value->IsArrayBufferView()) {
+    Nan::TypedArrayContents<uint8_t> contents(value);
+    *data = *contents;
+    *length = contents.length();
+    return true;
+  }
+
+  return false;
+}
+
+// premultiply(data, width, height): a new Buffer holding the RGBA pixels of
+// data as premultiplied surface pixels, ready for drawImageBuffer. data is
+// left untouched.
+static NAN_METHOD(Premultiply) {
+  uint8_t *src;
+  size_t length;
+  if (!GetPixelData(info[0], &src, &length)) {
+    return Nan::ThrowTypeError("First argument needs to be a Buffer or a typed array");
+  }
+
+  int64_t w = info[1]->Int32Value();
+  int64_t h = info[2]->Int32Value();
+  if (w < 0 || h < 0 || (uint64_t)(w * h * 4) > length) {
+    return Nan::ThrowRangeError("image data is smaller than its dimensions");
+  }
+
+  size_t size = (size_t)(w * h * 4);
+  SkPMColor *dst = (SkPMColor *)malloc(size);
+  if (!dst && size) {
+    return Nan::ThrowError("could not allocate image data");
+  }
+
+  // rows are contiguous on both sides
+  PremultiplyRow(dst, src, (int)(w * h));
+
+  info.GetReturnValue().Set(Nan::NewBuffer((char *)dst, size).ToLocalChecked());
+}
+
+void InitPixelOps(Handle<Object> exports) {
+  Nan::SetMethod(exports, "premultiply", Premultiply);
+}
@@ -0,0 +1,52 @@
+#ifndef _PIXELOPS_H_
+#define _PIXELOPS_H_
+
+#include <node.h>
+#include <nan.h>
+#include <SkColor.h>
+
+using namespace node;
+using namespace v8;
+
+// Row converters between the surface format (premultiplied, channels in
+// SK_*32_SHIFT order) and the unpremultiplied RGBA bytes ImageData uses.
+// The SSE2 kernels are compiled in when the target supports them, the
+// scalar loops handle everything else and the tail of each row.
+
+// Writes count RGBA pixels to dst, unpremultiplied exactly like
+// SkUnPreMultiply::PMColorToColor.
+void UnpremultiplyRow(uint8_t *dst, const SkPMColor *src, int count);
+
+// Writes count RGBA pixels from src to dst as surface pixels, premultiplied
+// exactly like SkPreMultiplyARGB.
+void PremultiplyRow(SkPMColor *dst, const uint8_t *src, int count);
+
+// Layouts toBuffer() can export the surface pixels in. kNative is the
+// surface format itself, the others are byte ordered and independent of
+// SK_*32_SHIFT. RGB565 pixels are little endian 16 bit words.
+enum PixelFormat {
+  kNative_PixelFormat,
+  kRGBA8888_PixelFormat,
+  kRGB888_PixelFormat,
+  kRGB565_PixelFormat,
+  kA8_PixelFormat
+};
+
+// Looks up a format by its toBuffer() name. Returns false for unknown names.
+bool ParsePixelFormat(const char *name, PixelFormat *format);
+
+size_t PixelFormatBytes(PixelFormat format);
+
+// Writes count surface pixels to dst in format. Colors are unpremultiplied
+// first unless premultiplied is set; A8 only ever copies alpha.
+void ConvertRow(uint8_t *dst, const SkPMColor *src, int count,
+                PixelFormat format, bool premultiplied);
+
+// Points data at the bytes of a Buffer or typed array. Returns false for
+// anything else.
+bool GetPixelData(Local<Value> value, uint8_t **data, size_t *length);
+
+// exposes premultiply() on the binding
+void InitPixelOps(Handle<Object> exports);
+
+#endif
@@ -0,0 +1,337 @@
+#include "pngparallel.h"
+#include "pixelops.h"
+
+#include <SkCountdown.h>
+#include <SkRunnable.h>
+#include <SkTDArray.h>
+#include <SkThread.h>
+#include <SkThreadPool.h>
+
+#include <png.h>
+#include <zlib.h>
+#include <stdlib.h>
+#include <string.h>
+#include <uv.h>
+
+// strips shorter than this are not worth a thread hop
+#define MIN_STRIP_ROWS 32
+
+// deflate output is collected in steps of this size
+#define DEFLATE_CHUNK (16 * 1024)
+
+static const uint8_t kSignature[8] = { 137, 80, 78, 71, 13, 10, 26, 10 };
+
+// one pool per process, one thread per core, created on first use
+SK_DECLARE_STATIC_MUTEX(gPoolMutex);
+static SkThreadPool *gPool = NULL;
+static int gPoolThreads = 0;
+
+static SkThreadPool *getPool(int *threads) {
+  SkAutoMutexAcquire lock(gPoolMutex);
+  if (!gPool) {
+    uv_cpu_info_t *cpus;
+    int count = 0;
+    if (uv_cpu_info(&cpus, &count) == 0) {
+      uv_free_cpu_info(cpus, count);
+    }
+
+    gPoolThreads = count > 0 ? count : 1;
+    gPool = SkNEW_ARGS(SkThreadPool, (gPoolThreads));
+  }
+
+  *threads = gPoolThreads;
+  return gPool;
+}
+
+static inline uint8_t paeth(int a, int b, int c) {
+  int p = a + b - c;
+  int pa = abs(p - a);
+  int pb = abs(p - b);
+  int pc = abs(p - c);
+
+  if (pa <= pb && pa <= pc) {
+    return a;
+  }
+  return pb <= pc ? b : c;
+}
+
+// Writes the filter type and row filtered with it to out. Returns libpng's
+// adaptive filter cost, the sum of the output bytes taken as signed.
+static uint32_t filterRow(int type, const uint8_t *row, const uint8_t *prev,
+                          size_t length, int bpp, uint8_t *out)
+{
+  *out++ = (uint8_t)type;
+
+  for (size_t i = 0; i<length; i++) {
+    int left = i >= (size_t)bpp ? row[i - bpp] : 0;
+    int upLeft = i >= (size_t)bpp ? prev[i - bpp] : 0;
+
+    switch (type) {
+      case PNG_FILTER_VALUE_NONE:
+        out[i] = row[i];
+        break;
+      case PNG_FILTER_VALUE_SUB:
+        out[i] = row[i] - left;
+        break;
+      case PNG_FILTER_VALUE_UP:
+        out[i] = row[i] - prev[i];
+        break;
+      case PNG_FILTER_VALUE_AVG:
+        out[i] = row[i] - ((left + prev[i]) >> 1);
+        break;
+      default:
+        out[i] = row[i] - paeth(left, prev[i], upLeft);
+        break;
+    }
+  }
+
+  uint32_t cost = 0;
+  for (size_t i = 0; i<length; i++) {
+    cost += out[i] < 128 ? out[i] : 256 - out[i];
+  }
+  return cost;
+}
+
+// PNG_FILTER_* flag of each PNG_FILTER_VALUE_*
+static const int kFilterFlags[PNG_FILTER_VALUE_LAST] = {
+  PNG_FILTER_NONE, PNG_FILTER_SUB, PNG_FILTER_UP, PNG_FILTER_AVG, PNG_FILTER_PAETH
+};
+
+class PngStrip : public SkRunnable {
+  public:
+    PngStrip() : adler(1), length(0), ok(false) {}
+
+    virtual void run() SK_OVERRIDE {
+      this->ok = this->encode();
+      this->done->run();
+    }
+
+    // set up by EncodePngParallel
+    const SkBitmap *bitmap;
+    int top, bottom;
+    bool alpha, first, last;
+    int filters, level, strategy;
+    SkCountdown *done;
+
+    // results: the deflated rows, their adler32 and how many bytes went in
+    SkTDArray<uint8_t> out;
+    uLong adler;
+    size_t length;
+    bool ok;
+
+  private:
+    bool encode();
+    void convertRow(int y, uint8_t *dst, uint8_t *rgba);
+    bool deflateBytes(z_stream *z, const uint8_t *bytes, size_t count, int flush);
+};
+
+// unpremultiplied row y, RGB when alpha is dropped
+void PngStrip::convertRow(int y, uint8_t *dst, uint8_t *rgba) {
+  int width = this->bitmap->width();
+
+  if (this->alpha) {
+    UnpremultiplyRow(dst, this->bitmap->getAddr32(0, y), width);
+    return;
+  }
+
+  UnpremultiplyRow(rgba, this->bitmap->getAddr32(0, y), width);
+  for (int x = 0; x<width; x++) {
+    dst[x * 3] = rgba[x * 4];
+    dst[x * 3 + 1] = rgba[x * 4 + 1];
+    dst[x * 3 + 2] = rgba[x * 4 + 2];
+  }
+}
+
+bool PngStrip::deflateBytes(z_stream *z, const uint8_t *bytes, size_t count, int flush) {
+  uint8_t buffer[DEFLATE_CHUNK];
+
+  z->next_in = (Bytef *)bytes;
+  z->avail_in = (uInt)count;
+  do {
+    z->next_out = buffer;
+    z->avail_out = sizeof(buffer);
+    if (deflate(z, flush) == Z_STREAM_ERROR) {
+      return false;
+    }
+    this->out.append(sizeof(buffer) - z->avail_out, buffer);
+  } while (z->avail_out == 0);
+
+  return true;
+}
+
+bool PngStrip::encode() {
+  int bpp = this->alpha ? 4 : 3;
+  size_t rowLength = this->bitmap->width() * bpp;
+
+  // current and previous row, RGBA scratch and a filtered candidate per
+  // filter type, each of those with its type byte in front
+  SkAutoMalloc storage(rowLength * 2 + this->bitmap->width() * 4 +
+                       (rowLength + 1) * PNG_FILTER_VALUE_LAST);
+  uint8_t *row = (uint8_t *)storage.get();
+  uint8_t *prev = row + rowLength;
+  uint8_t *rgba = prev + rowLength;
+  uint8_t *candidates = rgba + this->bitmap->width() * 4;
+
+  // the first row of a strip is filtered against the last row of the one
+  // above, exactly like a serial encode would
+  if (this->top > 0) {
+    this->convertRow(this->top - 1, prev, rgba);
+  } else {
+    memset(prev, 0, rowLength);
+  }
+
+  z_stream z;
+  memset(&z, 0, sizeof(z));
+  if (deflateInit2(&z, this->level, Z_DEFLATED, -MAX_WBITS, 8, this->strategy) != Z_OK) {
+    return false;
+  }
+
+  if (this->first) {
+    // zlib header: deflate with a 32K window, FLEVEL from the level
+    int flevel = this->level < 0 || this->level == 6 ? 2 :
+                 this->level < 2 ? 0 :
+                 this->level < 6 ? 1 : 3;
+    uint8_t header[2] = { 0x78, (uint8_t)(flevel << 6) };
+    header[1] += 31 - ((header[0] << 8) + header[1]) % 31;
+    this->out.append(2, header);
+  }
+
+  bool ok = true;
+  for (int y = this->top; ok && y < this->bottom; y++) {
+    this->convertRow(y, row, rgba);
+
+    const uint8_t *best = NULL;
+    uint32_t bestCost = 0;
+    for (int type = 0; type < PNG_FILTER_VALUE_LAST; type++) {
+      if (!(this->filters & kFilterFlags[type])) {
+        continue;
+      }
+
+      uint8_t *candidate = candidates + type * (rowLength + 1);
+      uint32_t cost = filterRow(type, row, prev, rowLength, bpp, candidate);
+      if (!best || cost < bestCost) {
+        best = candidate;
+        bestCost = cost;
+      }
+    }
+
+    this->adler = adler32(this->adler, best, (uInt)(rowLength + 1));
+    this->length += rowLength + 1;
+    ok = this->deflateBytes(&z, best, rowLength + 1, Z_NO_FLUSH);
+
+    uint8_t *tmp = prev;
+    prev = row;
+    row = tmp;
+  }
+
+  // a sync flush ends on a byte boundary with no final block, the next
+  // strip's stream carries on from there
+  ok = ok && this->deflateBytes(&z, NULL, 0, this->last ? Z_FINISH : Z_SYNC_FLUSH);
+  deflateEnd(&z);
+  return ok;
+}
+
+static void putBigEndian(uint8_t *dst, uint32_t value) {
+  dst[0] = (uint8_t)(value >> 24);
+  dst[1] = (uint8_t)(value >> 16);
+  dst[2] = (uint8_t)(value >> 8);
+  dst[3] = (uint8_t)value;
+}
+
+static bool writeChunk(SkWStream *stream, const char *type, const uint8_t *data, size_t length) {
+  uint8_t header[8], crc[4];
+  putBigEndian(header, (uint32_t)length);
+  memcpy(header + 4, type, 4);
+
+  uLong sum = crc32(0L, Z_NULL, 0);
+  sum = crc32(sum, header + 4, 4);
+  if (length) {
+    // crc32() treats a NULL buffer as a request for the initial value
+    sum = crc32(sum, data, (uInt)length);
+  }
+  putBigEndian(crc, (uint32_t)sum);
+
+  return stream->write(header, 8) &&
+         (!length || stream->write(data, length)) &&
+         stream->write(crc, 4);
+}
+
+bool EncodePngParallel(SkWStream *stream, const SkBitmap &bitmap,
+                       const PngOptions &options, bool alpha)
+{
+  // one strip per thread asked for, or per core
+  int threads;
+  SkThreadPool *pool = getPool(&threads);
+  if (options.threads > 0) {
+    threads = options.threads;
+  }
+
+  int height = bitmap.height();
+  int count = SkMin32(threads, SkMax32(1, height / MIN_STRIP_ROWS));
+
+  // libpng's defaults for 8 bit RGB(A)
+  int filters = options.filters >= 0 ? options.filters : PNG_ALL_FILTERS;
+  int level = options.level >= 0 ? options.level : Z_DEFAULT_COMPRESSION;
+  int strategy = options.strategy >= 0 ? options.strategy :
+                 filters == PNG_FILTER_NONE ? Z_DEFAULT_STRATEGY : Z_FILTERED;
+
+  SkCountdown done(count);
+  PngStrip *strips = SkNEW_ARRAY(PngStrip, count);
+  for (int i = 0; i<count; i++) {
+    PngStrip &strip = strips[i];
+    strip.bitmap = &bitmap;
+    strip.top = (int)((int64_t)height * i / count);
+    strip.bottom = (int)((int64_t)height * (i + 1) / count);
+    strip.alpha = alpha;
+    strip.first = i == 0;
+    strip.last = i == count - 1;
+    strip.filters = filters;
+    strip.level = level;
+    strip.strategy = strategy;
+    strip.done = &done;
+  }
+
+  // the calling thread takes the first strip itself
+  for (int i = 1; i<count; i++) {
+    pool->add(&strips[i]);
+  }
+  strips[0].run();
+  done.wait();
+
+  bool ok = true;
+  uLong adler = strips[0].adler;
+  for (int i = 0; i<count; i++) {
+    ok = ok && strips[i].ok;
+    if (i > 0) {
+      adler = adler32_combine(adler, strips[i].adler, (z_off_t)strips[i].length);
+    }
+  }
+
+  if (ok) {
+    uint8_t trailer[4];
+    putBigEndian(trailer, (uint32_t)adler);
+    strips[count - 1].out.append(4, trailer);
+
+    uint8_t ihdr[13];
+    putBigEndian(ihdr, bitmap.width());
+    putBigEndian(ihdr + 4, height);
+    ihdr[8] = 8;
+    ihdr[9] = alpha ? PNG_COLOR_TYPE_RGB_ALPHA : PNG_COLOR_TYPE_RGB;
+    ihdr[10] = PNG_COMPRESSION_TYPE_BASE;
+    ihdr[11] = PNG_FILTER_TYPE_BASE;
+    ihdr[12] = PNG_INTERLACE_NONE;
+
+    ok = stream->write(kSignature, sizeof(kSignature)) &&
+         writeChunk(stream, "IHDR", ihdr, sizeof(ihdr));
+
+    // one IDAT per strip, together they hold the one zlib stream
+    for (int i = 0; ok && i<count; i++) {
+      ok = writeChunk(stream, "IDAT", strips[i].out.begin(), strips[i].out.count());
+    }
+
+    ok = ok && writeChunk(stream, "IEND", NULL, 0);
+  }
+
+  SkDELETE_ARRAY(strips);
+  return ok;
+}
@@ -0,0 +1,20 @@
+#ifndef _PNGPARALLEL_H_
+#define _PNGPARALLEL_H_
+
+#include <SkBitmap.h>
+#include <SkStream.h>
+
+#include "encoder.h"
+
+// PNG encoding spread over a thread pool, for PngOptions::threads other
+// than 1. The image is cut into horizontal strips that are filtered and
+// deflated on their own, each ending on a sync flush so the raw deflate
+// streams concatenate into one zlib stream; the adler32 is combined from
+// the strip checksums. The output is a plain PNG, slightly larger than a
+// serial encode as no strip can refer back into the one before it.
+//
+// bitmap has to be locked already. alpha picks RGBA over RGB output.
+bool EncodePngParallel(SkWStream *stream, const SkBitmap &bitmap,
+                       const PngOptions &options, bool alpha);
+
+#endif
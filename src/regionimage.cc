@@ -0,0 +1,365 @@
+#include <node.h>
+#include <nan.h>
+
+#include "regionimage.h"
+#include "decoder.h"
+#include "pixelops.h"
+
+#include <SkCanvas.h>
+#include <SkPaint.h>
+
+#include <png.h>
+
+using namespace node;
+using namespace v8;
+
+Nan::Persistent<FunctionTemplate> RegionImage::constructorTemplate;
+
+// libpng reads the encoded bytes straight from memory
+struct PngSource {
+  const uint8_t *bytes;
+  size_t length, offset;
+};
+
+static void readPng(png_structp png, png_bytep out, png_size_t length) {
+  PngSource *source = (PngSource *)png_get_io_ptr(png);
+  if (length > source->length - source->offset) {
+    png_error(png, "unexpected end of image");
+  }
+
+  memcpy(out, source->bytes + source->offset, length);
+  source->offset += length;
+}
+
+// every color type and depth comes out as 8 bit RGBA
+static void setRGBATransforms(png_structp png) {
+  png_set_expand(png);
+  png_set_strip_16(png);
+  png_set_gray_to_rgb(png);
+  png_set_filler(png, 0xff, PNG_FILLER_AFTER);
+}
+
+void RegionImage::Init(Handle<Object> exports) {
+  Local<FunctionTemplate> tpl = Nan::New<FunctionTemplate>(New);
+  tpl->SetClassName(Nan::New("RegionImage").ToLocalChecked());
+  tpl->InstanceTemplate()->SetInternalFieldCount(1);
+
+  Nan::SetPrototypeMethod(tpl, "close", Close);
+  Nan::SetPrototypeMethod(tpl, "cacheStats", CacheStats);
+
+  constructorTemplate.Reset(tpl);
+  exports->Set(Nan::New("RegionImage").ToLocalChecked(), tpl->GetFunction());
+}
+
+bool RegionImage::HasInstance(Local<Value> value) {
+  return Nan::New(constructorTemplate)->HasInstance(value);
+}
+
+RegionImage::~RegionImage() {
+  this->purge(0);
+  SkSafeUnref(this->data);
+}
+
+void RegionImage::purge(uint32_t limit) {
+  while (this->tiles > limit) {
+    RegionTile *tile = this->tileList.tail();
+    this->tileList.remove(tile);
+    SkDELETE(tile);
+    this->tiles--;
+    this->evictions++;
+  }
+}
+
+RegionTile *RegionImage::findTile(int tx, int ty, int sampleSize) {
+  SkTInternalLList<RegionTile>::Iter iter;
+  RegionTile *tile = iter.init(this->tileList, SkTInternalLList<RegionTile>::Iter::kHead_IterStart);
+  while (tile) {
+    if (tile->tx == tx && tile->ty == ty && tile->sampleSize == sampleSize) {
+      return tile;
+    }
+    tile = iter.next();
+  }
+  return NULL;
+}
+
+// One pass over the rows down to the lowest missing tile. Sampled pixels
+// are taken from the middle of each sampleSize square, the way
+// SkScaledBitmapSampler does.
+bool RegionImage::decodeTiles(RegionTile **missing, int count) {
+  int sampleSize = missing[0]->sampleSize;
+  int half = sampleSize / 2;
+  int tileSize = this->tileSize;
+
+  int lastRow = 0;
+  for (int i = 0; i<count; i++) {
+    RegionTile *tile = missing[i];
+    int bottom = tile->ty * tileSize + tile->bitmap.height() - 1;
+    lastRow = SkMax32(lastRow, bottom * sampleSize + half);
+    tile->bitmap.lockPixels();
+  }
+
+  png_structp png = png_create_read_struct(PNG_LIBPNG_VER_STRING, NULL, NULL, NULL);
+  png_infop info = png ? png_create_info_struct(png) : NULL;
+  if (!info) {
+    png_destroy_read_struct(&png, NULL, NULL);
+    return false;
+  }
+
+  PngSource source = { this->data->bytes(), this->data->size(), 0 };
+  SkAutoMalloc row((size_t)this->width * 4);
+  SkAutoMalloc sampled((size_t)tileSize * 4);
+
+  if (setjmp(png_jmpbuf(png))) {
+    png_destroy_read_struct(&png, &info, NULL);
+    return false;
+  }
+
+  png_set_read_fn(png, &source, readPng);
+  png_read_info(png, info);
+  setRGBATransforms(png);
+  png_read_update_info(png, info);
+  if (png_get_rowbytes(png, info) != (png_size_t)this->width * 4) {
+    png_error(png, "unexpected row size");
+  }
+
+  uint8_t *rgba = (uint8_t *)row.get();
+  for (int y = 0; y <= lastRow; y++) {
+    png_read_row(png, rgba, NULL);
+    if (y % sampleSize != half) {
+      continue;
+    }
+
+    int sy = y / sampleSize;
+    for (int i = 0; i<count; i++) {
+      RegionTile *tile = missing[i];
+      int top = tile->ty * tileSize;
+      if (sy < top || sy >= top + tile->bitmap.height()) {
+        continue;
+      }
+
+      int left = tile->tx * tileSize;
+      int w = tile->bitmap.width();
+      SkPMColor *dst = tile->bitmap.getAddr32(0, sy - top);
+
+      if (sampleSize == 1) {
+        PremultiplyRow(dst, rgba + left * 4, w);
+        continue;
+      }
+
+      uint32_t *src = (uint32_t *)rgba;
+      uint32_t *gathered = (uint32_t *)sampled.get();
+      for (int x = 0; x<w; x++) {
+        gathered[x] = src[SkMin32((left + x) * sampleSize + half, this->width - 1)];
+      }
+      PremultiplyRow(dst, (uint8_t *)gathered, w);
+    }
+  }
+
+  png_destroy_read_struct(&png, &info, NULL);
+
+  for (int i = 0; i<count; i++) {
+    missing[i]->bitmap.unlockPixels();
+    missing[i]->bitmap.setImmutable();
+  }
+  return true;
+}
+
+bool RegionImage::getRegion(const SkRect &srcRect, const SkSize &destSize,
+                            SkBitmap *out, SkRect *outRect)
+{
+  DecodeOptions options;
+  options.width = SkMax32(SkScalarCeilToInt(destSize.width()), 1);
+  options.height = SkMax32(SkScalarCeilToInt(destSize.height()), 1);
+  int sampleSize = ChooseSampleSize(SkScalarCeilToInt(srcRect.width()),
+                                    SkScalarCeilToInt(srcRect.height()),
+                                    options);
+
+  SkScalar scale = SK_Scalar1 / sampleSize;
+  SkRect sampled = SkRect::MakeLTRB(
+    srcRect.fLeft * scale, srcRect.fTop * scale,
+    srcRect.fRight * scale, srcRect.fBottom * scale
+  );
+
+  SkIRect area;
+  sampled.roundOut(&area);
+  if (!area.intersect(0, 0, SkMax32(this->width / sampleSize, 1),
+                            SkMax32(this->height / sampleSize, 1))) {
+    out->reset();
+    return true;
+  }
+
+  int tileSize = this->tileSize;
+  int left = area.fLeft / tileSize, right = (area.fRight - 1) / tileSize;
+  int top = area.fTop / tileSize, bottom = (area.fBottom - 1) / tileSize;
+  int count = (right - left + 1) * (bottom - top + 1);
+
+  SkAutoTMalloc<RegionTile *> used(count);
+  SkAutoTMalloc<RegionTile *> missing(count);
+  int missed = 0;
+
+  int n = 0;
+  for (int ty = top; ty <= bottom; ty++) {
+    for (int tx = left; tx <= right; tx++) {
+      RegionTile *tile = this->findTile(tx, ty, sampleSize);
+      if (tile) {
+        this->hits++;
+        this->tileList.remove(tile);
+        this->tileList.addToHead(tile);
+      } else {
+        this->misses++;
+        tile = SkNEW(RegionTile);
+        tile->tx = tx;
+        tile->ty = ty;
+        tile->sampleSize = sampleSize;
+        tile->bitmap.setConfig(
+          SkBitmap::kARGB_8888_Config,
+          SkMin32(tileSize, SkMax32(this->width / sampleSize, 1) - tx * tileSize),
+          SkMin32(tileSize, SkMax32(this->height / sampleSize, 1) - ty * tileSize)
+        );
+        missing[missed++] = tile;
+      }
+      used[n++] = tile;
+    }
+  }
+
+  bool ok = true;
+  for (int i = 0; ok && i<missed; i++) {
+    ok = missing[i]->bitmap.allocPixels();
+  }
+
+  if (!ok || (missed && !this->decodeTiles(missing.get(), missed))) {
+    for (int i = 0; i<missed; i++) {
+      SkDELETE(missing[i]);
+    }
+    Nan::ThrowError(ok ? "could not decode image region" : "could not allocate image region");
+    return false;
+  }
+
+  for (int i = 0; i<missed; i++) {
+    this->tileList.addToHead(missing[i]);
+    this->tiles++;
+  }
+
+  out->setConfig(SkBitmap::kARGB_8888_Config, area.width(), area.height());
+  if (!out->allocPixels()) {
+    Nan::ThrowError("could not allocate image region");
+    return false;
+  }
+
+  SkCanvas canvas(*out);
+  SkPaint paint;
+  paint.setXfermodeMode(SkXfermode::kSrc_Mode);
+  for (int i = 0; i<count; i++) {
+    canvas.drawBitmap(
+      used[i]->bitmap,
+      SkIntToScalar(used[i]->tx * tileSize - area.fLeft),
+      SkIntToScalar(used[i]->ty * tileSize - area.fTop),
+      &paint
+    );
+  }
+
+  // only now, a single draw may need more tiles than the cache keeps
+  this->purge(this->maxTiles);
+
+  *outRect = sampled;
+  outRect->offset(SkIntToScalar(-area.fLeft), SkIntToScalar(-area.fTop));
+  return true;
+}
+
+void RegionImage::New(const Nan::FunctionCallbackInfo<Value>& info) {
+  uint8_t *bytes;
+  size_t length;
+  if (!GetPixelData(info[0], &bytes, &length)) {
+    return Nan::ThrowTypeError("First argument needs to be a Buffer or a typed array");
+  }
+
+  int tileSize = 256;
+  uint32_t maxTiles = 64;
+  if (info[1]->IsObject()) {
+    Local<Object> options = info[1]->ToObject();
+    Local<Value> v = options->Get(Nan::New("tileSize").ToLocalChecked());
+    if (!v->IsUndefined()) {
+      tileSize = v->Int32Value();
+      if (!v->IsNumber() || tileSize < 16) {
+        return Nan::ThrowRangeError("tileSize needs to be 16 or more");
+      }
+    }
+
+    v = options->Get(Nan::New("maxTiles").ToLocalChecked());
+    if (!v->IsUndefined()) {
+      if (!v->IsNumber() || v->Int32Value() < 1) {
+        return Nan::ThrowRangeError("maxTiles needs to be 1 or more");
+      }
+      maxTiles = v->Uint32Value();
+    }
+  }
+
+  if (length < 8 || png_sig_cmp(bytes, 0, 8)) {
+    return Nan::ThrowError("region images need a PNG");
+  }
+
+  png_structp png = png_create_read_struct(PNG_LIBPNG_VER_STRING, NULL, NULL, NULL);
+  png_infop info_ptr = png ? png_create_info_struct(png) : NULL;
+  if (!info_ptr) {
+    png_destroy_read_struct(&png, NULL, NULL);
+    return Nan::ThrowError("could not decode image");
+  }
+
+  PngSource source = { bytes, length, 0 };
+  if (setjmp(png_jmpbuf(png))) {
+    png_destroy_read_struct(&png, &info_ptr, NULL);
+    return Nan::ThrowError("could not decode image");
+  }
+
+  png_set_read_fn(png, &source, readPng);
+  png_read_info(png, info_ptr);
+
+  png_uint_32 width = png_get_image_width(png, info_ptr);
+  png_uint_32 height = png_get_image_height(png, info_ptr);
+  int interlace = png_get_interlace_type(png, info_ptr);
+  png_destroy_read_struct(&png, &info_ptr, NULL);
+
+  if (interlace != PNG_INTERLACE_NONE) {
+    return Nan::ThrowError("region images need a non-interlaced PNG");
+  }
+
+  if (!width || !height || width > 0x7fffffff / 4 || height > 0x7fffffff) {
+    return Nan::ThrowRangeError("invalid image dimensions");
+  }
+
+  RegionImage *image = new RegionImage();
+  image->data = SkData::NewWithCopy(bytes, length);
+  image->width = (int)width;
+  image->height = (int)height;
+  image->tileSize = tileSize;
+  image->maxTiles = maxTiles;
+
+  image->Wrap(info.This());
+  info.This()->Set(Nan::New("width").ToLocalChecked(), Nan::New((uint32_t)width));
+  info.This()->Set(Nan::New("height").ToLocalChecked(), Nan::New((uint32_t)height));
+  info.GetReturnValue().Set(info.This());
+}
+
+// close(): frees the encoded data and the tiles, drawing it afterwards
+// throws
+void RegionImage::Close(const Nan::FunctionCallbackInfo<Value>& info) {
+  RegionImage *image = ObjectWrap::Unwrap<RegionImage>(info.This());
+
+  image->purge(0);
+  SkSafeUnref(image->data);
+  image->data = NULL;
+  info.This()->Set(Nan::New("width").ToLocalChecked(), Nan::New(0));
+  info.This()->Set(Nan::New("height").ToLocalChecked(), Nan::New(0));
+}
+
+void RegionImage::CacheStats(const Nan::FunctionCallbackInfo<Value>& info) {
+  RegionImage *image = ObjectWrap::Unwrap<RegionImage>(info.This());
+
+  Local<Object> stats = Nan::New<Object>();
+  stats->Set(Nan::New("hits").ToLocalChecked(), Nan::New(image->hits));
+  stats->Set(Nan::New("misses").ToLocalChecked(), Nan::New(image->misses));
+  stats->Set(Nan::New("evictions").ToLocalChecked(), Nan::New(image->evictions));
+  stats->Set(Nan::New("tiles").ToLocalChecked(), Nan::New(image->tiles));
+  stats->Set(Nan::New("limit").ToLocalChecked(), Nan::New(image->maxTiles));
+  info.GetReturnValue().Set(stats);
+}
@@ -0,0 +1,78 @@
+#ifndef _REGIONIMAGE_H_
+#define _REGIONIMAGE_H_
+
+#include <node.h>
+#include <nan.h>
+#include <SkBitmap.h>
+#include <SkData.h>
+#include <SkRect.h>
+#include <SkTInternalLList.h>
+
+using namespace node;
+using namespace v8;
+
+// A decoded tile of a RegionImage, tileSize square at sampleSize except
+// along the right and bottom edges
+class RegionTile {
+  public:
+    int tx, ty, sampleSize;
+    SkBitmap bitmap;
+
+  private:
+    SK_DECLARE_INTERNAL_LLIST_INTERFACE(RegionTile);
+};
+
+// An encoded image that drawImage decodes a piece at a time. Only the
+// tiles under the source rect are decoded, at the coarsest power of two
+// sample size the destination allows, and the most recently drawn ones are
+// kept for the next draw.
+//
+//   new RegionImage(buffer, { tileSize: 256, maxTiles: 64 })
+//
+// buffer holds a non-interlaced PNG and is copied. This Skia only indexes
+// PNG and JPEG for random access on Android, so rows are streamed with
+// libpng instead: a miss reads rows from the top down to the lowest
+// missing tile, keeping just the columns of the missing tiles.
+//
+//   close(): drops the encoded data and the tiles
+//   cacheStats(): { hits, misses, evictions, tiles, limit }
+class RegionImage : public Nan::ObjectWrap {
+  public:
+    static void Init(Handle<Object> exports);
+    static bool HasInstance(Local<Value> value);
+
+    // Fills out with the pixels under srcRect, rounded out to whole
+    // pixels, at a sample size that still covers destSize device pixels.
+    // srcRect comes back mapped into out. Throws and returns false on
+    // failure.
+    bool getRegion(const SkRect &srcRect, const SkSize &destSize,
+                   SkBitmap *out, SkRect *outRect);
+
+    bool isClosed() const { return !this->data; }
+
+  private:
+    RegionImage() : data(NULL), width(0), height(0), tileSize(256), maxTiles(64),
+                    tiles(0), hits(0), misses(0), evictions(0) {}
+    ~RegionImage();
+
+    RegionTile *findTile(int tx, int ty, int sampleSize);
+    bool decodeTiles(RegionTile **missing, int count);
+    void purge(uint32_t limit);
+
+    static Nan::Persistent<FunctionTemplate> constructorTemplate;
+    static NAN_METHOD(New);
+    static NAN_METHOD(Close);
+    static NAN_METHOD(CacheStats);
+
+    SkData *data;
+    int width, height;
+    int tileSize;
+    uint32_t maxTiles;
+
+    // most recently used at the head
+    SkTInternalLList<RegionTile> tileList;
+    uint32_t tiles;
+    double hits, misses, evictions;
+};
+
+#endif
@@ -0,0 +1,174 @@
+#include "surfacepool.h"
+
+#include <SkTDArray.h>
+#include <SkRegion.h>
+
+#define DEFAULT_POOL_PER_SIZE 4
+#define DEFAULT_POOL_MAX_BYTES (64 * 1024 * 1024)
+
+struct PooledSurface {
+  SkBitmap bitmap;
+  SkDevice *device;
+  SkCanvas *canvas;
+};
+
+SurfaceDevice::SurfaceDevice(const SkBitmap &bitmap)
+  : SkDevice(bitmap), replacing(false)
+{
+}
+
+void SurfaceDevice::replaceBitmap(const SkBitmap &bitmap) {
+  this->replacement = bitmap;
+  this->replacing = true;
+  this->accessBitmap(false);
+}
+
+// SkDevice hands its own bitmap to this hook, which is the only way to
+// change the backend of a plain raster device from outside Skia
+const SkBitmap& SurfaceDevice::onAccessBitmap(SkBitmap *bitmap) {
+  if (this->replacing) {
+    *bitmap = this->replacement;
+    bitmap->lockPixels();
+    this->replacement.reset();
+    this->replacing = false;
+  }
+  return *bitmap;
+}
+
+// oldest first
+static SkTDArray<PooledSurface *> pool;
+
+static SurfacePool::Stats stats = {
+  0, 0, 0, 0,
+  0,
+  0,
+  DEFAULT_POOL_PER_SIZE,
+  DEFAULT_POOL_MAX_BYTES
+};
+
+static void freeSurface(PooledSurface *surface) {
+  SkSafeUnref(surface->canvas);
+  SkSafeUnref(surface->device);
+  SkDELETE(surface);
+}
+
+static void removeAt(int index) {
+  PooledSurface *surface = pool[index];
+  pool.remove(index);
+  stats.entries--;
+  stats.bytes -= surface->bitmap.getSize();
+  freeSurface(surface);
+}
+
+// drop the oldest entries until the pool fits in maxBytes
+static void trim() {
+  while (pool.count() && stats.bytes > stats.maxBytes) {
+    removeAt(0);
+  }
+}
+
+bool SurfacePool::Acquire(uint32_t w, uint32_t h,
+                          SkBitmap *bitmap,
+                          SkDevice **device,
+                          SkCanvas **canvas)
+{
+  // most recently released first, its pixels are more likely to be warm
+  for (int i = pool.count() - 1; i >= 0; i--) {
+    PooledSurface *surface = pool[i];
+    if ((uint32_t)surface->bitmap.width() != w ||
+        (uint32_t)surface->bitmap.height() != h)
+    {
+      continue;
+    }
+
+    pool.remove(i);
+    stats.entries--;
+    stats.bytes -= surface->bitmap.getSize();
+    stats.hits++;
+
+    SkCanvas *c = surface->canvas;
+    c->restoreToCount(1);
+    c->resetMatrix();
+    c->clipRect(SkRect::MakeWH(SkIntToScalar(w), SkIntToScalar(h)), SkRegion::kReplace_Op);
+
+    *bitmap = surface->bitmap;
+    *device = surface->device;
+    *canvas = c;
+
+    SkDELETE(surface);
+    return true;
+  }
+
+  stats.misses++;
+  return false;
+}
+
+void SurfacePool::Release(const SkBitmap &bitmap, SkDevice *device, SkCanvas *canvas) {
+  PooledSurface *surface = SkNEW(PooledSurface);
+  surface->bitmap = bitmap;
+  surface->device = device;
+  surface->canvas = canvas;
+
+  size_t size = bitmap.getSize();
+  if (!canvas || !size || size > stats.maxBytes) {
+    stats.discarded++;
+    freeSurface(surface);
+    return;
+  }
+
+  int sameSize = 0, oldest = -1;
+  for (int i = 0; i<pool.count(); i++) {
+    if (pool[i]->bitmap.width() == bitmap.width() &&
+        pool[i]->bitmap.height() == bitmap.height())
+    {
+      if (oldest < 0) {
+        oldest = i;
+      }
+      sameSize++;
+    }
+  }
+
+  if (sameSize >= (int)stats.perSize) {
+    if (oldest < 0) {
+      // perSize is 0, pooling is disabled
+      stats.discarded++;
+      freeSurface(surface);
+      return;
+    }
+    removeAt(oldest);
+  }
+
+  *pool.append() = surface;
+  stats.entries++;
+  stats.bytes += size;
+  stats.released++;
+
+  trim();
+}
+
+void SurfacePool::Configure(uint32_t perSize, size_t maxBytes) {
+  stats.perSize = perSize;
+  stats.maxBytes = maxBytes;
+
+  // enforce the new per size capacity, keeping the newest entries
+  for (int i = pool.count() - 1; i >= 0; i--) {
+    uint32_t newer = 0;
+    for (int j = i + 1; j<pool.count(); j++) {
+      if (pool[j]->bitmap.width() == pool[i]->bitmap.width() &&
+          pool[j]->bitmap.height() == pool[i]->bitmap.height())
+      {
+        newer++;
+      }
+    }
+
+    if (newer >= perSize) {
+      removeAt(i);
+    }
+  }
+
+  trim();
+}
+
+const SurfacePool::Stats &SurfacePool::GetStats() {
+  return stats;
+}
@@ -0,0 +1,61 @@
+#ifndef _SURFACEPOOL_H_
+#define _SURFACEPOOL_H_
+
+#include <SkBitmap.h>
+#include <SkCanvas.h>
+#include <SkDevice.h>
+
+// Raster device whose pixels can be swapped for a copy of the same size.
+// A context moves onto a private copy this way before drawing over pixels
+// that a zero-copy buffer still aliases (see Context2D::aboutToDraw); the
+// canvas keeps its matrix, clip and save stack.
+class SurfaceDevice : public SkDevice {
+  public:
+    SurfaceDevice(const SkBitmap &bitmap);
+
+    // takes effect on the next accessBitmap(), which this calls
+    void replaceBitmap(const SkBitmap &bitmap);
+
+  protected:
+    virtual const SkBitmap& onAccessBitmap(SkBitmap *bitmap) SK_OVERRIDE;
+
+  private:
+    SkBitmap replacement;
+    bool replacing;
+};
+
+// Recycles the raster backing (pixels, device and canvas) of contexts
+// that went away so a context of the same size can skip allocPixels and
+// the page faults that come with touching fresh memory.
+//
+// Surfaces are bucketed by size; each size keeps at most perSize entries
+// and the whole pool stays under maxBytes of pixels, dropping the least
+// recently released surfaces first. Main thread only.
+class SurfacePool {
+  public:
+    // Fills in bitmap/device/canvas from the pool, with the matrix, clip
+    // and save stack reset. The caller takes over the device and canvas
+    // refs. Returns false if nothing of that size is pooled.
+    static bool Acquire(uint32_t w, uint32_t h,
+                        SkBitmap *bitmap,
+                        SkDevice **device,
+                        SkCanvas **canvas);
+
+    // Hands a surface back, taking over the device and canvas refs. The
+    // surface is freed instead when it does not fit in the pool.
+    static void Release(const SkBitmap &bitmap, SkDevice *device, SkCanvas *canvas);
+
+    static void Configure(uint32_t perSize, size_t maxBytes);
+
+    struct Stats {
+      double hits, misses, released, discarded;
+      uint32_t entries;
+      size_t bytes;
+      uint32_t perSize;
+      size_t maxBytes;
+    };
+
+    static const Stats &GetStats();
+};
+
+#endif
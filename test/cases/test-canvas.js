@@ -34,3 +34,494 @@ test(module, '2d.canvas.reference',null, function(t) {
   t.done()
 });
 
+
+test(module, 'context2d.pool.reuse',null, function(t) {
+  var context2d = require('../../context2d');
+
+  var ctx = context2d.acquire(37, 19);
+  ctx.fillStyle = '#f00';
+  ctx.translate(5, 5);
+  ctx.fillRect(0, 0, 37, 19);
+
+  // the empty surface release() leaves behind is no pool miss
+  var before = context2d.poolStats();
+  ctx.release();
+  helpers.assertEqual(t, ctx.width, 0, "ctx.width", "0");
+
+  ctx = context2d.acquire(37, 19);
+  var after = context2d.poolStats();
+
+  helpers.assertEqual(t, after.hits - before.hits, 1, "after.hits - before.hits", "1");
+  helpers.assertEqual(t, after.misses - before.misses, 0, "after.misses - before.misses", "0");
+
+  // pixels are cleared and the matrix is reset on reuse
+  var data = ctx.getImageData(0, 0, 37, 19).data;
+  helpers.assertEqual(t, data[3], 0, "data[3]", "0");
+
+  ctx.fillStyle = '#0f0';
+  ctx.fillRect(0, 0, 1, 1);
+  data = ctx.getImageData(0, 0, 1, 1).data;
+  helpers.assertEqual(t, data[1], 255, "data[1]", "255");
+  ctx.release();
+
+  t.done()
+});
+
+
+test(module, 'context2d.toBuffer.shared',null, function(t) {
+  var context2d = require('../../context2d');
+
+  var ctx = context2d.acquire(4, 4);
+  ctx.fillStyle = '#f00';
+  ctx.fillRect(0, 0, 4, 4);
+
+  var shared = ctx.toBuffer({ copy: false });
+  var copy = ctx.toBuffer();
+  helpers.assertEqual(t, shared.length, copy.length, "shared.length", "copy.length");
+  helpers.assertEqual(t, shared[3], copy[3], "shared[3]", "copy[3]");
+
+  // drawing after sharing leaves the shared frame untouched
+  ctx.clearRect(0, 0, 4, 4);
+  helpers.assertEqual(t, shared[3], 255, "shared[3]", "255");
+  helpers.assertEqual(t, ctx.toBuffer()[3], 0, "ctx.toBuffer()[3]", "0");
+  ctx.release();
+
+  t.done()
+});
+
+
+test(module, 'context2d.toPngBufferAsync',null, function(t) {
+  var context2d = require('../../context2d');
+
+  var ctx = context2d.acquire(16, 16);
+  ctx.fillStyle = '#f00';
+  ctx.fillRect(0, 0, 16, 16);
+
+  var expected = ctx.toPngBuffer();
+
+  ctx.toPngBufferAsync(function(err, png) {
+    helpers.ok(t, !err, "no error");
+    helpers.assertEqual(t, png.toString('hex', 1, 4), '504e47', "png signature", "PNG");
+
+    // encoded from the frame as it was when the encode was queued
+    helpers.ok(t, png.equals(expected), "matches the synchronous encode");
+    ctx.release();
+
+    t.done()
+  });
+
+  // drawing goes on while the encode runs
+  ctx.clearRect(0, 0, 16, 16);
+  helpers.assertEqual(t, ctx.getPixel(0, 0).a, 0, "getPixel(0, 0).a", "0");
+});
+
+
+test(module, 'context2d.toPngBuffer.options',null, function(t) {
+  var context2d = require('../../context2d');
+
+  var ctx = context2d.acquire(64, 64);
+  ctx.fillStyle = '#369';
+  ctx.fillRect(0, 0, 64, 64);
+
+  // byte 25 is the IHDR color type: 6 is RGBA, 2 is RGB
+  var png = ctx.toPngBuffer();
+  helpers.assertEqual(t, png[25], 6, "color type", "6");
+  helpers.assertEqual(t, png.toString('ascii', png.length - 8, png.length - 4), 'IEND', "last chunk", "IEND");
+
+  var smallest = ctx.toPngBuffer({ preset: 'smallest' });
+  helpers.assertEqual(t, smallest[25], 2, "color type", "2");
+  helpers.ok(t, smallest.length <= png.length, "smallest is not larger than the default");
+
+  var fastest = ctx.toPngBuffer({ preset: 'fastest', filters: ['none', 'up'] });
+  helpers.assertEqual(t, fastest.toString('hex', 1, 4), '504e47', "png signature", "PNG");
+
+  // alpha is only dropped when nothing is translucent
+  ctx.clearRect(0, 0, 1, 1);
+  helpers.assertEqual(t, ctx.toPngBuffer({ dropAlpha: true })[25], 6, "color type", "6");
+
+  try {
+    ctx.toPngBuffer({ strategy: 'fast' });
+    helpers.ok(t, false, "should have thrown exception");
+  } catch (e) {
+    helpers.ok(t, e instanceof RangeError, "should throw RangeError");
+  }
+
+  ctx.release();
+  t.done()
+});
+
+
+test(module, 'context2d.toJpegBuffer.toWebpBuffer',null, function(t) {
+  var context2d = require('../../context2d');
+
+  var ctx = context2d.acquire(16, 16);
+  ctx.fillStyle = '#369';
+  ctx.fillRect(0, 0, 16, 16);
+
+  helpers.ok(t, context2d.encoders.png, "png is always available");
+
+  if (context2d.encoders.jpeg) {
+    var jpeg = ctx.toJpegBuffer(90);
+    helpers.assertEqual(t, jpeg.toString('hex', 0, 2), 'ffd8', "jpeg marker", "ffd8");
+  } else {
+    try {
+      ctx.toJpegBuffer();
+      helpers.ok(t, false, "should have thrown exception");
+    } catch (e) {
+      helpers.ok(t, e instanceof Error, "should throw without a jpeg encoder");
+    }
+  }
+
+  if (context2d.encoders.webp) {
+    var webp = ctx.toWebpBuffer();
+    helpers.assertEqual(t, webp.toString('ascii', 8, 12), 'WEBP', "webp header", "WEBP");
+  }
+
+  try {
+    ctx.toJpegBuffer(101);
+    helpers.ok(t, false, "should have thrown exception");
+  } catch (e) {
+    helpers.ok(t, e instanceof RangeError, "should throw RangeError");
+  }
+
+  ctx.release();
+  t.done()
+});
+
+
+test(module, 'context2d.createPNGStream.writePngToFd',null, function(t) {
+  var context2d = require('../../context2d');
+  var fs = require('fs');
+  var os = require('os');
+  var path = require('path');
+
+  var ctx = context2d.acquire(64, 64);
+  ctx.fillStyle = '#369';
+  ctx.fillRect(0, 0, 64, 32);
+  ctx.fillStyle = 'rgba(200, 100, 50, 0.5)';
+  ctx.fillRect(0, 16, 64, 48);
+
+  var expected = ctx.toPngBuffer();
+
+  var file = path.join(os.tmpdir(), 'context2d-' + process.pid + '.png');
+  var fd = fs.openSync(file, 'w');
+  var written = ctx.writePngToFd(fd);
+  fs.closeSync(fd);
+
+  helpers.assertEqual(t, written, expected.length, "bytes written", "expected.length");
+  helpers.ok(t, fs.readFileSync(file).equals(expected), "file matches toPngBuffer");
+  fs.unlinkSync(file);
+
+  var chunks = [];
+  var stream = ctx.createPNGStream();
+
+  // the stream keeps the frame it was created from
+  ctx.clearRect(0, 0, 64, 64);
+
+  stream.on('data', function(chunk) {
+    chunks.push(chunk);
+  });
+
+  stream.on('end', function() {
+    helpers.ok(t, chunks.length > 1, "header comes out on its own");
+    helpers.ok(t, Buffer.concat(chunks).equals(expected), "stream matches toPngBuffer");
+    ctx.release();
+    t.done()
+  });
+});
+
+
+test(module, 'context2d.writePngToFdAsync',null, function(t) {
+  var context2d = require('../../context2d');
+  var fs = require('fs');
+  var os = require('os');
+  var path = require('path');
+
+  var ctx = context2d.acquire(16, 16);
+  ctx.fillStyle = '#369';
+  ctx.fillRect(0, 0, 16, 8);
+
+  var expected = ctx.toPngBuffer();
+  var file = path.join(os.tmpdir(), 'context2d-async-' + process.pid + '.png');
+  var fd = fs.openSync(file, 'w');
+
+  ctx.writePngToFdAsync(fd, function(err, written) {
+    fs.closeSync(fd);
+    helpers.ok(t, !err, "no error");
+    helpers.assertEqual(t, written, expected.length, "bytes written", "expected.length");
+
+    var png = fs.readFileSync(file);
+    fs.unlinkSync(file);
+
+    context2d.decodeImage(png, function(err, image) {
+      helpers.ok(t, !err, "file decodes");
+      var out = context2d.acquire(16, 16);
+      out.drawImage(image, 0, 0);
+      helpers.assertEqual(t, out.getImageData(4, 4, 1, 1).data[2], 0x99, "blue at 4,4", "0x99");
+      helpers.assertEqual(t, out.getImageData(4, 12, 1, 1).data[3], 0, "alpha at 4,12", "0");
+
+      out.release();
+      ctx.release();
+      t.done()
+    });
+  });
+});
+
+
+test(module, 'context2d.toPngBuffer.threads',null, function(t) {
+  var context2d = require('../../context2d');
+  var zlib = require('zlib');
+
+  var ctx = context2d.acquire(64, 200);
+  ctx.fillStyle = '#369';
+  ctx.fillRect(0, 0, 64, 100);
+  ctx.fillStyle = 'rgba(200, 100, 50, 0.5)';
+  ctx.fillRect(16, 50, 32, 150);
+
+  var png = ctx.toPngBuffer({ threads: 4 });
+
+  // walk the chunks, the strips each get an IDAT of one zlib stream
+  var offset = 8, idat = [], types = [];
+  while (offset < png.length) {
+    var length = png.readUInt32BE(offset);
+    var type = png.toString('ascii', offset + 4, offset + 8);
+    types.push(type);
+    if (type === 'IDAT') {
+      idat.push(png.slice(offset + 8, offset + 8 + length));
+    }
+    offset += length + 12;
+  }
+
+  helpers.assertEqual(t, types[0], 'IHDR', "first chunk", "IHDR");
+  helpers.assertEqual(t, types[types.length - 1], 'IEND', "last chunk", "IEND");
+  helpers.assertEqual(t, idat.length, 4, "IDAT chunks", "4");
+
+  // inflateSync checks the combined adler32
+  var raw = zlib.inflateSync(Buffer.concat(idat));
+  helpers.assertEqual(t, raw.length, 200 * (64 * 4 + 1), "raw length", "200 * (64 * 4 + 1)");
+
+  // the strips must decode to the same pixels as the serial encoder's
+  var serial = ctx.toPngBuffer();
+  ctx.release();
+
+  function pixels(buffer, fn) {
+    context2d.decodeImage(buffer, function(err, image) {
+      helpers.ok(t, !err, "png decodes");
+      var out = context2d.acquire(64, 200);
+      out.drawImage(image, 0, 0);
+      var data = out.getImageData(0, 0, 64, 200).data;
+      out.release();
+      fn(data);
+    });
+  }
+
+  pixels(png, function(parallel) {
+    pixels(serial, function(expected) {
+      var same = parallel.length === expected.length;
+      for (var i = 0; same && i < expected.length; i++) {
+        same = parallel[i] === expected[i];
+      }
+      helpers.ok(t, same, "parallel pixels match the serial encoder");
+      t.done()
+    });
+  });
+});
+
+
+test(module, 'context2d.toBuffer.format',null, function(t) {
+  var context2d = require('../../context2d');
+
+  var ctx = context2d.acquire(2, 1);
+  ctx.fillStyle = '#ff8000';
+  ctx.fillRect(0, 0, 1, 1);
+  ctx.fillStyle = 'rgba(255, 0, 0, 0.5)';
+  ctx.fillRect(1, 0, 1, 1);
+
+  var rgba = ctx.toBuffer({ format: 'rgba8888' });
+  helpers.assertEqual(t, rgba.length, 8, "rgba.length", "8");
+  helpers.assertEqual(t, rgba[1], 128, "rgba[1]", "128");
+  helpers.assertEqual(t, rgba[4], 255, "rgba[4]", "255");
+  helpers.assertEqual(t, rgba[7], 128, "rgba[7]", "128");
+
+  var premultiplied = ctx.toBuffer({ format: 'rgba8888', premultiplied: true });
+  helpers.assertEqual(t, premultiplied[4], 128, "premultiplied[4]", "128");
+
+  var rgb = ctx.toBuffer({ format: 'rgb888' });
+  helpers.assertEqual(t, rgb.length, 6, "rgb.length", "6");
+  helpers.assertEqual(t, rgb[3], 255, "rgb[3]", "255");
+
+  var rgb565 = ctx.toBuffer({ format: 'rgb565' });
+  helpers.assertEqual(t, rgb565.readUInt16LE(0), 0xfc00, "rgb565.readUInt16LE(0)", "0xfc00");
+
+  var a8 = ctx.toBuffer({ format: 'a8' });
+  helpers.assertEqual(t, a8.length, 2, "a8.length", "2");
+  helpers.assertEqual(t, a8[0], 255, "a8[0]", "255");
+  helpers.assertEqual(t, a8[1], 128, "a8[1]", "128");
+
+  try {
+    ctx.toBuffer({ format: 'bgr233' });
+    helpers.ok(t, false, "should have thrown exception");
+  } catch (e) {
+    helpers.ok(t, e instanceof RangeError, "should throw RangeError");
+  }
+
+  ctx.release();
+  t.done()
+});
+
+
+test(module, 'context2d.drawPicture',null, function(t) {
+  var context2d = require('../../context2d');
+
+  var ctx = context2d.acquire(20, 10);
+  var pixel = function(ctx, x, y) {
+    var d = ctx.getImageData(x, y, 1, 1).data;
+    return [d[0], d[1], d[2], d[3]].join(',');
+  };
+
+  ctx.fillStyle = '#f00';
+  ctx.fillRect(0, 0, 20, 10);
+
+  // left open on purpose, endRecording() restores it
+  ctx.beginRecording();
+  ctx.save();
+  ctx.fillStyle = '#00f';
+  ctx.fillRect(0, 0, 5, 5);
+  var picture = ctx.endRecording();
+
+  helpers.assertEqual(t, picture.width, 20, "picture.width", "20");
+  helpers.assertEqual(t, pixel(ctx, 2, 2), '255,0,0,255', "2,2 before playback", "255,0,0,255");
+
+  ctx.drawPicture(picture);
+  ctx.drawPicture(picture, [1, 0, 0, 1, 10, 5]);
+  helpers.assertEqual(t, pixel(ctx, 2, 2), '0,0,255,255', "2,2", "0,0,255,255");
+  helpers.assertEqual(t, pixel(ctx, 12, 7), '0,0,255,255', "12,7", "0,0,255,255");
+  helpers.assertEqual(t, pixel(ctx, 7, 2), '255,0,0,255', "7,2", "255,0,0,255");
+
+  // the fill style the recording set was restored with the save()
+  ctx.fillRect(15, 0, 5, 5);
+  helpers.assertEqual(t, pixel(ctx, 17, 2), '255,0,0,255', "17,2", "255,0,0,255");
+
+  // plays back onto other contexts, through their transform
+  var other = context2d.acquire(10, 10);
+  other.scale(2, 2);
+  other.drawPicture(picture);
+  helpers.assertEqual(t, pixel(other, 9, 9), '0,0,255,255', "other 9,9", "0,0,255,255");
+
+  try {
+    ctx.endRecording();
+    helpers.ok(t, false, "should have thrown exception");
+  } catch (e) {
+    helpers.ok(t, true, "not recording");
+  }
+
+  picture.close();
+  other.release();
+  ctx.release();
+  t.done()
+});
+
+
+test(module, 'context2d.drawPicture.resize',null, function(t) {
+  var context2d = require('../../context2d');
+
+  var ctx = context2d.acquire(20, 10);
+  ctx.fillStyle = '#f00';
+  ctx.save();
+  ctx.fillStyle = '#0f0';
+
+  // resizing ends the recording, the save() before it can be restored
+  ctx.beginRecording();
+  ctx.save();
+  ctx.width = 30;
+  ctx.restore();
+  helpers.assertEqual(t, ctx.fillStyle, '#ff0000', "fillStyle", "#ff0000");
+
+  ctx.fillRect(0, 0, 30, 10);
+  var d = ctx.getImageData(25, 5, 1, 1).data;
+  helpers.assertEqual(t, [d[0], d[1], d[2], d[3]].join(','), '255,0,0,255', "25,5", "255,0,0,255");
+
+  try {
+    ctx.endRecording();
+    helpers.ok(t, false, "should have thrown exception");
+  } catch (e) {
+    helpers.ok(t, true, "not recording");
+  }
+
+  // and so does release(), dropping the save() made inside the recording
+  ctx.fillStyle = '#00f';
+  ctx.beginRecording();
+  ctx.save();
+  ctx.fillStyle = '#ff0';
+  ctx.release();
+  helpers.assertEqual(t, ctx.fillStyle, '#0000ff', "fillStyle", "#0000ff");
+
+  ctx.width = 4;
+  ctx.height = 4;
+  ctx.fillRect(0, 0, 4, 4);
+  d = ctx.getImageData(2, 2, 1, 1).data;
+  helpers.assertEqual(t, [d[0], d[1], d[2], d[3]].join(','), '0,0,255,255', "2,2", "0,0,255,255");
+
+  ctx.release();
+  t.done()
+});
+
+
+test(module, 'context2d.drawPicture.shared',null, function(t) {
+  var context2d = require('../../context2d');
+
+  var ctx = context2d.acquire(4, 4);
+  ctx.fillStyle = '#f00';
+  ctx.fillRect(0, 0, 4, 4);
+  var shared = ctx.toBuffer({ copy: false });
+
+  // recorded drawing never reaches the surface, the buffer still aliases it
+  ctx.beginRecording();
+  ctx.fillStyle = '#00f';
+  ctx.fillRect(0, 0, 4, 4);
+  shared[3] = 0;
+  helpers.assertEqual(t, ctx.getImageData(0, 0, 1, 1).data[3], 0, "alpha at 0,0", "0");
+
+  // putImageData writes to the surface, so it still copies first
+  ctx.putImageData(ctx.createImageData(1, 1), 1, 0);
+  helpers.assertEqual(t, shared[7], 255, "shared[7]", "255");
+  helpers.assertEqual(t, ctx.getImageData(1, 0, 1, 1).data[3], 0, "alpha at 1,0", "0");
+
+  ctx.endRecording().close();
+  ctx.release();
+  t.done()
+});
+
+
+test(module, 'context2d.getPixels',null, function(t) {
+  var window = helpers.createWindow();
+  var document = window.document;
+
+  var canvas = helpers.createCanvas(t, document, 10, 10);
+  var ctx = canvas.getContext('2d')
+
+  ctx.fillStyle = '#f00';
+  ctx.fillRect(0, 0, 5, 10);
+  ctx.fillStyle = 'rgba(0, 0, 255, 0.5)';
+  ctx.fillRect(5, 0, 5, 10);
+
+  var xy = new Int32Array([1, 1, 7, 3, -1, 2, 10, 0]);
+  var rgba = ctx.getPixels(xy);
+  helpers.assertEqual(t, rgba.length, 16, "rgba.length", "16");
+
+  var p = ctx.getPixel(7, 3);
+  helpers.assertEqual(t, rgba[0], 255, "rgba[0]", "255");
+  helpers.assertEqual(t, rgba[3], 255, "rgba[3]", "255");
+  helpers.assertEqual(t, rgba[6], p.b, "rgba[6]", "p.b");
+  helpers.assertEqual(t, rgba[7], p.a, "rgba[7]", "p.a");
+
+  // out of bounds points read as transparent black
+  helpers.assertEqual(t, rgba[11], 0, "rgba[11]", "0");
+  helpers.assertEqual(t, rgba[15], 0, "rgba[15]", "0");
+
+  var out = new Uint8Array(16);
+  helpers.assertEqual(t, ctx.getPixels(xy, out), out, "ctx.getPixels(xy, out)", "out");
+  helpers.assertEqual(t, out[4 + 2], rgba[6], "out[6]", "rgba[6]");
+
+  t.done()
+});
@@ -1085,3 +1085,329 @@ test(module, '2d.drawImage.zerosource','green-100x50.png', function(t) {
   });
 });
 
+
+
+test(module, 'context2d.drawImage.premultiplyCache',null, function(t) {
+  var window = helpers.createWindow();
+  var document = window.document;
+
+  var canvas = helpers.createCanvas(t, document, 4, 1);
+  var ctx = canvas.getContext('2d')
+
+  var data = new Buffer([
+    255, 0, 0, 255,   0, 255, 0, 128,   0, 0, 255, 0,   255, 255, 255, 255
+  ]);
+  var img = { width: 4, height: 1, imageData: { width: 4, height: 1, data: data } };
+
+  ctx.globalCompositeOperation = 'copy';
+  ctx.drawImage(img, 0, 0);
+  ctx.drawImage(img, 0, 0);
+
+  // the caller's pixels are left as they were
+  helpers.assertEqual(t, data[5], 255, "data[5]", "255");
+  helpers.assertEqual(t, data[7], 128, "data[7]", "128");
+  helpers.assertPixel(t, canvas, 0,0, 255,0,0,255, "0,0", "255,0,0,255");
+  helpers.assertPixelApprox(t, canvas, 1,0, 0,255,0,128, "1,0", "0,255,0,128", 2);
+
+  // in place edits are picked up once the generation changes
+  data[0] = 0;
+  data[2] = 255;
+  img.generation = 1;
+  ctx.drawImage(img, 0, 0);
+  helpers.assertPixel(t, canvas, 0,0, 0,0,255,255, "0,0", "0,0,255,255");
+
+  t.done()
+});
+
+test(module, 'context2d.drawImage.imageBitmap',null, function(t) {
+  var window = helpers.createWindow();
+  var document = window.document;
+
+  var canvas = helpers.createCanvas(t, document, 4, 1);
+  var ctx = canvas.getContext('2d')
+
+  var data = new Buffer([
+    255, 0, 0, 255,   0, 255, 0, 128,   0, 0, 255, 0,   255, 255, 255, 255
+  ]);
+  var bitmap = require('../../context2d').createImageBitmap({ width: 4, height: 1, data: data });
+
+  helpers.assertEqual(t, bitmap.width, 4, "bitmap.width", "4");
+  helpers.assertEqual(t, bitmap.height, 1, "bitmap.height", "1");
+
+  // the bitmap holds its own copy
+  data[0] = 0;
+
+  ctx.globalCompositeOperation = 'copy';
+  ctx.drawImage(bitmap, 0, 0);
+  ctx.drawImage(bitmap, 0, 0);
+
+  helpers.assertPixel(t, canvas, 0,0, 255,0,0,255, "0,0", "255,0,0,255");
+  helpers.assertPixelApprox(t, canvas, 1,0, 0,255,0,128, "1,0", "0,255,0,128", 2);
+  helpers.assertPixel(t, canvas, 3,0, 255,255,255,255, "3,0", "255,255,255,255");
+
+  bitmap.close();
+  helpers.assertEqual(t, bitmap.width, 0, "bitmap.width", "0");
+
+  try {
+    ctx.drawImage(bitmap, 0, 0);
+    helpers.ok(t, false, "should have thrown exception");
+  } catch (e) {
+    helpers.ok(t, e instanceof DOMException && e.code === DOMException.INVALID_STATE_ERR, "should throw INVALID_STATE_ERR");
+  }
+
+  t.done()
+});
+
+
+test(module, 'context2d.drawImage.context',null, function(t) {
+  var context2d = require('../../context2d');
+  var pixel = function(ctx, x, y) {
+    var d = ctx.getImageData(x, y, 1, 1).data;
+    return [d[0], d[1], d[2], d[3]].join(',');
+  };
+
+  var source = context2d.acquire(23, 11);
+  source.fillStyle = '#f00';
+  source.fillRect(0, 0, 23, 11);
+
+  var dest = context2d.acquire(23, 11);
+  dest.drawImage(source, 0, 0);
+  helpers.assertEqual(t, pixel(dest, 5, 5), '255,0,0,255', "dest 5,5", "255,0,0,255");
+
+  // the source draws on without copying its surface, which still pools
+  source.fillStyle = '#00f';
+  source.fillRect(0, 0, 23, 11);
+  helpers.assertEqual(t, pixel(source, 5, 5), '0,0,255,255', "source 5,5", "0,0,255,255");
+  helpers.assertEqual(t, pixel(dest, 5, 5), '255,0,0,255', "dest 5,5", "255,0,0,255");
+
+  var before = context2d.poolStats();
+  source.release();
+  source = context2d.acquire(23, 11);
+  var after = context2d.poolStats();
+  helpers.assertEqual(t, after.hits - before.hits, 1, "after.hits - before.hits", "1");
+
+  source.release();
+  dest.release();
+  t.done()
+});
+
+
+test(module, 'context2d.drawImage.decodeImage',null, function(t) {
+  var context2d = require('../../context2d');
+  var window = helpers.createWindow();
+  var document = window.document;
+
+  var canvas = helpers.createCanvas(t, document, 4, 1);
+  var ctx = canvas.getContext('2d')
+
+  var source = context2d.acquire(4, 1);
+  source.fillStyle = '#f00';
+  source.fillRect(0, 0, 2, 1);
+  source.fillStyle = 'rgba(0, 255, 0, 0.5)';
+  source.fillRect(2, 0, 1, 1);
+  var png = source.toPngBuffer();
+  source.release();
+
+  context2d.decodeImage(png, function(err, bitmap) {
+    helpers.ok(t, !err, "decodes without error");
+    helpers.assertEqual(t, bitmap.width, 4, "bitmap.width", "4");
+    helpers.assertEqual(t, bitmap.height, 1, "bitmap.height", "1");
+
+    ctx.drawImage(bitmap, 0, 0);
+    helpers.assertPixel(t, canvas, 0,0, 255,0,0,255, "0,0", "255,0,0,255");
+    helpers.assertPixelApprox(t, canvas, 2,0, 0,255,0,128, "2,0", "0,255,0,128", 2);
+    helpers.assertPixel(t, canvas, 3,0, 0,0,0,0, "3,0", "0,0,0,0");
+
+    context2d.decodeImage(new Buffer('not an image'), function(err) {
+      helpers.ok(t, err instanceof Error, "unknown data fails");
+      t.done()
+    });
+  });
+});
+
+
+test(module, 'context2d.drawImage.decodeImage.sampled',null, function(t) {
+  var context2d = require('../../context2d');
+
+  var source = context2d.acquire(64, 48);
+  source.fillStyle = '#00f';
+  source.fillRect(0, 0, 64, 48);
+  var png = source.toPngBuffer();
+  source.release();
+
+  // 64x48 covers 15x10 at a quarter of the size, not at an eighth
+  context2d.decodeImage(png, { width: 15, height: 10 }, function(err, bitmap) {
+    helpers.ok(t, !err, "decodes without error");
+    helpers.assertEqual(t, bitmap.width, 16, "bitmap.width", "16");
+    helpers.assertEqual(t, bitmap.height, 12, "bitmap.height", "12");
+
+    context2d.decodeImage(png, { sampleSize: 2 }, function(err, bitmap) {
+      helpers.assertEqual(t, bitmap.width, 32, "bitmap.width", "32");
+      helpers.assertEqual(t, bitmap.height, 24, "bitmap.height", "24");
+      t.done()
+    });
+  });
+});
+
+
+test(module, 'context2d.drawImage.regionImage',null, function(t) {
+  var context2d = require('../../context2d');
+  var window = helpers.createWindow();
+  var document = window.document;
+
+  var canvas = helpers.createCanvas(t, document, 40, 40);
+  var ctx = canvas.getContext('2d')
+
+  // four quadrants, each spanning several tiles
+  var source = context2d.acquire(320, 320);
+  source.fillStyle = '#f00';
+  source.fillRect(0, 0, 160, 160);
+  source.fillStyle = '#0f0';
+  source.fillRect(160, 0, 160, 160);
+  source.fillStyle = '#00f';
+  source.fillRect(0, 160, 160, 160);
+  source.fillStyle = '#fff';
+  source.fillRect(160, 160, 160, 160);
+  var image = new context2d.RegionImage(source.toPngBuffer(), { tileSize: 32, maxTiles: 8 });
+  source.release();
+
+  helpers.assertEqual(t, image.width, 320, "image.width", "320");
+  helpers.assertEqual(t, image.height, 320, "image.height", "320");
+
+  // a crop across the middle decodes the four tiles under it
+  ctx.drawImage(image, 140, 140, 40, 40, 0, 0, 40, 40);
+  helpers.assertPixel(t, canvas, 5,5, 255,0,0,255, "5,5", "255,0,0,255");
+  helpers.assertPixel(t, canvas, 35,5, 0,255,0,255, "35,5", "0,255,0,255");
+  helpers.assertPixel(t, canvas, 5,35, 0,0,255,255, "5,35", "0,0,255,255");
+  helpers.assertPixel(t, canvas, 35,35, 255,255,255,255, "35,35", "255,255,255,255");
+  helpers.assertEqual(t, image.cacheStats().misses, 4, "misses", "4");
+
+  ctx.drawImage(image, 140, 140, 40, 40, 0, 0, 40, 40);
+  helpers.assertEqual(t, image.cacheStats().hits, 4, "hits", "4");
+
+  // the whole image at an eighth of the size samples by 8, the cache stays
+  // bounded
+  ctx.drawImage(image, 0, 0, 40, 40);
+  helpers.assertPixel(t, canvas, 30,10, 0,255,0,255, "30,10", "0,255,0,255");
+  helpers.ok(t, image.cacheStats().tiles <= 8, "cache is bounded");
+
+  image.close();
+  try {
+    ctx.drawImage(image, 0, 0);
+    helpers.ok(t, false, "should have thrown exception");
+  } catch (e) {
+    helpers.ok(t, e instanceof DOMException && e.code === DOMException.INVALID_STATE_ERR, "should throw INVALID_STATE_ERR");
+  }
+
+  t.done()
+});
+
+
+test(module, 'context2d.drawImage.lazyImage',null, function(t) {
+  var context2d = require('../../context2d');
+  var window = helpers.createWindow();
+  var document = window.document;
+
+  var canvas = helpers.createCanvas(t, document, 32, 32);
+  var ctx = canvas.getContext('2d')
+
+  var source = context2d.acquire(32, 32);
+  source.fillStyle = '#0f0';
+  source.fillRect(0, 0, 32, 32);
+  var png = source.toPngBuffer();
+  source.release();
+
+  var a = context2d.createLazyImage(png);
+  var b = context2d.createLazyImage(png);
+  helpers.assertEqual(t, a.width, 32, "a.width", "32");
+
+  // nothing is decoded before the first draw
+  var before = context2d.imageCacheStats();
+  ctx.drawImage(a, 0, 0);
+  helpers.assertPixel(t, canvas, 16,16, 0,255,0,255, "16,16", "0,255,0,255");
+
+  var stats = context2d.imageCacheStats();
+  helpers.assertEqual(t, stats.decodes - before.decodes, 1, "decodes", "1");
+
+  ctx.drawImage(a, 0, 0);
+  helpers.ok(t, context2d.imageCacheStats().hits > stats.hits, "second draw hits the cache");
+
+  // room for a single image: drawing b evicts a, which decodes again
+  context2d.setImageCacheLimit(32 * 32 * 4);
+  ctx.drawImage(b, 0, 0);
+  ctx.clearRect(0, 0, 32, 32);
+  ctx.drawImage(a, 0, 0);
+  helpers.assertPixel(t, canvas, 16,16, 0,255,0,255, "16,16", "0,255,0,255");
+
+  var after = context2d.imageCacheStats();
+  helpers.ok(t, after.evictions - stats.evictions >= 2, "a and b were evicted");
+  helpers.ok(t, after.misses > stats.misses, "a was decoded again");
+  helpers.ok(t, after.used <= after.limit, "usage within the limit");
+
+  context2d.setImageCacheLimit(64 * 1024 * 1024);
+  t.done()
+});
+
+
+test(module, 'context2d.drawImage.animatedImage',null, function(t) {
+  var context2d = require('../../context2d');
+  if (!context2d.decoders.gif) {
+    // needs a build with -Dwith_gif=1
+    return t.done();
+  }
+
+  var window = helpers.createWindow();
+  var document = window.document;
+
+  var canvas = helpers.createCanvas(t, document, 2, 1);
+  var ctx = canvas.getContext('2d')
+
+  // 2x1 on a blue background, 100ms per 1x1 frame: red at 0,0, green at
+  // 1,0 and then black at 0,0, each drawn over the last
+  var frame = function(x, color) {
+    return [
+      0x21, 0xf9, 0x04, 0x04, 0x0a, 0x00, 0x00, 0x00,
+      0x2c, x, 0x00, 0x00, 0x00, 0x01, 0x00, 0x01, 0x00, 0x00,
+      0x02, 0x02, 0x44 | (color << 3), 0x01, 0x00
+    ];
+  };
+  var gif = new Buffer([].concat(
+    [0x47, 0x49, 0x46, 0x38, 0x39, 0x61, 0x02, 0x00, 0x01, 0x00, 0x91, 0x02, 0x00],
+    [0xff, 0x00, 0x00, 0x00, 0xff, 0x00, 0x00, 0x00, 0xff, 0x00, 0x00, 0x00],
+    frame(0, 0), frame(1, 1), frame(0, 3),
+    [0x3b]
+  ));
+
+  var anim = new context2d.AnimatedImage(gif, { frameCache: 2 });
+  helpers.assertEqual(t, anim.frameCount, 3, "frameCount", "3");
+  helpers.assertEqual(t, anim.duration, 300, "duration", "300");
+  helpers.assertEqual(t, anim.frameAtTime(150), 1, "frameAtTime(150)", "1");
+  helpers.assertEqual(t, anim.frameAtTime(350), 0, "frameAtTime(350)", "0");
+
+  anim.currentFrame = 2;
+  ctx.drawImage(anim, 0, 0);
+  helpers.assertPixel(t, canvas, 0,0, 0,0,0,255, "0,0", "0,0,0,255");
+  helpers.assertPixel(t, canvas, 1,0, 0,255,0,255, "1,0", "0,255,0,255");
+
+  anim.currentFrame = 0;
+  ctx.drawImage(anim, 0, 0);
+  helpers.assertPixel(t, canvas, 0,0, 255,0,0,255, "0,0", "255,0,0,255");
+  helpers.assertPixel(t, canvas, 1,0, 0,0,255,255, "1,0", "0,0,255,255");
+
+  // frame 1 resumes from frame 0, still in the ring
+  var stats = anim.cacheStats();
+  anim.currentFrame = anim.frameAtTime(150);
+  ctx.drawImage(anim, 0, 0);
+  helpers.assertPixel(t, canvas, 1,0, 0,255,0,255, "1,0", "0,255,0,255");
+  helpers.assertEqual(t, anim.cacheStats().composited - stats.composited, 1, "composited", "1");
+
+  try {
+    anim.getFrame(3);
+    helpers.ok(t, false, "should have thrown exception");
+  } catch (e) {
+    helpers.ok(t, e instanceof RangeError, "frame index out of range");
+  }
+
+  anim.close();
+  t.done()
+});
@@ -1262,3 +1262,26 @@ test(module, '2d.fillStyle.parse.transparent-2','2d.fillStyle.parse.transparent-
   t.done()
 });
 
+
+test(module, 'context2d.fillStyle.colorCache',null, function(t) {
+  var window = helpers.createWindow();
+  var document = window.document;
+
+  var canvas = helpers.createCanvas(t, document, 100, 50);
+  var ctx = canvas.getContext('2d')
+  var context2d = require('../../context2d');
+
+  ctx.fillStyle = 'rgba(12, 34, 56, 0.5)';
+  var before = context2d.colorCacheStats();
+  ctx.fillStyle = 'rgba(12, 34, 56, 0.5)';
+  ctx.strokeStyle = 'rgba(12, 34, 56, 0.5)';
+  var after = context2d.colorCacheStats();
+
+  helpers.assertEqual(t, after.hits - before.hits, 2, "after.hits - before.hits", "2");
+  helpers.assertEqual(t, after.misses, before.misses, "after.misses", "before.misses");
+  helpers.assertEqual(t, ctx.fillStyle, 'rgba(12, 34, 56, 0.5)', "ctx.fillStyle", "'rgba(12, 34, 56, 0.5)'");
+  helpers.assertEqual(t, context2d.parseColor('#0f0'), 0xff00ff00, "context2d.parseColor('#0f0')", "0xff00ff00");
+  helpers.assertEqual(t, context2d.parseColor('bogus'), undefined, "context2d.parseColor('bogus')", "undefined");
+
+  t.done()
+});
@@ -1520,3 +1520,123 @@ test(module, '2d.imageData.put.wrongtype','green-100x50.png', function(t) {
   t.done()
 });
 
+
+
+test(module, 'context2d.imageData.get.rows',null, function(t) {
+  var window = helpers.createWindow();
+  var document = window.document;
+
+  var canvas = helpers.createCanvas(t, document, 11, 3);
+  var ctx = canvas.getContext('2d')
+
+  // opaque, translucent and transparent pixels across the 4 pixel groups
+  // and the scalar tail of each row
+  ctx.fillStyle = '#f80';
+  ctx.fillRect(0, 0, 3, 3);
+  ctx.fillStyle = 'rgba(16, 128, 255, 0.3)';
+  ctx.fillRect(3, 0, 5, 3);
+
+  var imgdata = ctx.getImageData(1, 1, 10, 2);
+  var matches = true;
+  for (var y = 0; y < 2; y++) {
+    for (var x = 0; x < 10; x++) {
+      var p = ctx.getPixel(x + 1, y + 1);
+      var i = (y * 10 + x) * 4;
+      if (imgdata.data[i] !== p.r || imgdata.data[i+1] !== p.g ||
+          imgdata.data[i+2] !== p.b || imgdata.data[i+3] !== p.a)
+      {
+        matches = false;
+      }
+    }
+  }
+  helpers.ok(t, matches, "matches");
+
+  t.done()
+});
+
+
+test(module, 'context2d.imageData.put.offsurface',null, function(t) {
+  var window = helpers.createWindow();
+  var document = window.document;
+
+  var canvas = helpers.createCanvas(t, document, 5, 5);
+  var ctx = canvas.getContext('2d')
+
+  var imgdata = ctx.createImageData(6, 4);
+  for (var i = 0; i < 24; i++) {
+    imgdata.data[i*4] = i * 10;
+    imgdata.data[i*4+1] = 255 - i;
+    imgdata.data[i*4+2] = i;
+    imgdata.data[i*4+3] = 255;
+  }
+
+  // only the bottom right 3x2 of the image lands on the surface
+  ctx.putImageData(imgdata, -3, -2);
+  helpers.assertPixel(t, canvas, 0,0, 150,240,15,255, "0,0", "150,240,15,255");
+  helpers.assertPixel(t, canvas, 2,1, 230,232,23,255, "2,1", "230,232,23,255");
+  helpers.assertPixel(t, canvas, 3,1, 0,0,0,0, "3,1", "0,0,0,0");
+  helpers.assertPixel(t, canvas, 0,2, 0,0,0,0, "0,2", "0,0,0,0");
+
+  t.done()
+});
+
+
+test(module, 'context2d.imageData.lockPixels',null, function(t) {
+  var window = helpers.createWindow();
+  var document = window.document;
+
+  var canvas = helpers.createCanvas(t, document, 3, 2);
+  var ctx = canvas.getContext('2d')
+
+  ctx.fillStyle = '#00f';
+  ctx.fillRect(0, 0, 3, 2);
+
+  var pixels = ctx.lockPixels();
+  helpers.assertEqual(t, pixels.stride, 12, "pixels.stride", "12");
+  helpers.assertEqual(t, pixels.length, 24, "pixels.length", "24");
+  helpers.assertEqual(t, ctx.lockPixels(), pixels, "ctx.lockPixels()", "pixels");
+
+  // second pixel of the second row to opaque green, in place
+  var o = pixels.stride + 4;
+  var r = pixels.format === 'rgba' ? 0 : 2;
+  pixels[o + r] = 0;
+  pixels[o + 1] = 255;
+  pixels[o + 2 - r] = 0;
+  ctx.unlockPixels();
+
+  helpers.assertPixel(t, canvas, 1,1, 0,255,0,255, "1,1", "0,255,0,255");
+  helpers.assertPixel(t, canvas, 0,1, 0,0,255,255, "0,1", "0,0,255,255");
+  helpers.assertEqual(t, pixels.length, 0, "pixels.length", "0");
+
+  t.done()
+});
+
+
+test(module, 'context2d.imageData.lockPixels.toBuffer',null, function(t) {
+  var window = helpers.createWindow();
+  var document = window.document;
+
+  var canvas = helpers.createCanvas(t, document, 3, 2);
+  var ctx = canvas.getContext('2d')
+
+  ctx.fillStyle = '#00f';
+  ctx.fillRect(0, 0, 3, 2);
+
+  var pixels = ctx.lockPixels();
+  var frozen = ctx.toBuffer({ copy: false });
+
+  // the view keeps showing what is drawn, the buffer the frame it was taken
+  // from
+  ctx.fillStyle = '#0f0';
+  ctx.fillRect(0, 0, 3, 2);
+  helpers.assertEqual(t, pixels[1], 255, "pixels[1]", "255");
+  helpers.assertEqual(t, frozen[1], 0, "frozen[1]", "0");
+
+  pixels[1] = 128;
+  helpers.assertEqual(t, frozen[1], 0, "frozen[1] after writing the view", "0");
+  ctx.unlockPixels();
+
+  helpers.assertPixel(t, canvas, 0,0, 0,128,0,255, "0,0", "0,128,0,255");
+
+  t.done()
+});
@@ -0,0 +1,131 @@
+var helpers = require('../helpers');
+var test = helpers.test;
+var Canvas = helpers.Canvas;
+var Image = helpers.Image;
+var DOMException = helpers.DOMException;
+var wrapFunction = helpers.wrapFunction;
+var CommandBuffer = require('../../context2d').CommandBuffer;
+
+test(module, 'context2d.submit.path',null, function(t) {
+  var window = helpers.createWindow();
+  var document = window.document;
+
+  var canvas = helpers.createCanvas(t, document, 100, 50);
+  var ctx = canvas.getContext('2d')
+
+  ctx.fillStyle = '#f00';
+  ctx.fillRect(0, 0, 100, 50);
+  ctx.fillStyle = '#0f0';
+
+  var commands = new CommandBuffer(4);
+  commands.beginPath()
+          .moveTo(0, 0)
+          .lineTo(100, 0)
+          .lineTo(100, 50)
+          .lineTo(0, 50)
+          .closePath()
+          .fill();
+
+  ctx.submit(commands);
+  helpers.assertPixel(t, canvas, 50,25, 0,255,0,255, "50,25", "0,255,0,255");
+
+  t.done()
+});
+
+
+test(module, 'context2d.submit.transform',null, function(t) {
+  var window = helpers.createWindow();
+  var document = window.document;
+
+  var canvas = helpers.createCanvas(t, document, 100, 50);
+  var ctx = canvas.getContext('2d')
+
+  ctx.fillStyle = '#f00';
+  ctx.fillRect(0, 0, 100, 50);
+  ctx.fillStyle = '#0f0';
+
+  var commands = new CommandBuffer();
+  commands.translate(50, 0)
+          .fillRect(0, 0, 50, 50)
+          .setTransform(1, 0, 0, 1, 0, 0)
+          .fillRect(0, 0, 50, 50)
+          .fillRect(Infinity, 0, 100, 50);
+
+  ctx.submit(commands.data, commands.length);
+  helpers.assertPixel(t, canvas, 25,25, 0,255,0,255, "25,25", "0,255,0,255");
+  helpers.assertPixel(t, canvas, 75,25, 0,255,0,255, "75,25", "0,255,0,255");
+
+  t.done()
+});
+
+
+test(module, 'context2d.submit.saveRestore',null, function(t) {
+  var window = helpers.createWindow();
+  var document = window.document;
+
+  var canvas = helpers.createCanvas(t, document, 100, 50);
+  var ctx = canvas.getContext('2d')
+
+  ctx.fillStyle = '#0f0';
+  ctx.save();
+  ctx.fillStyle = '#f00';
+
+  var commands = new CommandBuffer();
+  commands.restore()
+          .save()
+          .translate(50, 0)
+          .fillRect(0, 0, 50, 50);
+
+  ctx.submit(commands);
+  ctx.fillRect(0, 0, 50, 50);
+  helpers.assertPixel(t, canvas, 25,25, 0,255,0,255, "25,25", "0,255,0,255");
+  helpers.assertPixel(t, canvas, 75,25, 0,255,0,255, "75,25", "0,255,0,255");
+
+  ctx.restore();
+  helpers.assertEqual(t, ctx.fillStyle, '#00ff00', "ctx.fillStyle", "'#00ff00'");
+
+  t.done()
+});
+
+test(module, 'context2d.submit.invalid',null, function(t) {
+  var window = helpers.createWindow();
+  var document = window.document;
+
+  var canvas = helpers.createCanvas(t, document, 100, 50);
+  var ctx = canvas.getContext('2d')
+
+  try { ctx.submit(new Float64Array([ 3, 0 ])); t.fail("Failed to throw exception"); } catch (e) { }
+  try { ctx.submit(new Float64Array([ 255 ])); t.fail("Failed to throw exception"); } catch (e) { }
+
+  t.done()
+});
+
+test(module, 'context2d.submit.invalidRadius',null, function(t) {
+  var window = helpers.createWindow();
+  var document = window.document;
+
+  var canvas = helpers.createCanvas(t, document, 100, 50);
+  var ctx = canvas.getContext('2d')
+
+  ctx.fillStyle = '#0f0';
+  ctx.fillRect(0, 0, 100, 50);
+  ctx.fillStyle = '#f00';
+
+  // the fillRect ahead of the bad arc must not be drawn either
+  var commands = new CommandBuffer(4);
+  commands.fillRect(0, 0, 100, 50)
+          .beginPath()
+          .arc(50, 25, -1, 0, Math.PI, false)
+          .fill();
+
+  try {
+    ctx.submit(commands);
+    helpers.ok(t, false, "should have thrown exception");
+  } catch (e) {
+    helpers.assertEqual(t, e.code, DOMException.INDEX_SIZE_ERR, "e.code", "DOMException.INDEX_SIZE_ERR");
+  }
+
+  helpers.assertPixel(t, canvas, 50,25, 0,255,0,255, "50,25", "0,255,0,255");
+
+  t.done()
+});
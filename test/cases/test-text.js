@@ -1113,3 +1113,27 @@ test(module, '2d.text.measure.width.space',null, function(t) {
 
 });
 
+
+test(module, 'context2d.text.font.cache',null, function(t) {
+  var window = helpers.createWindow();
+  var document = window.document;
+
+  var canvas = helpers.createCanvas(t, document, 100, 50);
+  var ctx = canvas.getContext('2d')
+  var context2d = require('../../context2d');
+
+  ctx.font = '13px sans-serif';
+  var before = context2d.fontCacheStats();
+  ctx.font = '13px sans-serif';
+  var after = context2d.fontCacheStats();
+
+  helpers.assertEqual(t, after.hits - before.hits, 1, "after.hits - before.hits", "1");
+  helpers.assertEqual(t, after.parsed.hits - before.parsed.hits, 1, "after.parsed.hits - before.parsed.hits", "1");
+  helpers.assertEqual(t, ctx.font, '13px sans-serif', "ctx.font", "'13px sans-serif'");
+
+  context2d.setFontCacheLimit(1);
+  helpers.assertEqual(t, context2d.fontCacheStats().entries, 1, "context2d.fontCacheStats().entries", "1");
+  context2d.setFontCacheLimit(64);
+
+  t.done()
+});
@@ -53,6 +53,7 @@ var files = [
   'cases/test-state.js',
   'cases/test-strokeRect.js',
   'cases/test-strokeStyle.js',
+  'cases/test-submit.js',
   'cases/test-text.js',
   'cases/test-transformation.js',
   'cases/test-voidreturn.js'